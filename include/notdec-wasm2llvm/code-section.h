@@ -0,0 +1,92 @@
+#ifndef _NOTDEC_WASM2LLVM_CODE_SECTION_H_
+#define _NOTDEC_WASM2LLVM_CODE_SECTION_H_
+
+#include <cstddef>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "wabt/ir.h"
+
+namespace notdec::frontend::wasm {
+
+/// The sections of a wasm binary needed to decode the function bodies one at
+/// a time, found by one scan of the section headers. The ranges are
+/// [begin, end) byte offsets into the binary.
+struct CodeSectionIndex {
+  // the whole code section, including the section id and size
+  std::pair<std::size_t, std::size_t> codeSection;
+  // the data segment count, if there is a data count section
+  std::optional<uint32_t> dataCount;
+  // each function body, after its size prefix
+  std::vector<std::pair<std::size_t, std::size_t>> bodies;
+};
+
+/// Scan the section headers and the size prefixes of the function bodies.
+/// Returns false if the binary is malformed.
+bool indexCodeSection(const std::vector<uint8_t> &binary,
+                      CodeSectionIndex &index);
+
+/// Copy the binary with every function body replaced by an empty one, so that
+/// reading it only decodes the module level sections.
+std::vector<uint8_t> stripFunctionBodies(const std::vector<uint8_t> &binary,
+                                         const CodeSectionIndex &index);
+
+/// Decode the body `bodyIndex` of the code section into the locals and the
+/// instructions of `func`. The body is read from a small module holding only
+/// the function, plus placeholder data segments if the body may use
+/// memory.init or data.drop, and the signatures of its blocks and indirect
+/// calls are taken from `module`, so the type section is never read again.
+/// The indices in the body are kept as is. Returns false if the body cannot
+/// be decoded.
+bool decodeFuncBody(const std::vector<uint8_t> &binary,
+                    const CodeSectionIndex &index, std::size_t bodyIndex,
+                    const wabt::Module &module,
+                    const wabt::Features &features, wabt::Func &func);
+
+/// Decodes the function bodies for the translation, which takes them in order
+/// with `get`. With threads, the bodies are decoded concurrently in the
+/// background, at most `window` bodies ahead of the translation to bound the
+/// memory. Without threads, each body is decoded by `get`.
+class BodyDecoder {
+public:
+  BodyDecoder(const std::vector<uint8_t> &binary,
+              const CodeSectionIndex &index, const wabt::Module &module,
+              std::vector<wabt::Func *> funcs, const wabt::Features &features,
+              unsigned threads);
+  ~BodyDecoder();
+
+  // Wait for the body of the non-imported function `i`. Returns false if it
+  // cannot be decoded.
+  bool get(std::size_t i);
+
+private:
+  enum class State { Pending, Decoded, Failed };
+
+  void work();
+
+  const std::vector<uint8_t> &binary;
+  const CodeSectionIndex &index;
+  // only its types are read, which the translation does not change
+  const wabt::Module &module;
+  std::vector<wabt::Func *> funcs;
+  wabt::Features features;
+  std::size_t window;
+
+  std::mutex mutex;
+  std::condition_variable cond;
+  std::vector<State> states;
+  // the next body to decode, and the body being translated
+  std::size_t next = 0;
+  std::size_t current = 0;
+  bool stopping = false;
+  std::vector<std::thread> workers;
+};
+
+} // namespace notdec::frontend::wasm
+
+#endif
@@ -29,6 +29,46 @@ struct Options {
   /// (Breaks execution!) Do not generate memory initializer, because currently
   /// the initializer is flattened, which makes the bytecode really big in size.
   bool NoMemInitializer : 1;
+  /// (Assumption!) Attach type-based alias analysis metadata to memory
+  /// accesses, assuming that accesses of different scalar types never alias.
+  bool GenTBAA : 1;
+  /// (Assumption!) Lift the __stack_pointer frame of each function into a
+  /// native alloca when the frame does not escape, assuming that accesses with
+  /// a dynamic offset stay inside the frame.
+  bool LiftStackFrames : 1;
+  /// (Assumption!) Assume that the host never writes the linear memory, even
+  /// through the addresses passed to the imported functions or an exported
+  /// memory, so that more data segments are found read-only and folded.
+  bool NoHostWrites : 1;
+  /// (Assumption!) Use the alignment hints of the memory accesses as their
+  /// alignment, assuming that the hints hold. Otherwise misaligned accesses
+  /// are allowed, as in wasm.
+  bool TrustAlignHints : 1;
+  /// If true, lower relaxed SIMD instructions with their deterministic
+  /// semantics, instead of the fastest instruction of the host.
+  bool DeterministicSIMD : 1;
+  /// Access the linear memory through a base pointer global, loaded once in
+  /// each function, instead of indexing the memory array. The host may point
+  /// it to a memory allocated at runtime, holding the initial contents.
+  bool MemBasePointer : 1;
+  /// Keep the memory base pointers, the mutable globals and the tables in a
+  /// per-instance struct passed as the first argument of every function, so
+  /// that one process can run many instances of the module.
+  bool InstanceContext : 1;
+  /// With SplitMem, write the large data segments to binary files next to the
+  /// output, included with .incbin by the module asm, instead of printing the
+  /// bytes into the module.
+  bool IncbinData : 1;
+  /// (Assumption!) Skip the validation of the input, which is trusted to be
+  /// valid. Malformed function bodies stop the translation with an error.
+  bool NoValidate : 1;
+  /// Decode each function body right before it is translated and free it
+  /// afterwards, instead of decoding the whole module first. Implies
+  /// NoValidate.
+  bool DecodePerFunction : 1;
+  /// With DecodePerFunction, the number of threads decoding the function
+  /// bodies ahead of the translation, or 0 to decode them in order.
+  unsigned DecodeThreads;
   int LogLevel;
 };
 
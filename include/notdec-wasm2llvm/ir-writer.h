@@ -0,0 +1,23 @@
+#ifndef _NOTDEC_WASM2LLVM_IR_WRITER_H_
+#define _NOTDEC_WASM2LLVM_IR_WRITER_H_
+
+#include <string>
+
+#include <llvm/IR/Module.h>
+
+namespace notdec::frontend::wasm {
+
+/// Rewrite the large byte array initializers, e.g. the flattened memory, to
+/// packed structs of the data and the zeroinitializer runs between them. The
+/// layout of the globals is unchanged, and the accesses carry their own
+/// element types, so the module is equivalent, but the zero bytes are no
+/// longer printed one by one as "\00".
+void compactInitializers(llvm::Module &mod);
+
+/// Print the module as textual IR with the initializers compacted, through a
+/// large output buffer. Returns false if the file cannot be opened.
+bool writeTextualIR(llvm::Module &mod, const std::string &path);
+
+} // namespace notdec::frontend::wasm
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef _NOTDEC_WASM2LLVM_LINK_HOST_H_
+#define _NOTDEC_WASM2LLVM_LINK_HOST_H_
+
+#include <string>
+
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/TargetParser/Triple.h>
+
+namespace notdec::frontend::wasm {
+
+/// Link the host implementations of the imported functions from the bitcode
+/// or IR file into the translated module, e.g. notdec-wasi.bc of the runtime.
+/// The whole host module is linked, so the host program must not link the
+/// same library again. Small imports are marked alwaysinline, so that the
+/// import calls are inlined even at -O0.
+///
+/// Returns false if the file cannot be read or linked.
+bool linkHostModule(llvm::Module &mod, const std::string &path, int logLevel);
+
+/// Read the target triple and data layout of the host module, without
+/// loading the function bodies, for the outputs written before the host
+/// module is linked. Returns false if the file cannot be read.
+bool readHostTarget(const std::string &path, llvm::LLVMContext &ctx,
+                    llvm::Triple &triple, std::string &dataLayout);
+
+} // namespace notdec::frontend::wasm
+
+#endif
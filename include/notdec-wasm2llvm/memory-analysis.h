@@ -0,0 +1,49 @@
+#ifndef _NOTDEC_WASM2LLVM_MEMORY_ANALYSIS_H_
+#define _NOTDEC_WASM2LLVM_MEMORY_ANALYSIS_H_
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <vector>
+
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/GlobalVariable.h>
+
+#include "parser.h"
+
+namespace notdec::frontend::wasm {
+
+/// Byte ranges [begin, end) of a linear memory, keyed by begin.
+using MemRanges = std::map<uint64_t, uint64_t>;
+
+/// Collect the byte ranges of the linear memory `mem` that may be written by
+/// the translated functions: stores, atomics, and the destinations of memory
+/// intrinsics (memory.copy, memory.fill and memory.init). Dynamic addresses
+/// are bounded with a simple range analysis.
+///
+/// Returns std::nullopt if a write is unbounded, or the address of the memory
+/// escapes.
+std::optional<MemRanges> collectMemWrites(llvm::GlobalVariable *mem);
+
+/// Whether a call to one of the `imports` may pass an address of the linear
+/// memory, which the host may write through, e.g. the buffer of WASI fd_read.
+/// Addresses are plain integers, so any integer argument may be one, and an
+/// import whose address is taken may be called indirectly with any arguments.
+bool mayPassMemAddress(llvm::ArrayRef<llvm::Function *> imports);
+
+/// Whether [begin, end) overlaps any of the ranges.
+bool overlaps(const MemRanges &ranges, uint64_t begin, uint64_t end);
+
+/// Replace the loads of `mem` from read-only data with the constant bytes, and
+/// fold the instructions that become constant, so loads at constant offsets
+/// from loaded table bases are folded as well. A load at a bounded dynamic
+/// address in a small table becomes a select chain.
+///
+/// Returns the number of folded loads.
+unsigned foldReadOnlyLoads(llvm::GlobalVariable *mem,
+                           const std::vector<DataRange> &data, int logLevel);
+
+} // namespace notdec::frontend::wasm
+
+#endif
@@ -3,6 +3,7 @@
 
 #include <deque>
 #include <iostream>
+#include <string>
 #include <vector>
 
 // wabt header
@@ -15,6 +16,15 @@
 
 namespace notdec::frontend::wasm {
 
+// Exception handler of a try block with catches. Calls in the try body unwind
+// to `lpad`, which forwards the exception to `dispatch`. Unmatched exceptions
+// of inner try blocks are also forwarded to `dispatch` through the `exn` phi.
+struct TryHandler {
+  llvm::BasicBlock *lpad;
+  llvm::BasicBlock *dispatch;
+  llvm::PHINode *exn;
+};
+
 struct BreakoutTarget {
   llvm::BasicBlock &target;
   std::deque<llvm::PHINode *> phis;
@@ -22,6 +32,13 @@ struct BreakoutTarget {
   std::size_t pos;
   wabt::BlockDeclaration &sig;
   wabt::LabelType lty;
+  // handler of exceptions thrown in this block, nullptr for the caller.
+  TryHandler *handler = nullptr;
+  // caught exception, tag and payload buffer in catch blocks, used by
+  // rethrow. Foreign exceptions are released when the catch block is left.
+  llvm::Value *exn = nullptr;
+  llvm::Value *exnTag = nullptr;
+  llvm::Value *exnPayload = nullptr;
 
   BreakoutTarget(llvm::BasicBlock &target, std::deque<llvm::PHINode *> phis,
                  std::size_t pos, wabt::BlockDeclaration &sig,
@@ -61,6 +78,8 @@ struct extendType {
   llvm::FixedVectorType *i16x32Type;
   llvm::FixedVectorType *i32x16Type;
   llvm::FixedVectorType *i64x8Type;
+  // canonical type of v128 across locals, globals, calls and phis.
+  llvm::FixedVectorType *v128Type;
   extendType(llvm::LLVMContext &llvmContext);
 };
 
@@ -74,6 +93,17 @@ struct BlockContext {
   // wasm stack
   std::vector<llvm::Value *> stack;
   std::vector<wabt::Type> type_stack;
+  // shared block calling llvm.trap, created on first use.
+  llvm::BasicBlock *trapBlock = nullptr;
+  // handlers of try blocks, deque for stable pointers.
+  std::deque<TryHandler> tryHandlers;
+  // buffer to pack the payload of thrown exceptions, created on first use.
+  llvm::AllocaInst *throwPayload = nullptr;
+  // base pointer of the memory loaded at the entry, with MemBasePointer or
+  // InstanceContext.
+  llvm::Value *memBase = nullptr;
+  // the instance argument with InstanceContext.
+  llvm::Value *instance = nullptr;
   int log_level;
   extendType type;
 
@@ -86,11 +116,14 @@ struct BlockContext {
 
   void visitBlock(wabt::LabelType lty, llvm::BasicBlock *entry,
                   llvm::BasicBlock *exit, wabt::BlockDeclaration &decl,
-                  wabt::ExprList &exprs);
+                  wabt::ExprList &exprs, bool keepTarget = false,
+                  TryHandler *handler = nullptr);
   void visitControlInsts(llvm::BasicBlock *entry, llvm::BasicBlock *exit,
                          wabt::ExprList &exprs);
   void dispatchExprs(wabt::Expr &expr);
   void unwindStackTo(size_t pos);
+  llvm::Value *toV128(llvm::Value *val);
+  void normalizeStack(std::size_t num);
 
   llvm::Instruction *visitBr(wabt::Expr *expr, std::size_t ind,
                              llvm::Value *cond, llvm::BasicBlock *nextBlock);
@@ -102,11 +135,58 @@ struct BlockContext {
   void visitConstInst(wabt::ConstExpr *expr);
   void visitCallInst(wabt::CallExpr *expr);
   void visitCallIndirectInst(wabt::CallIndirectExpr *expr);
+  void visitReturnCall(wabt::ReturnCallExpr *expr);
+  void visitReturnCallIndirect(wabt::ReturnCallIndirectExpr *expr);
+  llvm::Value *createIndirectCallee(const wabt::Var &tableVar);
+  void createReturnCall(llvm::FunctionType *funcType, llvm::Value *callee);
   void visitSelectExpr(wabt::SelectExpr *expr);
+  llvm::Value *createCall(llvm::FunctionType *funcType, llvm::Value *callee,
+                          llvm::ArrayRef<llvm::Value *> args);
+
+  void visitTry(wabt::TryExpr *expr);
+  TryHandler *createTryHandler();
+  void visitThrow(wabt::ThrowExpr *expr);
+  void visitRethrow(wabt::RethrowExpr *expr);
+  void createThrow(llvm::Value *tag, llvm::Value *payload);
+  bool leavesCatch(std::size_t ind);
+  void createEndCatch(std::size_t ind);
+  llvm::BasicBlock *createLeaveBlock(std::size_t ind);
+  llvm::AllocaInst *createEntryAlloca(llvm::Type *ty, const llvm::Twine &name);
+  uint32_t getExnPayloadSize();
+
+  void visitMemoryInit(wabt::MemoryInitExpr *expr);
+  void visitDataDrop(wabt::DataDropExpr *expr);
+  void visitTableInit(wabt::TableInitExpr *expr);
+  void visitTableCopy(wabt::TableCopyExpr *expr);
+  void visitElemDrop(wabt::ElemDropExpr *expr);
+  void visitTableGet(wabt::TableGetExpr *expr);
+  void visitTableSet(wabt::TableSetExpr *expr);
+  void visitTableSize(wabt::TableSizeExpr *expr);
+  void visitTableGrow(wabt::TableGrowExpr *expr);
+  void visitTableFill(wabt::TableFillExpr *expr);
+  void visitRefIsNull(wabt::RefIsNullExpr *expr);
+  llvm::Value *createSegmentAccess(SegmentInfo &seg, llvm::Value *offset,
+                                   llvm::Value *num);
+  llvm::Value *createTableAccess(llvm::Value *table,
+                                 llvm::Value *offset, llvm::Value *num);
+  llvm::Value *createTableElems(llvm::Value *table);
+  llvm::Value *createTableSize(llvm::Value *table);
+  llvm::Value *getTablePtr(const wabt::Var &var) {
+    return ctx.getTablePtr(irBuilder, instance, ctx.module->GetTableIndex(var));
+  }
+  llvm::Value *createPtrArraySize(llvm::Value *num);
+  void createTrapIf(llvm::Value *cond);
+  llvm::Value *createTruncSat(llvm::Value *val, llvm::Type *intType,
+                              bool isSigned);
+  llvm::Value *createTruncTrapping(llvm::Value *val, llvm::Type *intType,
+                                   bool isSigned);
 
   void visitLoadInst(wabt::LoadExpr *expr);
+  void createLoad(wabt::Opcode opcode, wabt::Address align,
+                  wabt::Address offset);
   void visitStoreInst(wabt::StoreExpr *expr);
   llvm::Value *convertStackAddr(uint64_t offset);
+  llvm::Align getAccessAlign(wabt::Opcode opcode, wabt::Address align);
 
   void visitLocalGet(wabt::LocalGetExpr *expr);
   void visitLocalSet(wabt::LocalSetExpr *expr);
@@ -132,12 +212,45 @@ struct BlockContext {
                                 llvm::FixedVectorType *vectorType,
                                 llvm::FixedVectorType *destType,
                                 unsigned int startIdx, bool sign);
+  llvm::Value *createSIMDNarrow(llvm::Value *left, llvm::Value *right,
+                                llvm::FixedVectorType *vectorType,
+                                llvm::FixedVectorType *destType, bool sign);
+  llvm::Value *createQ15Mulr(llvm::Value *left, llvm::Value *right,
+                             bool saturate);
+  llvm::Value *createBitSelect(llvm::Value *trueValue, llvm::Value *falseValue,
+                               llvm::Value *mask);
+  llvm::Value *createSwizzle(llvm::Value *vector, llvm::Value *index,
+                             bool strict);
+  llvm::Value *createRelaxedTrunc(llvm::Value *vector,
+                                  llvm::FixedVectorType *destType, bool sign);
+  llvm::Value *createRelaxedDot(llvm::Value *left, llvm::Value *right);
   llvm::Value *createSIMDTrunc(llvm::Value *vector,
                                llvm::FixedVectorType *vectorType,
                                llvm::FixedVectorType *destType,
                                llvm::Value *floatMin, bool sign);
+  // Structural checks that are kept in release builds, so that malformed
+  // input fails cleanly when it is not validated (Options::NoValidate).
+  [[noreturn]] void malformed(const std::string &msg);
+  void requireStack(std::size_t num) {
+    if (stack.size() < num) {
+      malformed("value stack underflow");
+    }
+  }
+  // The blockStack index of the branch target at label `depth`.
+  std::size_t getBrTarget(wabt::Index depth) {
+    if (depth >= blockStack.size()) {
+      malformed("branch depth " + std::to_string(depth) + " out of range");
+    }
+    return blockStack.size() - depth - 1;
+  }
+  llvm::Value *getLocal(const wabt::Var &var) {
+    if (var.index() >= locals.size()) {
+      malformed("local " + std::to_string(var.index()) + " out of range");
+    }
+    return locals[var.index()];
+  }
   llvm::Value *popStack() {
-    assert(stack.size() >= 1);
+    requireStack(1);
     llvm::Value *p1 = stack.back();
     stack.pop_back();
     return p1;
@@ -3,6 +3,8 @@
 
 #include <cstdint>
 #include <iostream>
+#include <map>
+#include <memory>
 
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/LLVMContext.h>
@@ -18,11 +20,34 @@
 #include "wabt/validator.h"
 #include "wabt/wast-parser.h"
 
+#include "code-section.h"
 #include "interface.h"
 #include "utils.h"
 
 namespace notdec::frontend::wasm {
 
+class FunctionStreamer;
+
+// A data or elem segment that can be used by memory.init/table.init at
+// runtime. Passive segments are kept as separate constant blobs, and the drop
+// state is tracked with a per-segment flag. Active segments are dropped right
+// after instantiation, so they have a null `blob`.
+struct SegmentInfo {
+  llvm::GlobalVariable *blob = nullptr;
+  llvm::GlobalVariable *dropped = nullptr;
+  uint64_t size = 0;
+};
+
+// An active data segment of memory 0 at a constant offset.
+struct DataRange {
+  uint64_t begin;
+  const std::vector<uint8_t> *bytes;
+  // the separate globals of the segment with SplitMem, split at zero runs
+  std::vector<llvm::GlobalVariable *> splits;
+  // never written after instantiation, see `Context::findReadOnlyData`.
+  bool readOnly = false;
+};
+
 struct Context {
   Options opts;
   llvm::LLVMContext &llvmContext;
@@ -31,23 +56,54 @@ struct Context {
   // mapping from global index to llvm thing
   std::vector<llvm::GlobalVariable *> globs;
   std::vector<llvm::Function *> funcs;
+  // nullptr with InstanceContext, the memory is allocated by the host.
   std::vector<llvm::GlobalVariable *> mems;
+  // pointers to the memories with MemBasePointer, nullptr otherwise.
+  std::vector<llvm::GlobalVariable *> memBases;
+  // table structures (see `getTableType`), and the arrays holding their
+  // initial elements, nullptr for imported tables.
   std::vector<llvm::GlobalVariable *> tables;
-
-  // Memory buffer for `ConstantDataArray::getRaw`.
-  // TODO: Should be kept with llvmContext.
-  std::vector<uint8_t *> OwnedBuffers;
+  std::vector<llvm::GlobalVariable *> tableElems;
+  // mapping from data/elem segment index to the segment blob
+  std::vector<SegmentInfo> dataSegs;
+  std::vector<SegmentInfo> elemSegs;
+  std::vector<DataRange> activeData;
+
+  // TBAA access tags, keyed by the accessed type.
+  std::map<llvm::Type *, llvm::MDNode *> tbaaTags;
+  llvm::MDNode *tbaaChar = nullptr;
+
+  // Module constructor for the initialization that depends on imported
+  // globals, created on first use by `getInitBuilder`.
+  llvm::Function *initFunc = nullptr;
+  std::unique_ptr<llvm::IRBuilder<>> initBuilder;
+
+  // The instance struct with InstanceContext, see `declareInstanceType`, and
+  // the field index of each memory, global and table, or -1 if the module
+  // global is shared by the instances.
+  llvm::StructType *instanceType = nullptr;
+  std::vector<int> memFields;
+  std::vector<int> globFields;
+  std::vector<int> tableFields;
+
+  // Writes out each function after it is translated, see `FunctionStreamer`.
+  FunctionStreamer *streamer = nullptr;
+
+  // Decodes the function bodies with DecodePerFunction, right before or
+  // concurrently with the translation, see `BodyDecoder`.
+  BodyDecoder *bodyDecoder = nullptr;
+
+  // The segment blobs by their initializer. Constants are uniqued by LLVM, so
+  // segments with the same content share one blob.
+  std::map<llvm::Constant *, llvm::GlobalVariable *> dataBlobs;
+
+  // The output path, next to which the data files of IncbinData are written.
+  std::string outputPath;
 
   Context(llvm::LLVMContext &llvmContext, llvm::Module &llvmModule,
           Options opts)
       : opts(opts), llvmContext(llvmContext), llvmModule(llvmModule) {}
 
-  ~Context() {
-    for (auto *buf : OwnedBuffers) {
-      delete[] buf;
-    }
-  }
-
   void visitModule();
   void visitGlobal(wabt::Global &gl, bool isExternal);
   void visitFunc(wabt::Func &func, llvm::Function *function);
@@ -56,14 +112,45 @@ struct Context {
   llvm::PointerType *getFuncPointerType() {
     return llvm::PointerType::get(llvmContext, 0);
   }
+  llvm::StructType *getTableType();
   llvm::Constant *visitInitExpr(wabt::ExprList &expr);
+  llvm::Value *evalInitExpr(wabt::ExprList &expr, llvm::IRBuilder<> *builder);
+  llvm::IRBuilder<> &getInitBuilder();
+  void declareInstanceType();
+  llvm::FunctionType *getFuncType(const wabt::FuncSignature &sig);
+  llvm::Value *getInitInstance();
+  llvm::Value *getGlobalPtr(llvm::IRBuilder<> &builder, llvm::Value *instance,
+                            wabt::Index index);
+  llvm::Value *getTablePtr(llvm::IRBuilder<> &builder, llvm::Value *instance,
+                           wabt::Index index);
+  llvm::Value *getMemBasePtr(llvm::IRBuilder<> &builder, llvm::Value *instance,
+                             wabt::Index index);
+  llvm::Constant *visitElemExpr(const wabt::ExprList &expr);
   llvm::GlobalVariable *visitDataSegment(wabt::DataSegment &ds);
+  SegmentInfo declareSegment(llvm::Constant *init, uint64_t size,
+                             const std::string &name);
+  llvm::GlobalVariable *getDataBlob(llvm::Constant *init,
+                                    const std::string &name);
+  llvm::GlobalVariable *declareDataPiece(llvm::GlobalVariable *mem,
+                                         uint64_t addr,
+                                         llvm::ArrayRef<uint8_t> bytes,
+                                         bool isConstant);
 
   llvm::Function *declareFunc(wabt::Func &func, bool isExternal);
   llvm::GlobalVariable *declareMemory(wabt::Memory &mem, bool isExternal);
+  // The global that the accesses of memory `index` are based on, see
+  // `getMemAccessIndex`.
+  llvm::GlobalVariable *getMemAccessBase(wabt::Index index) {
+    return memBases.at(index) != nullptr ? memBases.at(index) : mems.at(index);
+  }
   void setFuncArgName(llvm::Function &function,
                       const wabt::FuncSignature &decl);
   llvm::Function *findFunc(wabt::Var &var);
+  llvm::MDNode *getTBAATag(llvm::Type *ty);
+  llvm::GlobalVariable *findStackPointer();
+  void findReadOnlyData();
+  void visitExports();
+  void setInternalCallingConv();
 
 private:
   wabt::Index _func_index = 0;
@@ -75,10 +162,14 @@ private:
 void free_buffer();
 std::unique_ptr<Context> parse_wasm(llvm::LLVMContext &llvmContext,
                                     llvm::Module &llvmModule, Options opts,
-                                    std::string file_name);
+                                    std::string file_name,
+                                    std::string output_path = "",
+                                    FunctionStreamer *streamer = nullptr);
 std::unique_ptr<Context> parse_wat(llvm::LLVMContext &llvmContext,
                                    llvm::Module &llvmModule, Options opts,
-                                   std::string file_name);
+                                   std::string file_name,
+                                   std::string output_path = "",
+                                   FunctionStreamer *streamer = nullptr);
 
 llvm::Constant *convertZeroValue(llvm::LLVMContext &llvmContext,
                                  const wabt::Type &ty);
@@ -90,6 +181,7 @@ llvm::Type *convertReturnType(llvm::LLVMContext &llvmContext,
 llvm::Constant *createMemInitializer(llvm::LLVMContext &llvmContext,
                                      llvm::Type *memty, uint64_t offset,
                                      std::vector<uint8_t> data);
+llvm::Value *getMemAccessIndex(llvm::Value *ptr, llvm::GlobalVariable *mem);
 void modMemInitializer(llvm::StringRef ptr, uint64_t offset,
                        std::vector<uint8_t> data);
 
@@ -0,0 +1,26 @@
+#ifndef _NOTDEC_WASM2LLVM_SPLIT_MODULE_H_
+#define _NOTDEC_WASM2LLVM_SPLIT_MODULE_H_
+
+#include <string>
+
+#include <llvm/IR/Module.h>
+
+namespace notdec::frontend::wasm {
+
+/// Split the module into `parts` bitcode files `<output>.<n>.bc`, so that the
+/// code generation can run in parallel, and write the list of the files to
+/// `<output>.manifest`, which can be passed to clang or llvm-link as a
+/// response file (@<output>.manifest).
+///
+/// Functions that call each other are kept together while the group stays
+/// small, and the groups are balanced on their instruction counts. The global
+/// variables go to the first file. Local symbols are made external with
+/// hidden visibility. With `summary`, the files carry ThinLTO summaries.
+///
+/// Returns false if a file cannot be written.
+bool splitModule(llvm::Module &mod, const std::string &outputPath,
+                 unsigned parts, bool summary, int logLevel);
+
+} // namespace notdec::frontend::wasm
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef _NOTDEC_WASM2LLVM_STACK_RECOVERY_H_
+#define _NOTDEC_WASM2LLVM_STACK_RECOVERY_H_
+
+#include <llvm/IR/Function.h>
+#include <llvm/IR/GlobalVariable.h>
+
+namespace notdec::frontend::wasm {
+
+/// Recognize the shadow stack frame of a translated function:
+///
+///   sp = global.get __stack_pointer; frame = sp - N; global.set frame ...
+///   global.set __stack_pointer (sp or frame + N)
+///
+/// and rewrite the accesses to [frame, frame + N) in the linear memory to a
+/// native alloca, when the frame does not escape the function. The locals
+/// holding the stack pointer or the frame base are promoted to SSA values
+/// first, and functions without a stack pointer load are not changed.
+///
+/// Returns true if the frame is lifted.
+bool liftStackFrame(llvm::Function &F, llvm::GlobalVariable *sp,
+                    llvm::GlobalVariable *mem, int logLevel);
+
+} // namespace notdec::frontend::wasm
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef _NOTDEC_WASM2LLVM_STREAM_OUTPUT_H_
+#define _NOTDEC_WASM2LLVM_STREAM_OUTPUT_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <llvm/ADT/STLFunctionalExtras.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/GlobalValue.h>
+#include <llvm/IR/Module.h>
+#include <llvm/TargetParser/Triple.h>
+
+namespace notdec::frontend::wasm {
+
+/// Make the local symbols of the module external with hidden visibility, so
+/// that the modules split from it can refer to them by name.
+void exportLocalSymbols(llvm::Module &mod);
+
+/// Clone the definitions selected by `shouldClone` into a new module, with
+/// only the declarations they use. The module asm, which defines the incbin
+/// data pieces, is only kept if `keepAsm` is set, so that exactly one of the
+/// modules split from `mod` defines them.
+std::unique_ptr<llvm::Module>
+cloneDefinitions(const llvm::Module &mod,
+                 llvm::function_ref<bool(const llvm::GlobalValue *)>
+                     shouldClone,
+                 bool keepAsm);
+
+/// Write the module as bitcode, with the module summary and hash for ThinLTO
+/// if `summary` is set. Returns false if the file cannot be opened.
+bool writeBitcode(llvm::Module &mod, const std::string &path,
+                  bool summary = false);
+
+/// Write the functions to bitcode as soon as they are translated, so that the
+/// peak memory depends on the chunk size instead of the whole module.
+///
+/// The functions are collected into chunks of about `chunkSize` instructions.
+/// Each chunk is written to `<output>.<n>.bc` with the declarations it
+/// references, and the bodies are deleted from the module. `finish` writes the
+/// rest of the module (globals, segments and the init function) to the output
+/// path. Local symbols are made external with hidden visibility, so that the
+/// files link back together.
+class FunctionStreamer {
+public:
+  FunctionStreamer(const std::string &outputPath, uint64_t chunkSize,
+                   bool summary, int logLevel);
+
+  // Write the chunks for the target of the host module instead of wasm32,
+  // which is linked into the rest of the module only after the translation.
+  void setTarget(const llvm::Triple &triple, const std::string &dataLayout);
+  void add(llvm::Function &F);
+  // Write the pending functions as a chunk.
+  void flush();
+  // Write the remaining module. Returns false if any file cannot be written.
+  bool finish(llvm::Module &mod);
+
+  const std::vector<std::string> &getChunkPaths() const { return chunkPaths; }
+
+private:
+  std::string outputPath;
+  std::string prefix;
+  uint64_t chunkSize;
+  bool summary;
+  int logLevel;
+  std::vector<llvm::Function *> pending;
+  uint64_t pendingSize = 0;
+  std::vector<std::string> chunkPaths;
+  bool failed = false;
+  llvm::Triple targetTriple;
+  std::string targetDataLayout;
+};
+
+} // namespace notdec::frontend::wasm
+
+#endif
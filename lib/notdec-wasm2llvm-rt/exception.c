@@ -0,0 +1,90 @@
+// Exceptions of the wasm exception handling proposal.
+//
+// The translated code catches exceptions with a catch-all landingpad under
+// __gxx_personality_v0, so wasm exceptions are raised as foreign exceptions
+// with their own exception class. Tags are identified by their index in the
+// module, and the payload is copied as raw bytes.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unwind.h>
+
+// "NTDCWASM"
+#define NOTDEC_WASM_EXCEPTION_CLASS 0x4e5444435741534dULL
+#define NOTDEC_WASM_FOREIGN_TAG UINT32_MAX
+
+struct notdec_wasm_exception {
+  struct _Unwind_Exception header;
+  uint32_t tag;
+  uint32_t size;
+  unsigned char payload[];
+};
+
+static void notdec_wasm_exception_cleanup(_Unwind_Reason_Code reason,
+                                          struct _Unwind_Exception *exn) {
+  (void)reason;
+  free(exn);
+}
+
+void __notdec_wasm_throw(uint32_t tag, const void *payload, uint32_t size) {
+  struct notdec_wasm_exception *exn =
+      malloc(sizeof(struct notdec_wasm_exception) + size);
+  if (exn == NULL) {
+    abort();
+  }
+  memset(&exn->header, 0, sizeof(exn->header));
+  exn->header.exception_class = NOTDEC_WASM_EXCEPTION_CLASS;
+  exn->header.exception_cleanup = notdec_wasm_exception_cleanup;
+  exn->tag = tag;
+  exn->size = size;
+  memcpy(exn->payload, payload, size);
+  _Unwind_RaiseException(&exn->header);
+  // no handler found
+  fprintf(stderr, "Error: uncaught wasm exception with tag %u\n", tag);
+  abort();
+}
+
+// Tag of the caught exception, or NOTDEC_WASM_FOREIGN_TAG if it is not thrown
+// by wasm code.
+uint32_t __notdec_wasm_exception_tag(struct _Unwind_Exception *exn) {
+  if (exn->exception_class != NOTDEC_WASM_EXCEPTION_CLASS) {
+    return NOTDEC_WASM_FOREIGN_TAG;
+  }
+  return ((struct notdec_wasm_exception *)exn)->tag;
+}
+
+// Enter the catch block: copy the payload to `payload`, and release the
+// exception. Foreign exceptions have an empty payload, and are kept alive
+// until the end of the catch block, so that they can be rethrown.
+void __notdec_wasm_catch(struct _Unwind_Exception *exn, void *payload,
+                         uint32_t size) {
+  memset(payload, 0, size);
+  if (exn->exception_class == NOTDEC_WASM_EXCEPTION_CLASS) {
+    struct notdec_wasm_exception *wexn = (struct notdec_wasm_exception *)exn;
+    memcpy(payload, wexn->payload, wexn->size < size ? wexn->size : size);
+    _Unwind_DeleteException(exn);
+  }
+}
+
+// Leave the catch block of `exn` without rethrowing it.
+void __notdec_wasm_end_catch(struct _Unwind_Exception *exn) {
+  if (exn->exception_class != NOTDEC_WASM_EXCEPTION_CLASS) {
+    _Unwind_DeleteException(exn);
+  }
+}
+
+// Rethrow the exception caught as `exn`. Wasm exceptions were released by
+// __notdec_wasm_catch and are thrown again from the saved tag and payload,
+// while foreign exceptions are rethrown as they are.
+void __notdec_wasm_rethrow(struct _Unwind_Exception *exn, uint32_t tag,
+                           const void *payload, uint32_t size) {
+  if (tag != NOTDEC_WASM_FOREIGN_TAG) {
+    __notdec_wasm_throw(tag, payload, size);
+  }
+  _Unwind_Resume_or_Rethrow(exn);
+  // no handler found
+  fprintf(stderr, "Error: uncaught foreign exception\n");
+  abort();
+}
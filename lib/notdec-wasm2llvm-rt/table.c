@@ -0,0 +1,94 @@
+// Growable tables of the reference types proposal.
+//
+// The translated code accesses the elements directly, and only calls into the
+// runtime for table.grow and table.fill, and to set up the tables of an
+// instance. Tables start with a static array of the initial size, which is
+// moved to the heap on the first growth.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// keep in sync with Context::getTableType
+struct notdec_table {
+  void **elems;
+  uint32_t size;
+  uint32_t max;
+  // 0 if `elems` is the static initial array
+  uint32_t capacity;
+};
+
+uint32_t __notdec_wasm_table_grow(struct notdec_table *table, void *init,
+                                  uint32_t delta) {
+  uint32_t old = table->size;
+  if (delta > table->max - old) {
+    return UINT32_MAX;
+  }
+  uint32_t size = old + delta;
+  uint32_t capacity = table->capacity == 0 ? old : table->capacity;
+  if (size > capacity) {
+    // amortized growth, bounded by the max size
+    uint64_t next = (uint64_t)capacity * 2;
+    if (next < size) {
+      next = size;
+    }
+    if (next < 8) {
+      next = 8;
+    }
+    if (next > table->max) {
+      next = table->max;
+    }
+    void **elems;
+    if (table->capacity == 0) {
+      elems = malloc(next * sizeof(void *));
+      if (elems != NULL && old != 0) {
+        memcpy(elems, table->elems, old * sizeof(void *));
+      }
+    } else {
+      elems = realloc(table->elems, next * sizeof(void *));
+    }
+    if (elems == NULL) {
+      return UINT32_MAX;
+    }
+    table->elems = elems;
+    table->capacity = (uint32_t)next;
+  }
+  for (uint32_t i = old; i < size; i++) {
+    table->elems[i] = init;
+  }
+  table->size = size;
+  return old;
+}
+
+// The range is checked by the caller.
+void __notdec_wasm_table_fill(void **dest, void *val, uint32_t num) {
+  for (uint32_t i = 0; i < num; i++) {
+    dest[i] = val;
+  }
+}
+
+// Copy the initial table to the table of an instance, which gets its own
+// elements (InstanceContext).
+void __notdec_wasm_table_init(struct notdec_table *dest,
+                              const struct notdec_table *src) {
+  *dest = *src;
+  if (src->size == 0) {
+    return; // nothing is written to the static array
+  }
+  dest->elems = malloc(src->size * sizeof(void *));
+  if (dest->elems == NULL) {
+    abort();
+  }
+  memcpy(dest->elems, src->elems, src->size * sizeof(void *));
+  dest->capacity = src->size;
+}
+
+// Free the elements of an instance table.
+void __notdec_wasm_table_free(struct notdec_table *table) {
+  if (table->capacity != 0) {
+    free(table->elems);
+  }
+  table->elems = NULL;
+  table->size = 0;
+  table->capacity = 0;
+}
@@ -0,0 +1,509 @@
+// Host implementation of the common WASI preview1 imports.
+//
+// The imports are declared as `wasi_snapshot_preview1.<name>` in stripped
+// modules, and with the wasi-libc names `__imported_wasi_snapshot_preview1_
+// <name>` when the module has a name section, so both symbols are defined.
+// Addresses are offsets into memory 0: the __notdec_mem0 array, or the memory
+// at __notdec_mem0_base when built with NOTDEC_MEM_BASE_POINTER for
+// --mem-base-pointer. The module must export its memory.
+//
+// The host calls __notdec_wasi_init with the arguments before running the
+// module. File descriptors 0-2 are the host standard streams, and 3 is the
+// preopened current directory. Paths are not sandboxed.
+//
+// Also built as bitcode (notdec-wasi.bc), so that the calls can be inlined
+// into the translated module.
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/random.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef NOTDEC_MEM_BASE_POINTER
+extern unsigned char *__notdec_mem0_base;
+#define WASI_MEM __notdec_mem0_base
+#else
+extern unsigned char __notdec_mem0[];
+#define WASI_MEM __notdec_mem0
+#endif
+
+// wasi_snapshot_preview1 errno values
+#define WASI_ESUCCESS 0
+#define WASI_E2BIG 1
+#define WASI_EACCES 2
+#define WASI_EAGAIN 6
+#define WASI_EBADF 8
+#define WASI_EEXIST 20
+#define WASI_EFAULT 21
+#define WASI_EFBIG 22
+#define WASI_EINTR 27
+#define WASI_EINVAL 28
+#define WASI_EIO 29
+#define WASI_EISDIR 31
+#define WASI_ELOOP 32
+#define WASI_EMFILE 33
+#define WASI_ENAMETOOLONG 37
+#define WASI_ENFILE 41
+#define WASI_ENOENT 44
+#define WASI_ENOMEM 48
+#define WASI_ENOSPC 51
+#define WASI_ENOSYS 52
+#define WASI_ENOTDIR 54
+#define WASI_ENOTEMPTY 55
+#define WASI_ENOTSUP 58
+#define WASI_EPERM 63
+#define WASI_EPIPE 64
+#define WASI_EROFS 69
+#define WASI_ESPIPE 70
+
+#define WASI_RIGHT_FD_READ (UINT64_C(1) << 1)
+#define WASI_RIGHT_FD_SEEK (UINT64_C(1) << 2)
+#define WASI_RIGHT_FD_TELL (UINT64_C(1) << 5)
+#define WASI_RIGHT_FD_WRITE (UINT64_C(1) << 6)
+
+#define WASI_MAX_FDS 128
+#define WASI_PREOPEN_FD 3
+// iovecs converted on the stack for each readv/writev
+#define WASI_IOV_BATCH 16
+
+static int wasi_argc;
+static char **wasi_argv;
+static char **wasi_envp;
+// host fd of each wasi fd, -1 if closed
+static int wasi_fds[WASI_MAX_FDS] = {0, 1, 2, -1};
+
+static unsigned char *wasi_mem(uint32_t addr) { return WASI_MEM + addr; }
+
+static uint32_t wasi_load_u32(uint32_t addr) {
+  uint32_t val;
+  memcpy(&val, wasi_mem(addr), sizeof(val));
+  return val;
+}
+
+static void wasi_store_u32(uint32_t addr, uint32_t val) {
+  memcpy(wasi_mem(addr), &val, sizeof(val));
+}
+
+static void wasi_store_u64(uint32_t addr, uint64_t val) {
+  memcpy(wasi_mem(addr), &val, sizeof(val));
+}
+
+static int32_t wasi_errno(int err) {
+  switch (err) {
+  case E2BIG:
+    return WASI_E2BIG;
+  case EACCES:
+    return WASI_EACCES;
+  case EAGAIN:
+    return WASI_EAGAIN;
+  case EBADF:
+    return WASI_EBADF;
+  case EEXIST:
+    return WASI_EEXIST;
+  case EFAULT:
+    return WASI_EFAULT;
+  case EFBIG:
+    return WASI_EFBIG;
+  case EINTR:
+    return WASI_EINTR;
+  case EINVAL:
+    return WASI_EINVAL;
+  case EISDIR:
+    return WASI_EISDIR;
+  case ELOOP:
+    return WASI_ELOOP;
+  case EMFILE:
+    return WASI_EMFILE;
+  case ENAMETOOLONG:
+    return WASI_ENAMETOOLONG;
+  case ENFILE:
+    return WASI_ENFILE;
+  case ENOENT:
+    return WASI_ENOENT;
+  case ENOMEM:
+    return WASI_ENOMEM;
+  case ENOSPC:
+    return WASI_ENOSPC;
+  case ENOSYS:
+    return WASI_ENOSYS;
+  case ENOTDIR:
+    return WASI_ENOTDIR;
+  case ENOTEMPTY:
+    return WASI_ENOTEMPTY;
+  case ENOTSUP:
+    return WASI_ENOTSUP;
+  case EPERM:
+    return WASI_EPERM;
+  case EPIPE:
+    return WASI_EPIPE;
+  case EROFS:
+    return WASI_EROFS;
+  case ESPIPE:
+    return WASI_ESPIPE;
+  default:
+    return WASI_EIO;
+  }
+}
+
+static int wasi_host_fd(uint32_t fd) {
+  return fd < WASI_MAX_FDS ? wasi_fds[fd] : -1;
+}
+
+void __notdec_wasi_init(int argc, char **argv, char **envp) {
+  wasi_argc = argc;
+  wasi_argv = argv;
+  wasi_envp = envp;
+  for (int i = WASI_PREOPEN_FD + 1; i < WASI_MAX_FDS; i++) {
+    wasi_fds[i] = -1;
+  }
+  wasi_fds[WASI_PREOPEN_FD] = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+}
+
+// Sizes and contents of a NULL terminated string list, for args and environ.
+static int32_t wasi_strings_sizes_get(char **list, int count,
+                                      uint32_t count_ptr, uint32_t size_ptr) {
+  uint32_t size = 0;
+  for (int i = 0; i < count; i++) {
+    size += strlen(list[i]) + 1;
+  }
+  wasi_store_u32(count_ptr, count);
+  wasi_store_u32(size_ptr, size);
+  return WASI_ESUCCESS;
+}
+
+static int32_t wasi_strings_get(char **list, int count, uint32_t ptrs,
+                                uint32_t buf) {
+  for (int i = 0; i < count; i++) {
+    size_t len = strlen(list[i]) + 1;
+    wasi_store_u32(ptrs + i * 4, buf);
+    memcpy(wasi_mem(buf), list[i], len);
+    buf += len;
+  }
+  return WASI_ESUCCESS;
+}
+
+static int wasi_environ_count(void) {
+  int count = 0;
+  while (wasi_envp != NULL && wasi_envp[count] != NULL) {
+    count++;
+  }
+  return count;
+}
+
+static int32_t wasi_args_sizes_get(uint32_t argc_ptr, uint32_t size_ptr) {
+  return wasi_strings_sizes_get(wasi_argv, wasi_argc, argc_ptr, size_ptr);
+}
+
+static int32_t wasi_args_get(uint32_t argv_ptr, uint32_t buf) {
+  return wasi_strings_get(wasi_argv, wasi_argc, argv_ptr, buf);
+}
+
+static int32_t wasi_environ_sizes_get(uint32_t count_ptr, uint32_t size_ptr) {
+  return wasi_strings_sizes_get(wasi_envp, wasi_environ_count(), count_ptr,
+                                size_ptr);
+}
+
+static int32_t wasi_environ_get(uint32_t environ_ptr, uint32_t buf) {
+  return wasi_strings_get(wasi_envp, wasi_environ_count(), environ_ptr, buf);
+}
+
+static clockid_t wasi_clock(uint32_t id) {
+  switch (id) {
+  case 0:
+    return CLOCK_REALTIME;
+  case 1:
+    return CLOCK_MONOTONIC;
+  case 2:
+    return CLOCK_PROCESS_CPUTIME_ID;
+  default:
+    return CLOCK_THREAD_CPUTIME_ID;
+  }
+}
+
+static int32_t wasi_clock_res_get(uint32_t id, uint32_t res_ptr) {
+  struct timespec ts;
+  if (id > 3) {
+    return WASI_EINVAL;
+  }
+  if (clock_getres(wasi_clock(id), &ts) != 0) {
+    return wasi_errno(errno);
+  }
+  wasi_store_u64(res_ptr, (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+  return WASI_ESUCCESS;
+}
+
+static int32_t wasi_clock_time_get(uint32_t id, uint64_t precision,
+                                   uint32_t time_ptr) {
+  struct timespec ts;
+  (void)precision;
+  if (id > 3) {
+    return WASI_EINVAL;
+  }
+  if (clock_gettime(wasi_clock(id), &ts) != 0) {
+    return wasi_errno(errno);
+  }
+  wasi_store_u64(time_ptr, (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+  return WASI_ESUCCESS;
+}
+
+// Convert up to WASI_IOV_BATCH wasm iovecs {u32 buf, u32 len}, and return the
+// total length.
+static size_t wasi_iovecs(struct iovec *vec, uint32_t iovs, uint32_t n) {
+  size_t total = 0;
+  for (uint32_t i = 0; i < n; i++) {
+    vec[i].iov_base = wasi_mem(wasi_load_u32(iovs + i * 8));
+    vec[i].iov_len = wasi_load_u32(iovs + i * 8 + 4);
+    total += vec[i].iov_len;
+  }
+  return total;
+}
+
+// fd_read and fd_write: one readv/writev per batch of iovecs, stopping at a
+// short transfer.
+static int32_t wasi_fd_rw(uint32_t fd, uint32_t iovs, uint32_t iovs_len,
+                          uint32_t done_ptr, int write) {
+  struct iovec vec[WASI_IOV_BATCH];
+  int host = wasi_host_fd(fd);
+  size_t done = 0;
+  if (host < 0) {
+    return WASI_EBADF;
+  }
+  for (uint32_t i = 0; i < iovs_len; i += WASI_IOV_BATCH) {
+    uint32_t n = iovs_len - i < WASI_IOV_BATCH ? iovs_len - i : WASI_IOV_BATCH;
+    size_t len = wasi_iovecs(vec, iovs + i * 8, n);
+    ssize_t ret = write ? writev(host, vec, n) : readv(host, vec, n);
+    if (ret < 0) {
+      if (done == 0) {
+        return wasi_errno(errno);
+      }
+      break;
+    }
+    done += ret;
+    if ((size_t)ret < len) {
+      break;
+    }
+  }
+  wasi_store_u32(done_ptr, done);
+  return WASI_ESUCCESS;
+}
+
+static int32_t wasi_fd_read(uint32_t fd, uint32_t iovs, uint32_t iovs_len,
+                            uint32_t nread_ptr) {
+  return wasi_fd_rw(fd, iovs, iovs_len, nread_ptr, 0);
+}
+
+static int32_t wasi_fd_write(uint32_t fd, uint32_t iovs, uint32_t iovs_len,
+                             uint32_t nwritten_ptr) {
+  return wasi_fd_rw(fd, iovs, iovs_len, nwritten_ptr, 1);
+}
+
+static int32_t wasi_fd_seek(uint32_t fd, uint64_t offset, uint32_t whence,
+                            uint32_t newoffset_ptr) {
+  int host = wasi_host_fd(fd);
+  if (host < 0) {
+    return WASI_EBADF;
+  }
+  // SET, CUR and END match the host values
+  off_t ret = lseek(host, (off_t)offset, whence);
+  if (ret < 0) {
+    return wasi_errno(errno);
+  }
+  wasi_store_u64(newoffset_ptr, ret);
+  return WASI_ESUCCESS;
+}
+
+static int32_t wasi_fd_close(uint32_t fd) {
+  int host = wasi_host_fd(fd);
+  if (host < 0) {
+    return WASI_EBADF;
+  }
+  wasi_fds[fd] = -1;
+  if (host > 2 && close(host) != 0) {
+    return wasi_errno(errno);
+  }
+  return WASI_ESUCCESS;
+}
+
+static int32_t wasi_fd_fdstat_get(uint32_t fd, uint32_t stat_ptr) {
+  struct stat st;
+  int host = wasi_host_fd(fd);
+  if (host < 0) {
+    return WASI_EBADF;
+  }
+  if (fstat(host, &st) != 0) {
+    return wasi_errno(errno);
+  }
+  uint8_t type = 0;
+  uint64_t rights = UINT64_MAX;
+  if (S_ISREG(st.st_mode)) {
+    type = 4;
+  } else if (S_ISDIR(st.st_mode)) {
+    type = 3;
+  } else if (S_ISCHR(st.st_mode)) {
+    type = 2;
+    // wasi-libc detects ttys by the missing seek rights
+    rights &= ~(WASI_RIGHT_FD_SEEK | WASI_RIGHT_FD_TELL);
+  } else if (S_ISBLK(st.st_mode)) {
+    type = 1;
+  } else if (S_ISSOCK(st.st_mode)) {
+    type = 6;
+  } else if (S_ISLNK(st.st_mode)) {
+    type = 7;
+  }
+  int fl = fcntl(host, F_GETFL);
+  uint16_t flags = 0;
+  if (fl >= 0) {
+    flags |= (fl & O_APPEND) ? 1 : 0;
+    flags |= (fl & O_NONBLOCK) ? 4 : 0;
+    flags |= (fl & O_SYNC) == O_SYNC ? 16 : 0;
+  }
+  // struct fdstat { u8 filetype; u16 flags; u64 rights; u64 inheriting; }
+  memset(wasi_mem(stat_ptr), 0, 24);
+  *wasi_mem(stat_ptr) = type;
+  memcpy(wasi_mem(stat_ptr + 2), &flags, sizeof(flags));
+  wasi_store_u64(stat_ptr + 8, rights);
+  wasi_store_u64(stat_ptr + 16, UINT64_MAX);
+  return WASI_ESUCCESS;
+}
+
+static int32_t wasi_fd_prestat_get(uint32_t fd, uint32_t prestat_ptr) {
+  if (fd != WASI_PREOPEN_FD || wasi_fds[fd] < 0) {
+    return WASI_EBADF;
+  }
+  // struct prestat { u8 tag = dir; u32 name_len; }
+  memset(wasi_mem(prestat_ptr), 0, 8);
+  wasi_store_u32(prestat_ptr + 4, 1);
+  return WASI_ESUCCESS;
+}
+
+static int32_t wasi_fd_prestat_dir_name(uint32_t fd, uint32_t path,
+                                        uint32_t path_len) {
+  if (fd != WASI_PREOPEN_FD || wasi_fds[fd] < 0) {
+    return WASI_EBADF;
+  }
+  if (path_len < 1) {
+    return WASI_EINVAL;
+  }
+  *wasi_mem(path) = '.';
+  return WASI_ESUCCESS;
+}
+
+static int32_t wasi_path_open(uint32_t dirfd, uint32_t dirflags, uint32_t path,
+                              uint32_t path_len, uint32_t oflags,
+                              uint64_t rights, uint64_t rights_inheriting,
+                              uint32_t fdflags, uint32_t fd_ptr) {
+  char buf[PATH_MAX];
+  int host = wasi_host_fd(dirfd);
+  (void)rights_inheriting;
+  if (host < 0) {
+    return WASI_EBADF;
+  }
+  if (path_len >= sizeof(buf)) {
+    return WASI_ENAMETOOLONG;
+  }
+  memcpy(buf, wasi_mem(path), path_len);
+  buf[path_len] = '\0';
+
+  int flags = O_CLOEXEC;
+  if (oflags & 2) {
+    flags |= O_RDONLY | O_DIRECTORY;
+  } else if ((rights & WASI_RIGHT_FD_READ) && (rights & WASI_RIGHT_FD_WRITE)) {
+    flags |= O_RDWR;
+  } else if (rights & WASI_RIGHT_FD_WRITE) {
+    flags |= O_WRONLY;
+  } else {
+    flags |= O_RDONLY;
+  }
+  flags |= (oflags & 1) ? O_CREAT : 0;
+  flags |= (oflags & 4) ? O_EXCL : 0;
+  flags |= (oflags & 8) ? O_TRUNC : 0;
+  flags |= (fdflags & 1) ? O_APPEND : 0;
+  flags |= (fdflags & 4) ? O_NONBLOCK : 0;
+  flags |= (fdflags & 16) ? O_SYNC : 0;
+  flags |= (dirflags & 1) ? 0 : O_NOFOLLOW;
+
+  uint32_t fd = WASI_PREOPEN_FD + 1;
+  while (fd < WASI_MAX_FDS && wasi_fds[fd] >= 0) {
+    fd++;
+  }
+  if (fd == WASI_MAX_FDS) {
+    return WASI_EMFILE;
+  }
+  int ret = openat(host, buf, flags, 0666);
+  if (ret < 0) {
+    return wasi_errno(errno);
+  }
+  wasi_fds[fd] = ret;
+  wasi_store_u32(fd_ptr, fd);
+  return WASI_ESUCCESS;
+}
+
+static int32_t wasi_random_get(uint32_t buf, uint32_t len) {
+  while (len > 0) {
+    ssize_t ret = getrandom(wasi_mem(buf), len, 0);
+    if (ret < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return wasi_errno(errno);
+    }
+    buf += ret;
+    len -= ret;
+  }
+  return WASI_ESUCCESS;
+}
+
+static int32_t wasi_sched_yield(void) {
+  sched_yield();
+  return WASI_ESUCCESS;
+}
+
+// Define the import under both names, see the top of the file.
+#define WASI_IMPORT(name, params, args)                                        \
+  int32_t __imported_wasi_snapshot_preview1_##name params {                    \
+    return wasi_##name args;                                                   \
+  }                                                                            \
+  int32_t __notdec_wasi_##name params                                          \
+      __asm__("wasi_snapshot_preview1." #name);                                \
+  int32_t __notdec_wasi_##name params { return wasi_##name args; }
+
+WASI_IMPORT(args_get, (uint32_t a, uint32_t b), (a, b))
+WASI_IMPORT(args_sizes_get, (uint32_t a, uint32_t b), (a, b))
+WASI_IMPORT(environ_get, (uint32_t a, uint32_t b), (a, b))
+WASI_IMPORT(environ_sizes_get, (uint32_t a, uint32_t b), (a, b))
+WASI_IMPORT(clock_res_get, (uint32_t a, uint32_t b), (a, b))
+WASI_IMPORT(clock_time_get, (uint32_t a, uint64_t b, uint32_t c), (a, b, c))
+WASI_IMPORT(fd_read, (uint32_t a, uint32_t b, uint32_t c, uint32_t d),
+            (a, b, c, d))
+WASI_IMPORT(fd_write, (uint32_t a, uint32_t b, uint32_t c, uint32_t d),
+            (a, b, c, d))
+WASI_IMPORT(fd_seek, (uint32_t a, uint64_t b, uint32_t c, uint32_t d),
+            (a, b, c, d))
+WASI_IMPORT(fd_close, (uint32_t a), (a))
+WASI_IMPORT(fd_fdstat_get, (uint32_t a, uint32_t b), (a, b))
+WASI_IMPORT(fd_prestat_get, (uint32_t a, uint32_t b), (a, b))
+WASI_IMPORT(fd_prestat_dir_name, (uint32_t a, uint32_t b, uint32_t c),
+            (a, b, c))
+WASI_IMPORT(path_open,
+            (uint32_t a, uint32_t b, uint32_t c, uint32_t d, uint32_t e,
+             uint64_t f, uint64_t g, uint32_t h, uint32_t i),
+            (a, b, c, d, e, f, g, h, i))
+WASI_IMPORT(random_get, (uint32_t a, uint32_t b), (a, b))
+WASI_IMPORT(sched_yield, (void), ())
+
+_Noreturn void __imported_wasi_snapshot_preview1_proc_exit(uint32_t code) {
+  exit(code);
+}
+
+_Noreturn void __notdec_wasi_proc_exit(uint32_t code)
+    __asm__("wasi_snapshot_preview1.proc_exit");
+_Noreturn void __notdec_wasi_proc_exit(uint32_t code) { exit(code); }
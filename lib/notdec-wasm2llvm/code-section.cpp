@@ -0,0 +1,647 @@
+#include <iostream>
+#include <memory>
+#include <utility>
+
+#include "wabt/binary-reader-nop.h"
+#include "wabt/binary-reader.h"
+#include "wabt/error.h"
+
+#include "code-section.h"
+
+namespace notdec::frontend::wasm {
+
+namespace {
+
+const uint8_t TypeSectionId = 1;
+const uint8_t FunctionSectionId = 3;
+const uint8_t CodeSectionId = 10;
+const uint8_t DataSectionId = 11;
+const uint8_t DataCountSectionId = 12;
+// wasm magic and version
+const std::size_t HeaderSize = 8;
+// bodies decoded ahead of the translation by each thread
+const std::size_t WindowPerThread = 16;
+
+bool readU32Leb(const std::vector<uint8_t> &binary, std::size_t &pos,
+                uint32_t &value) {
+  value = 0;
+  for (unsigned shift = 0; shift < 35; shift += 7) {
+    if (pos >= binary.size()) {
+      return false;
+    }
+    uint8_t byte = binary[pos++];
+    value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void writeU32Leb(std::vector<uint8_t> &out, uint32_t value) {
+  do {
+    uint8_t byte = value & 0x7f;
+    value >>= 7;
+    out.push_back(value != 0 ? (byte | 0x80) : byte);
+  } while (value != 0);
+}
+
+void appendRange(std::vector<uint8_t> &out, const std::vector<uint8_t> &binary,
+                 std::pair<std::size_t, std::size_t> range) {
+  out.insert(out.end(), binary.begin() + range.first,
+             binary.begin() + range.second);
+}
+
+void appendSection(std::vector<uint8_t> &out, uint8_t id,
+                   const std::vector<uint8_t> &payload) {
+  out.push_back(id);
+  writeU32Leb(out, payload.size());
+  out.insert(out.end(), payload.begin(), payload.end());
+}
+
+
+// Builds the locals and the instructions of one function body, as the wabt
+// IR reader does, but takes the signatures of the blocks and the indirect
+// calls from the already read module instead of the type section.
+class FuncBodyReader : public wabt::BinaryReaderNop {
+public:
+  FuncBodyReader(const wabt::Module &module, wabt::Func &func)
+      : module(module), func(func) {}
+
+  bool finished() const { return done && labels.size() <= 1; }
+  const wabt::Errors &errors() const { return errs; }
+
+  bool OnError(const wabt::Error &error) override {
+    errs.push_back(error);
+    return true;
+  }
+
+  wabt::Result BeginFunctionBody(wabt::Index index,
+                                 wabt::Offset size) override {
+    func.local_types = wabt::LocalTypes();
+    func.exprs.clear();
+    labels.push_back({wabt::LabelType::Func, &func.exprs, nullptr});
+    return wabt::Result::Ok;
+  }
+  wabt::Result OnLocalDecl(wabt::Index declIndex, wabt::Index count,
+                           wabt::Type type) override {
+    func.local_types.AppendDecl(type, count);
+    return wabt::Result::Ok;
+  }
+  wabt::Result EndFunctionBody(wabt::Index index) override {
+    // the final end is either popped by OnEndExpr or left to OnEndFunc
+    done = true;
+    return labels.size() <= 1 ? wabt::Result::Ok : wabt::Result::Error;
+  }
+
+  // blocks
+  wabt::Result OnBlockExpr(wabt::Type sigType) override {
+    auto expr = std::make_unique<wabt::BlockExpr>();
+    setBlockDecl(expr->block.decl, sigType);
+    return push(wabt::LabelType::Block, &expr->block.exprs, std::move(expr));
+  }
+  wabt::Result OnLoopExpr(wabt::Type sigType) override {
+    auto expr = std::make_unique<wabt::LoopExpr>();
+    setBlockDecl(expr->block.decl, sigType);
+    return push(wabt::LabelType::Loop, &expr->block.exprs, std::move(expr));
+  }
+  wabt::Result OnIfExpr(wabt::Type sigType) override {
+    auto expr = std::make_unique<wabt::IfExpr>();
+    setBlockDecl(expr->true_.decl, sigType);
+    return push(wabt::LabelType::If, &expr->true_.exprs, std::move(expr));
+  }
+  wabt::Result OnElseExpr() override {
+    if (labels.empty() || labels.back().type != wabt::LabelType::If) {
+      return wabt::Result::Error;
+    }
+    Label &label = labels.back();
+    label.type = wabt::LabelType::Else;
+    label.exprs = &wabt::cast<wabt::IfExpr>(label.context)->false_;
+    return wabt::Result::Ok;
+  }
+  wabt::Result OnTryExpr(wabt::Type sigType) override {
+    auto expr = std::make_unique<wabt::TryExpr>();
+    setBlockDecl(expr->block.decl, sigType);
+    return push(wabt::LabelType::Try, &expr->block.exprs, std::move(expr));
+  }
+  wabt::Result OnCatchExpr(wabt::Index tagIndex) override {
+    return appendCatch(wabt::Catch(wabt::Var(tagIndex)));
+  }
+  wabt::Result OnCatchAllExpr() override { return appendCatch(wabt::Catch()); }
+  wabt::Result OnDelegateExpr(wabt::Index depth) override {
+    if (labels.empty() || labels.back().type != wabt::LabelType::Try) {
+      return wabt::Result::Error;
+    }
+    auto *tryExpr = wabt::cast<wabt::TryExpr>(labels.back().context);
+    tryExpr->kind = wabt::TryKind::Delegate;
+    tryExpr->delegate_target = wabt::Var(depth);
+    labels.pop_back();
+    return wabt::Result::Ok;
+  }
+  wabt::Result OnEndExpr() override {
+    if (labels.empty()) {
+      return wabt::Result::Error;
+    }
+    labels.pop_back();
+    return wabt::Result::Ok;
+  }
+
+  // branches and calls
+  wabt::Result OnBrExpr(wabt::Index depth) override {
+    return append<wabt::BrExpr>(wabt::Var(depth));
+  }
+  wabt::Result OnBrIfExpr(wabt::Index depth) override {
+    return append<wabt::BrIfExpr>(wabt::Var(depth));
+  }
+  wabt::Result OnBrTableExpr(wabt::Index numTargets,
+                             wabt::Index *targetDepths,
+                             wabt::Index defaultTargetDepth) override {
+    auto expr = std::make_unique<wabt::BrTableExpr>();
+    expr->default_target = wabt::Var(defaultTargetDepth);
+    for (wabt::Index i = 0; i < numTargets; i++) {
+      expr->targets.push_back(wabt::Var(targetDepths[i]));
+    }
+    return append(std::move(expr));
+  }
+  wabt::Result OnCallExpr(wabt::Index funcIndex) override {
+    return append<wabt::CallExpr>(wabt::Var(funcIndex));
+  }
+  wabt::Result OnCallIndirectExpr(wabt::Index sigIndex,
+                                  wabt::Index tableIndex) override {
+    auto expr = std::make_unique<wabt::CallIndirectExpr>();
+    setFuncDecl(expr->decl, sigIndex);
+    expr->table = wabt::Var(tableIndex);
+    return append(std::move(expr));
+  }
+  wabt::Result OnReturnCallExpr(wabt::Index funcIndex) override {
+    return append<wabt::ReturnCallExpr>(wabt::Var(funcIndex));
+  }
+  wabt::Result OnReturnCallIndirectExpr(wabt::Index sigIndex,
+                                        wabt::Index tableIndex) override {
+    auto expr = std::make_unique<wabt::ReturnCallIndirectExpr>();
+    setFuncDecl(expr->decl, sigIndex);
+    expr->table = wabt::Var(tableIndex);
+    return append(std::move(expr));
+  }
+  wabt::Result OnReturnExpr() override { return append<wabt::ReturnExpr>(); }
+  wabt::Result OnUnreachableExpr() override {
+    return append<wabt::UnreachableExpr>();
+  }
+  wabt::Result OnThrowExpr(wabt::Index tagIndex) override {
+    return append<wabt::ThrowExpr>(wabt::Var(tagIndex));
+  }
+  wabt::Result OnRethrowExpr(wabt::Index depth) override {
+    return append<wabt::RethrowExpr>(wabt::Var(depth));
+  }
+
+  // operators
+  wabt::Result OnNopExpr() override { return append<wabt::NopExpr>(); }
+  wabt::Result OnDropExpr() override { return append<wabt::DropExpr>(); }
+  wabt::Result OnSelectExpr(wabt::Index resultCount,
+                            wabt::Type *resultTypes) override {
+    wabt::TypeVector types(resultTypes, resultTypes + resultCount);
+    return append<wabt::SelectExpr>(types);
+  }
+  wabt::Result OnUnaryExpr(wabt::Opcode opcode) override {
+    return append<wabt::UnaryExpr>(opcode);
+  }
+  wabt::Result OnBinaryExpr(wabt::Opcode opcode) override {
+    return append<wabt::BinaryExpr>(opcode);
+  }
+  wabt::Result OnCompareExpr(wabt::Opcode opcode) override {
+    return append<wabt::CompareExpr>(opcode);
+  }
+  wabt::Result OnConvertExpr(wabt::Opcode opcode) override {
+    return append<wabt::ConvertExpr>(opcode);
+  }
+  wabt::Result OnTernaryExpr(wabt::Opcode opcode) override {
+    return append<wabt::TernaryExpr>(opcode);
+  }
+  wabt::Result OnI32ConstExpr(uint32_t value) override {
+    return append<wabt::ConstExpr>(wabt::Const::I32(value));
+  }
+  wabt::Result OnI64ConstExpr(uint64_t value) override {
+    return append<wabt::ConstExpr>(wabt::Const::I64(value));
+  }
+  wabt::Result OnF32ConstExpr(uint32_t valueBits) override {
+    return append<wabt::ConstExpr>(wabt::Const::F32(valueBits));
+  }
+  wabt::Result OnF64ConstExpr(uint64_t valueBits) override {
+    return append<wabt::ConstExpr>(wabt::Const::F64(valueBits));
+  }
+  wabt::Result OnV128ConstExpr(wabt::v128 valueBits) override {
+    return append<wabt::ConstExpr>(wabt::Const::V128(valueBits));
+  }
+
+  // variables
+  wabt::Result OnLocalGetExpr(wabt::Index localIndex) override {
+    return append<wabt::LocalGetExpr>(wabt::Var(localIndex));
+  }
+  wabt::Result OnLocalSetExpr(wabt::Index localIndex) override {
+    return append<wabt::LocalSetExpr>(wabt::Var(localIndex));
+  }
+  wabt::Result OnLocalTeeExpr(wabt::Index localIndex) override {
+    return append<wabt::LocalTeeExpr>(wabt::Var(localIndex));
+  }
+  wabt::Result OnGlobalGetExpr(wabt::Index globalIndex) override {
+    return append<wabt::GlobalGetExpr>(wabt::Var(globalIndex));
+  }
+  wabt::Result OnGlobalSetExpr(wabt::Index globalIndex) override {
+    return append<wabt::GlobalSetExpr>(wabt::Var(globalIndex));
+  }
+
+  // memory
+  wabt::Result OnLoadExpr(wabt::Opcode opcode, wabt::Index memidx,
+                          wabt::Address alignLog2,
+                          wabt::Address offset) override {
+    return appendAccess<wabt::LoadExpr>(opcode, memidx, alignLog2, offset);
+  }
+  wabt::Result OnStoreExpr(wabt::Opcode opcode, wabt::Index memidx,
+                           wabt::Address alignLog2,
+                           wabt::Address offset) override {
+    return appendAccess<wabt::StoreExpr>(opcode, memidx, alignLog2, offset);
+  }
+  wabt::Result OnLoadSplatExpr(wabt::Opcode opcode, wabt::Index memidx,
+                               wabt::Address alignLog2,
+                               wabt::Address offset) override {
+    return appendAccess<wabt::LoadSplatExpr>(opcode, memidx, alignLog2,
+                                             offset);
+  }
+  wabt::Result OnLoadZeroExpr(wabt::Opcode opcode, wabt::Index memidx,
+                              wabt::Address alignLog2,
+                              wabt::Address offset) override {
+    return appendAccess<wabt::LoadZeroExpr>(opcode, memidx, alignLog2,
+                                            offset);
+  }
+  wabt::Result OnAtomicLoadExpr(wabt::Opcode opcode, wabt::Index memidx,
+                                wabt::Address alignLog2,
+                                wabt::Address offset) override {
+    return appendAccess<wabt::AtomicLoadExpr>(opcode, memidx, alignLog2,
+                                              offset);
+  }
+  wabt::Result OnAtomicStoreExpr(wabt::Opcode opcode, wabt::Index memidx,
+                                 wabt::Address alignLog2,
+                                 wabt::Address offset) override {
+    return appendAccess<wabt::AtomicStoreExpr>(opcode, memidx, alignLog2,
+                                               offset);
+  }
+  wabt::Result OnAtomicRmwExpr(wabt::Opcode opcode, wabt::Index memidx,
+                               wabt::Address alignLog2,
+                               wabt::Address offset) override {
+    return appendAccess<wabt::AtomicRmwExpr>(opcode, memidx, alignLog2,
+                                             offset);
+  }
+  wabt::Result OnAtomicRmwCmpxchgExpr(wabt::Opcode opcode, wabt::Index memidx,
+                                      wabt::Address alignLog2,
+                                      wabt::Address offset) override {
+    return appendAccess<wabt::AtomicRmwCmpxchgExpr>(opcode, memidx,
+                                                    alignLog2, offset);
+  }
+  wabt::Result OnAtomicWaitExpr(wabt::Opcode opcode, wabt::Index memidx,
+                                wabt::Address alignLog2,
+                                wabt::Address offset) override {
+    return appendAccess<wabt::AtomicWaitExpr>(opcode, memidx, alignLog2,
+                                              offset);
+  }
+  wabt::Result OnAtomicNotifyExpr(wabt::Opcode opcode, wabt::Index memidx,
+                                  wabt::Address alignLog2,
+                                  wabt::Address offset) override {
+    return appendAccess<wabt::AtomicNotifyExpr>(opcode, memidx, alignLog2,
+                                                offset);
+  }
+  wabt::Result OnAtomicFenceExpr(uint32_t consistencyModel) override {
+    return append<wabt::AtomicFenceExpr>(consistencyModel);
+  }
+  wabt::Result OnMemorySizeExpr(wabt::Index memidx) override {
+    return append<wabt::MemorySizeExpr>(wabt::Var(memidx));
+  }
+  wabt::Result OnMemoryGrowExpr(wabt::Index memidx) override {
+    return append<wabt::MemoryGrowExpr>(wabt::Var(memidx));
+  }
+  wabt::Result OnMemoryFillExpr(wabt::Index memidx) override {
+    return append<wabt::MemoryFillExpr>(wabt::Var(memidx));
+  }
+  wabt::Result OnMemoryCopyExpr(wabt::Index destmemidx,
+                                wabt::Index srcmemidx) override {
+    return append<wabt::MemoryCopyExpr>(wabt::Var(destmemidx),
+                                        wabt::Var(srcmemidx));
+  }
+  wabt::Result OnMemoryInitExpr(wabt::Index segmentIndex,
+                                wabt::Index memidx) override {
+    return append<wabt::MemoryInitExpr>(wabt::Var(segmentIndex),
+                                        wabt::Var(memidx));
+  }
+  wabt::Result OnDataDropExpr(wabt::Index segmentIndex) override {
+    return append<wabt::DataDropExpr>(wabt::Var(segmentIndex));
+  }
+
+  // tables and references
+  wabt::Result OnTableInitExpr(wabt::Index segmentIndex,
+                               wabt::Index tableIndex) override {
+    return append<wabt::TableInitExpr>(wabt::Var(segmentIndex),
+                                       wabt::Var(tableIndex));
+  }
+  wabt::Result OnTableCopyExpr(wabt::Index dstIndex,
+                               wabt::Index srcIndex) override {
+    return append<wabt::TableCopyExpr>(wabt::Var(dstIndex),
+                                       wabt::Var(srcIndex));
+  }
+  wabt::Result OnElemDropExpr(wabt::Index segmentIndex) override {
+    return append<wabt::ElemDropExpr>(wabt::Var(segmentIndex));
+  }
+  wabt::Result OnTableGetExpr(wabt::Index tableIndex) override {
+    return append<wabt::TableGetExpr>(wabt::Var(tableIndex));
+  }
+  wabt::Result OnTableSetExpr(wabt::Index tableIndex) override {
+    return append<wabt::TableSetExpr>(wabt::Var(tableIndex));
+  }
+  wabt::Result OnTableGrowExpr(wabt::Index tableIndex) override {
+    return append<wabt::TableGrowExpr>(wabt::Var(tableIndex));
+  }
+  wabt::Result OnTableSizeExpr(wabt::Index tableIndex) override {
+    return append<wabt::TableSizeExpr>(wabt::Var(tableIndex));
+  }
+  wabt::Result OnTableFillExpr(wabt::Index tableIndex) override {
+    return append<wabt::TableFillExpr>(wabt::Var(tableIndex));
+  }
+  wabt::Result OnRefFuncExpr(wabt::Index funcIndex) override {
+    return append<wabt::RefFuncExpr>(wabt::Var(funcIndex));
+  }
+  wabt::Result OnRefNullExpr(wabt::Type type) override {
+    return append<wabt::RefNullExpr>(type);
+  }
+  wabt::Result OnRefIsNullExpr() override {
+    return append<wabt::RefIsNullExpr>();
+  }
+
+  // simd
+  wabt::Result OnSimdLaneOpExpr(wabt::Opcode opcode, uint64_t value) override {
+    return append<wabt::SimdLaneOpExpr>(opcode, value);
+  }
+  wabt::Result OnSimdLoadLaneExpr(wabt::Opcode opcode, wabt::Index memidx,
+                                  wabt::Address alignLog2,
+                                  wabt::Address offset,
+                                  uint64_t value) override {
+    return append<wabt::SimdLoadLaneExpr>(opcode, wabt::Var(memidx),
+                                          wabt::Address(1) << alignLog2,
+                                          offset, value);
+  }
+  wabt::Result OnSimdStoreLaneExpr(wabt::Opcode opcode, wabt::Index memidx,
+                                   wabt::Address alignLog2,
+                                   wabt::Address offset,
+                                   uint64_t value) override {
+    return append<wabt::SimdStoreLaneExpr>(opcode, wabt::Var(memidx),
+                                           wabt::Address(1) << alignLog2,
+                                           offset, value);
+  }
+  wabt::Result OnSimdShuffleOpExpr(wabt::Opcode opcode,
+                                   wabt::v128 value) override {
+    return append<wabt::SimdShuffleOpExpr>(opcode, value);
+  }
+
+private:
+  struct Label {
+    wabt::LabelType type;
+    // where the following instructions go
+    wabt::ExprList *exprs;
+    // the if or try expression of the label
+    wabt::Expr *context;
+  };
+
+  wabt::Result append(std::unique_ptr<wabt::Expr> expr) {
+    if (labels.empty()) {
+      return wabt::Result::Error;
+    }
+    labels.back().exprs->push_back(std::move(expr));
+    return wabt::Result::Ok;
+  }
+  template <typename T, typename... Args> wabt::Result append(Args &&...args) {
+    return append(std::make_unique<T>(std::forward<Args>(args)...));
+  }
+  template <typename T>
+  wabt::Result appendAccess(wabt::Opcode opcode, wabt::Index memidx,
+                            wabt::Address alignLog2, wabt::Address offset) {
+    return append<T>(opcode, wabt::Var(memidx), wabt::Address(1) << alignLog2,
+                     offset);
+  }
+  wabt::Result push(wabt::LabelType type, wabt::ExprList *exprs,
+                    std::unique_ptr<wabt::Expr> expr) {
+    wabt::Expr *context = expr.get();
+    if (Failed(append(std::move(expr)))) {
+      return wabt::Result::Error;
+    }
+    labels.push_back({type, exprs, context});
+    return wabt::Result::Ok;
+  }
+  wabt::Result appendCatch(wabt::Catch catch_) {
+    if (labels.empty() || (labels.back().type != wabt::LabelType::Try &&
+                           labels.back().type != wabt::LabelType::Catch)) {
+      return wabt::Result::Error;
+    }
+    Label &label = labels.back();
+    auto *tryExpr = wabt::cast<wabt::TryExpr>(label.context);
+    tryExpr->kind = wabt::TryKind::Catch;
+    tryExpr->catches.push_back(std::move(catch_));
+    label.type = wabt::LabelType::Catch;
+    label.exprs = &tryExpr->catches.back().exprs;
+    return wabt::Result::Ok;
+  }
+
+  void setFuncDecl(wabt::FuncDeclaration &decl, wabt::Index typeIndex) {
+    decl.has_func_type = true;
+    decl.type_var = wabt::Var(typeIndex);
+    if (const wabt::FuncType *type = module.GetFuncType(decl.type_var)) {
+      decl.sig = type->sig;
+    }
+  }
+  void setBlockDecl(wabt::BlockDeclaration &decl, wabt::Type sigType) {
+    if (sigType.IsIndex()) {
+      setFuncDecl(decl, sigType.GetIndex());
+    } else {
+      decl.has_func_type = false;
+      decl.sig.result_types = sigType.GetInlineVector();
+    }
+  }
+
+  const wabt::Module &module;
+  wabt::Func &func;
+  std::vector<Label> labels;
+  wabt::Errors errs;
+  bool done = false;
+};
+
+} // namespace
+
+bool indexCodeSection(const std::vector<uint8_t> &binary,
+                      CodeSectionIndex &index) {
+  std::size_t pos = HeaderSize;
+  if (binary.size() < HeaderSize) {
+    return false;
+  }
+  while (pos < binary.size()) {
+    std::size_t begin = pos;
+    uint8_t id = binary[pos++];
+    uint32_t size;
+    if (!readU32Leb(binary, pos, size) || binary.size() - pos < size) {
+      return false;
+    }
+    std::size_t end = pos + size;
+    if (id == DataCountSectionId) {
+      uint32_t count;
+      if (!readU32Leb(binary, pos, count)) {
+        return false;
+      }
+      index.dataCount = count;
+    } else if (id == CodeSectionId) {
+      index.codeSection = {begin, end};
+      uint32_t count;
+      if (!readU32Leb(binary, pos, count)) {
+        return false;
+      }
+      for (uint32_t i = 0; i < count; i++) {
+        uint32_t bodySize;
+        if (!readU32Leb(binary, pos, bodySize) || end - pos < bodySize) {
+          return false;
+        }
+        index.bodies.push_back({pos, pos + bodySize});
+        pos += bodySize;
+      }
+    }
+    pos = end;
+  }
+  return true;
+}
+
+std::vector<uint8_t> stripFunctionBodies(const std::vector<uint8_t> &binary,
+                                         const CodeSectionIndex &index) {
+  std::vector<uint8_t> out;
+  if (index.codeSection.second == 0) {
+    return binary;
+  }
+  appendRange(out, binary, {0, index.codeSection.first});
+  // no locals, end
+  std::vector<uint8_t> payload;
+  writeU32Leb(payload, index.bodies.size());
+  for (std::size_t i = 0; i < index.bodies.size(); i++) {
+    payload.insert(payload.end(), {0x02, 0x00, 0x0b});
+  }
+  appendSection(out, CodeSectionId, payload);
+  appendRange(out, binary, {index.codeSection.second, binary.size()});
+  return out;
+}
+
+bool decodeFuncBody(const std::vector<uint8_t> &binary,
+                    const CodeSectionIndex &index, std::size_t bodyIndex,
+                    const wabt::Module &module,
+                    const wabt::Features &features, wabt::Func &func) {
+  using namespace wabt;
+  std::vector<uint8_t> data;
+  appendRange(data, binary, {0, HeaderSize});
+  // one placeholder type for the function entry, the types used by the body
+  // are resolved against the module by the reader.
+  std::vector<uint8_t> payload = {0x01, 0x60, 0x00, 0x00};
+  appendSection(data, TypeSectionId, payload);
+  payload.clear();
+  writeU32Leb(payload, 1);
+  writeU32Leb(payload, 0);
+  appendSection(data, FunctionSectionId, payload);
+  auto [begin, end] = index.bodies.at(bodyIndex);
+  // memory.init and data.drop need the data count. The check may match
+  // immediates too, which only costs the placeholder segments.
+  bool useData = false;
+  for (std::size_t i = begin; i + 1 < end && index.dataCount; i++) {
+    if (binary[i] == 0xfc && (binary[i + 1] == 0x08 || binary[i + 1] == 0x09)) {
+      useData = true;
+      break;
+    }
+  }
+  if (useData) {
+    payload.clear();
+    writeU32Leb(payload, *index.dataCount);
+    appendSection(data, DataCountSectionId, payload);
+  }
+  payload.clear();
+  writeU32Leb(payload, 1);
+  writeU32Leb(payload, end - begin);
+  payload.insert(payload.end(), binary.begin() + begin, binary.begin() + end);
+  appendSection(data, CodeSectionId, payload);
+  if (useData) {
+    // empty passive segments
+    payload.clear();
+    writeU32Leb(payload, *index.dataCount);
+    for (uint32_t i = 0; i < *index.dataCount; i++) {
+      payload.insert(payload.end(), {0x01, 0x00});
+    }
+    appendSection(data, DataSectionId, payload);
+  }
+
+  FuncBodyReader reader(module, func);
+  ReadBinaryOptions options(features, nullptr, false, true, false);
+  Result result = ReadBinary(data.data(), data.size(), &reader, options);
+  if (!Succeeded(result) || !reader.finished()) {
+    std::cerr << __FILE__ << ":" << __LINE__ << ": "
+              << "Error: Cannot decode function body " << bodyIndex
+              << std::endl;
+    for (const Error &error : reader.errors()) {
+      std::cerr << "Note: " << error.message << std::endl;
+    }
+    return false;
+  }
+  return true;
+}
+
+BodyDecoder::BodyDecoder(const std::vector<uint8_t> &binary,
+                         const CodeSectionIndex &index,
+                         const wabt::Module &module,
+                         std::vector<wabt::Func *> funcs,
+                         const wabt::Features &features, unsigned threads)
+    : binary(binary), index(index), module(module), funcs(std::move(funcs)),
+      features(features), window(threads * WindowPerThread),
+      states(this->funcs.size(), State::Pending) {
+  for (unsigned i = 0; i < threads; i++) {
+    workers.emplace_back(&BodyDecoder::work, this);
+  }
+}
+
+BodyDecoder::~BodyDecoder() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  cond.notify_all();
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+}
+
+bool BodyDecoder::get(std::size_t i) {
+  if (workers.empty()) {
+    return decodeFuncBody(binary, index, i, module, features, *funcs.at(i));
+  }
+  std::unique_lock<std::mutex> lock(mutex);
+  current = i;
+  cond.notify_all();
+  cond.wait(lock, [&] { return states.at(i) != State::Pending; });
+  return states[i] == State::Decoded;
+}
+
+void BodyDecoder::work() {
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    cond.wait(lock, [&] {
+      return stopping || next >= funcs.size() || next < current + window;
+    });
+    if (stopping || next >= funcs.size()) {
+      return;
+    }
+    std::size_t i = next++;
+    lock.unlock();
+    bool ok =
+        decodeFuncBody(binary, index, i, module, features, *funcs[i]);
+    lock.lock();
+    states[i] = ok ? State::Decoded : State::Failed;
+    cond.notify_all();
+  }
+}
+
+} // namespace notdec::frontend::wasm
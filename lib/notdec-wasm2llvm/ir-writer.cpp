@@ -0,0 +1,91 @@
+#include <iostream>
+
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/DerivedTypes.h>
+#include <llvm/IR/GlobalVariable.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include "ir-writer.h"
+
+namespace notdec::frontend::wasm {
+
+namespace {
+
+// initializers smaller than this are printed as they are
+const std::size_t MinCompactSize = 4096;
+// zero runs shorter than this stay in the byte strings
+const std::size_t MinZeroRun = 64;
+const std::size_t OutputBufferSize = 1 << 20;
+
+} // namespace
+
+void compactInitializers(llvm::Module &mod) {
+  using namespace llvm;
+  const DataLayout &DL = mod.getDataLayout();
+  Type *i8 = Type::getInt8Ty(mod.getContext());
+  for (GlobalVariable &gv : mod.globals()) {
+    if (!gv.hasInitializer()) {
+      continue;
+    }
+    auto *init = dyn_cast<ConstantDataArray>(gv.getInitializer());
+    if (init == nullptr || init->getElementType() != i8 ||
+        init->getNumElements() < MinCompactSize) {
+      continue;
+    }
+    StringRef data = init->getRawDataValues();
+    SmallVector<Constant *> parts;
+    std::size_t i = 0;
+    while (i < data.size()) {
+      std::size_t end = i;
+      if (data[i] == 0) {
+        while (end < data.size() && data[end] == 0) {
+          end++;
+        }
+      }
+      // short zero runs and the data go into one byte string
+      if (end - i < MinZeroRun) {
+        std::size_t zeros = 0;
+        for (end = i; end < data.size() && zeros < MinZeroRun; end++) {
+          zeros = data[end] == 0 ? zeros + 1 : 0;
+        }
+        if (zeros == MinZeroRun) {
+          end -= zeros;
+        }
+        parts.push_back(
+            ConstantDataArray::getString(mod.getContext(),
+                                         data.slice(i, end), false));
+      } else {
+        parts.push_back(
+            ConstantAggregateZero::get(ArrayType::get(i8, end - i)));
+      }
+      i = end;
+    }
+    if (parts.size() < 2) {
+      continue;
+    }
+    // keep the alignment of the array type
+    if (!gv.getAlign().has_value()) {
+      gv.setAlignment(DL.getPreferredAlign(&gv));
+    }
+    gv.replaceInitializer(
+        ConstantStruct::getAnon(mod.getContext(), parts, true));
+  }
+}
+
+bool writeTextualIR(llvm::Module &mod, const std::string &path) {
+  std::error_code EC;
+  llvm::raw_fd_ostream os(path, EC);
+  if (EC) {
+    std::cerr << "Error: Cannot open output file " << path << ": "
+              << EC.message() << std::endl;
+    return false;
+  }
+  compactInitializers(mod);
+  os.SetBufferSize(OutputBufferSize);
+  mod.print(os, nullptr);
+  return true;
+}
+
+} // namespace notdec::frontend::wasm
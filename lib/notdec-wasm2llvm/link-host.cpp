@@ -0,0 +1,93 @@
+#include <iostream>
+#include <set>
+#include <string>
+
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IRReader/IRReader.h>
+#include <llvm/Linker/Linker.h>
+#include <llvm/Support/SourceMgr.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include "link-host.h"
+#include "utils.h"
+
+namespace notdec::frontend::wasm {
+
+namespace {
+
+// max number of instructions of an always inlined import
+const unsigned MaxAlwaysInlineSize = 32;
+
+unsigned countInstructions(llvm::Function &F) {
+  unsigned count = 0;
+  for (llvm::BasicBlock &bb : F) {
+    count += bb.size();
+  }
+  return count;
+}
+
+} // namespace
+
+bool linkHostModule(llvm::Module &mod, const std::string &path, int logLevel) {
+  using namespace llvm;
+  SMDiagnostic err;
+  std::unique_ptr<Module> host = parseIRFile(path, err, mod.getContext());
+  if (host == nullptr) {
+    err.print("notdec-wasm2llvm", errs());
+    return false;
+  }
+  // the translated module is compiled for the native target of the host in
+  // the end, and its IR does not depend on the pointer size.
+  mod.setDataLayout(host->getDataLayout());
+  mod.setTargetTriple(host->getTargetTriple());
+
+  std::set<std::string> imports;
+  for (Function &F : mod) {
+    if (F.isDeclaration() && !F.isIntrinsic()) {
+      imports.insert(F.getName().str());
+    }
+  }
+  // link everything, so that the state of the host library and its entry
+  // points (e.g. __notdec_wasi_init) are in one place.
+  if (Linker::linkModules(mod, std::move(host))) {
+    std::cerr << __FILE__ << ":" << __LINE__ << ": "
+              << "Error: cannot link the host module " << path << std::endl;
+    return false;
+  }
+
+  unsigned linked = 0, inlined = 0;
+  for (const std::string &name : imports) {
+    Function *F = mod.getFunction(name);
+    if (F == nullptr || F->isDeclaration()) {
+      continue;
+    }
+    linked++;
+    if (!F->hasFnAttribute(Attribute::NoInline) &&
+        countInstructions(*F) <= MaxAlwaysInlineSize) {
+      F->addFnAttr(Attribute::AlwaysInline);
+      inlined++;
+    }
+  }
+  if (logLevel >= level_info) {
+    std::cerr << "Info: Linked " << linked << " imports from " << path << " ("
+              << inlined << " always inline)." << std::endl;
+  }
+  return true;
+}
+
+bool readHostTarget(const std::string &path, llvm::LLVMContext &ctx,
+                    llvm::Triple &triple, std::string &dataLayout) {
+  using namespace llvm;
+  SMDiagnostic err;
+  std::unique_ptr<Module> host = getLazyIRFileModule(path, err, ctx);
+  if (host == nullptr) {
+    err.print("notdec-wasm2llvm", errs());
+    return false;
+  }
+  triple = host->getTargetTriple();
+  dataLayout = host->getDataLayoutStr();
+  return true;
+}
+
+} // namespace notdec::frontend::wasm
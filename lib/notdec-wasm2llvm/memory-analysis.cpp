@@ -0,0 +1,442 @@
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <iterator>
+#include <numeric>
+#include <optional>
+#include <utility>
+
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/Analysis/ConstantFolding.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/DataLayout.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/IntrinsicInst.h>
+#include <llvm/IR/Operator.h>
+#include <llvm/Support/Casting.h>
+
+#include "memory-analysis.h"
+#include "utils.h"
+
+namespace notdec::frontend::wasm {
+
+namespace {
+
+// Inclusive range [first, second] of an unsigned value, which is first plus a
+// multiple of stride. The stride is 0 for a single value.
+struct ValueRange {
+  uint64_t first;
+  uint64_t second;
+  uint64_t stride = 1;
+};
+
+std::optional<ValueRange> getValueRange(llvm::Value *val, unsigned depth = 0) {
+  using namespace llvm;
+  if (auto *c = dyn_cast<ConstantInt>(val)) {
+    if (c->getBitWidth() > 64) {
+      return std::nullopt;
+    }
+    return ValueRange{c->getZExtValue(), c->getZExtValue(), 0};
+  }
+  if (depth > 8) {
+    return std::nullopt;
+  }
+  auto *inst = dyn_cast<Instruction>(val);
+  if (inst == nullptr || !inst->getType()->isIntegerTy() ||
+      inst->getType()->getIntegerBitWidth() > 64) {
+    return std::nullopt;
+  }
+  unsigned bits = inst->getType()->getIntegerBitWidth();
+  uint64_t maxValue = bits == 64 ? UINT64_MAX : (uint64_t(1) << bits) - 1;
+  switch (inst->getOpcode()) {
+  case Instruction::And:
+    // a constant mask bounds the result, and its low zero bits align it
+    for (Value *op : inst->operands()) {
+      if (auto *c = dyn_cast<ConstantInt>(op)) {
+        uint64_t mask = c->getZExtValue();
+        return ValueRange{0, mask, mask & -mask};
+      }
+    }
+    return std::nullopt;
+  case Instruction::Shl: {
+    auto l = getValueRange(inst->getOperand(0), depth + 1);
+    auto *c = dyn_cast<ConstantInt>(inst->getOperand(1));
+    if (!l || c == nullptr || c->getZExtValue() >= bits ||
+        l->second > (maxValue >> c->getZExtValue())) {
+      return std::nullopt;
+    }
+    return ValueRange{l->first << c->getZExtValue(),
+                      l->second << c->getZExtValue(),
+                      l->stride << c->getZExtValue()};
+  }
+  case Instruction::Mul: {
+    auto l = getValueRange(inst->getOperand(0), depth + 1);
+    auto *c = dyn_cast<ConstantInt>(inst->getOperand(1));
+    if (!l || c == nullptr || c->isZero() ||
+        l->second > maxValue / c->getZExtValue()) {
+      return std::nullopt;
+    }
+    return ValueRange{l->first * c->getZExtValue(),
+                      l->second * c->getZExtValue(),
+                      l->stride * c->getZExtValue()};
+  }
+  case Instruction::URem:
+    if (auto *c = dyn_cast<ConstantInt>(inst->getOperand(1))) {
+      if (!c->isZero()) {
+        return ValueRange{0, c->getZExtValue() - 1};
+      }
+    }
+    return std::nullopt;
+  case Instruction::ZExt: {
+    unsigned srcBits = inst->getOperand(0)->getType()->getIntegerBitWidth();
+    if (auto r = getValueRange(inst->getOperand(0), depth + 1)) {
+      return r;
+    }
+    return ValueRange{0, (uint64_t(1) << srcBits) - 1};
+  }
+  case Instruction::Add: {
+    auto l = getValueRange(inst->getOperand(0), depth + 1);
+    auto r = getValueRange(inst->getOperand(1), depth + 1);
+    // give up if the addition can wrap
+    if (!l || !r || l->second > maxValue - r->second) {
+      return std::nullopt;
+    }
+    return ValueRange{l->first + r->first, l->second + r->second,
+                      std::gcd(l->stride, r->stride)};
+  }
+  case Instruction::Select: {
+    auto l = getValueRange(inst->getOperand(1), depth + 1);
+    auto r = getValueRange(inst->getOperand(2), depth + 1);
+    if (!l || !r) {
+      return std::nullopt;
+    }
+    uint64_t diff = std::max(l->first, r->first) - std::min(l->first, r->first);
+    return ValueRange{std::min(l->first, r->first),
+                      std::max(l->second, r->second),
+                      std::gcd(std::gcd(l->stride, r->stride), diff)};
+  }
+  default:
+    return std::nullopt;
+  }
+}
+
+void addRange(MemRanges &ranges, uint64_t begin, uint64_t end) {
+  if (begin >= end) {
+    return;
+  }
+  // merge with the overlapping ranges
+  auto it = ranges.upper_bound(begin);
+  if (it != ranges.begin() && std::prev(it)->second >= begin) {
+    --it;
+  }
+  while (it != ranges.end() && it->first <= end) {
+    begin = std::min(begin, it->first);
+    end = std::max(end, it->second);
+    it = ranges.erase(it);
+  }
+  ranges[begin] = end;
+}
+
+// Record the write of the user `u` through `ptr`, which points to `mem` +
+// [idx.first, idx.second]. Returns false if the write is unbounded or `ptr`
+// escapes.
+bool visitMemUser(llvm::User *u, llvm::Value *ptr, ValueRange idx,
+                  MemRanges &writes, const llvm::DataLayout &DL) {
+  using namespace llvm;
+  if (isa<LoadInst>(u)) {
+    return true;
+  }
+  if (auto *si = dyn_cast<StoreInst>(u)) {
+    if (si->getValueOperand() == ptr) {
+      return false;
+    }
+    uint64_t size = DL.getTypeStoreSize(si->getValueOperand()->getType());
+    addRange(writes, idx.first, idx.second + size);
+    return true;
+  }
+  if (auto *mi = dyn_cast<MemIntrinsic>(u)) {
+    if (mi->getRawDest() != ptr) {
+      return true; // source of memcpy/memmove
+    }
+    auto len = getValueRange(mi->getLength());
+    if (!len) {
+      return false;
+    }
+    addRange(writes, idx.first, idx.second + len->second);
+    return true;
+  }
+  if (auto *rmw = dyn_cast<AtomicRMWInst>(u)) {
+    uint64_t size = DL.getTypeStoreSize(rmw->getValOperand()->getType());
+    addRange(writes, idx.first, idx.second + size);
+    return true;
+  }
+  if (auto *cas = dyn_cast<AtomicCmpXchgInst>(u)) {
+    uint64_t size = DL.getTypeStoreSize(cas->getNewValOperand()->getType());
+    addRange(writes, idx.first, idx.second + size);
+    return true;
+  }
+  return false;
+}
+
+// The pointers to the start of the memory: `mem` itself, or the loads of it
+// when it holds the base pointer (MemBasePointer). Returns false if the base
+// pointer is used otherwise.
+bool getMemRoots(llvm::GlobalVariable *mem,
+                 llvm::SmallVectorImpl<llvm::Value *> &roots) {
+  using namespace llvm;
+  if (!mem->getValueType()->isPointerTy()) {
+    roots.push_back(mem);
+    return true;
+  }
+  for (User *u : mem->users()) {
+    if (!isa<LoadInst>(u)) {
+      return false;
+    }
+    roots.push_back(u);
+  }
+  return true;
+}
+
+} // namespace
+
+std::optional<MemRanges> collectMemWrites(llvm::GlobalVariable *mem) {
+  using namespace llvm;
+  const DataLayout &DL = mem->getParent()->getDataLayout();
+  MemRanges writes;
+  SmallVector<Value *> roots;
+  if (!getMemRoots(mem, roots)) {
+    return std::nullopt;
+  }
+  for (Value *root : roots) {
+    for (User *u : root->users()) {
+      auto *gep = dyn_cast<GEPOperator>(u);
+      if (gep == nullptr) {
+        // GEPs to offset 0 are folded to the memory itself.
+        if (!visitMemUser(u, root, {0, 0}, writes, DL)) {
+          return std::nullopt;
+        }
+        continue;
+      }
+      Value *idx = getMemAccessIndex(gep, mem);
+      std::optional<ValueRange> range =
+          idx != nullptr ? getValueRange(idx) : std::nullopt;
+      if (!range) {
+        // only reads are allowed through unbounded addresses
+        for (User *gu : gep->users()) {
+          if (!isa<LoadInst>(gu) &&
+              !(isa<MemTransferInst>(gu) &&
+                cast<MemTransferInst>(gu)->getRawSource() == gep &&
+                cast<MemTransferInst>(gu)->getRawDest() != gep)) {
+            return std::nullopt;
+          }
+        }
+        continue;
+      }
+      for (User *gu : gep->users()) {
+        if (!visitMemUser(gu, gep, *range, writes, DL)) {
+          return std::nullopt;
+        }
+      }
+    }
+  }
+  return writes;
+}
+
+namespace {
+
+// max number of table entries to turn into a select chain
+const uint64_t MaxSelectChain = 16;
+
+// Little endian constant of type `ty` from the bytes.
+llvm::Constant *getConstantFromBytes(llvm::Type *ty, const uint8_t *bytes,
+                                     const llvm::DataLayout &DL) {
+  using namespace llvm;
+  if (auto *vty = dyn_cast<FixedVectorType>(ty)) {
+    uint64_t elemSize = DL.getTypeStoreSize(vty->getElementType());
+    SmallVector<Constant *> elems;
+    for (unsigned i = 0; i < vty->getNumElements(); i++) {
+      Constant *elem =
+          getConstantFromBytes(vty->getElementType(), bytes + i * elemSize, DL);
+      if (elem == nullptr) {
+        return nullptr;
+      }
+      elems.push_back(elem);
+    }
+    return ConstantVector::get(elems);
+  }
+  if (!ty->isIntegerTy() && !ty->isFloatingPointTy()) {
+    return nullptr;
+  }
+  unsigned bits = ty->getPrimitiveSizeInBits();
+  APInt val(bits, 0);
+  for (unsigned i = 0; i < bits / 8; i++) {
+    val.insertBits(bytes[i], i * 8, 8);
+  }
+  if (ty->isIntegerTy()) {
+    return ConstantInt::get(ty, val);
+  }
+  return ConstantFP::get(ty, APFloat(ty->getFltSemantics(), val));
+}
+
+const DataRange *findReadOnly(const std::vector<DataRange> &data,
+                              uint64_t begin, uint64_t end) {
+  for (const DataRange &range : data) {
+    if (range.readOnly && range.begin <= begin &&
+        end <= range.begin + range.bytes->size()) {
+      return &range;
+    }
+  }
+  return nullptr;
+}
+
+// The value of the load at mem + idx, or nullptr if it is not known.
+llvm::Value *foldLoad(llvm::LoadInst *li, llvm::Value *idx,
+                      const std::vector<DataRange> &data,
+                      const llvm::DataLayout &DL) {
+  using namespace llvm;
+  Type *ty = li->getType();
+  uint64_t size = DL.getTypeStoreSize(ty);
+  std::optional<ValueRange> r = getValueRange(idx);
+  // e.g. a table of i32 indexed by (i << 2) takes one select per entry
+  if (!r || (r->stride != 0 &&
+             (r->second - r->first) / r->stride >= MaxSelectChain)) {
+    return nullptr;
+  }
+  const DataRange *range = findReadOnly(data, r->first, r->second + size);
+  if (range == nullptr) {
+    return nullptr;
+  }
+  const uint8_t *bytes = range->bytes->data() - range->begin;
+  Constant *first = getConstantFromBytes(ty, bytes + r->first, DL);
+  if (first == nullptr) {
+    return nullptr;
+  }
+  // select chain over the possible addresses
+  IRBuilder<> builder(li);
+  Value *ret = first;
+  for (uint64_t addr = r->first + r->stride;
+       r->stride != 0 && addr <= r->second; addr += r->stride) {
+    Constant *c = getConstantFromBytes(ty, bytes + addr, DL);
+    if (c == ret) {
+      continue;
+    }
+    Value *cond =
+        builder.CreateICmpEQ(idx, ConstantInt::get(idx->getType(), addr));
+    ret = builder.CreateSelect(cond, c, ret, "rodata_select");
+  }
+  return ret;
+}
+
+// Fold the users of `val` that only have constant operands now.
+void foldConstantUsers(llvm::Value *val, const llvm::DataLayout &DL) {
+  using namespace llvm;
+  SmallVector<Instruction *> worklist;
+  for (User *u : val->users()) {
+    if (auto *inst = dyn_cast<Instruction>(u)) {
+      worklist.push_back(inst);
+    }
+  }
+  while (!worklist.empty()) {
+    Instruction *inst = worklist.pop_back_val();
+    if (isa<LoadInst>(inst) || inst->use_empty()) {
+      continue; // loads are folded in the next round
+    }
+    Constant *c = ConstantFoldInstruction(inst, DL);
+    if (c == nullptr) {
+      continue;
+    }
+    for (User *u : inst->users()) {
+      if (auto *userInst = dyn_cast<Instruction>(u)) {
+        worklist.push_back(userInst);
+      }
+    }
+    inst->replaceAllUsesWith(c);
+  }
+}
+
+} // namespace
+
+unsigned foldReadOnlyLoads(llvm::GlobalVariable *mem,
+                           const std::vector<DataRange> &data, int logLevel) {
+  using namespace llvm;
+  const DataLayout &DL = mem->getParent()->getDataLayout();
+  unsigned folded = 0;
+  Value *zero = ConstantInt::get(Type::getInt32Ty(mem->getContext()), 0);
+  // folded table bases expose more constant addresses
+  for (unsigned round = 0; round < 4; round++) {
+    SmallVector<std::pair<LoadInst *, Value *>> loads;
+    SmallVector<Value *> roots;
+    if (!getMemRoots(mem, roots)) {
+      break;
+    }
+    for (Value *root : roots) {
+      for (User *u : root->users()) {
+        if (auto *li = dyn_cast<LoadInst>(u)) {
+          loads.push_back({li, zero});
+          continue;
+        }
+        auto *gep = dyn_cast<GEPOperator>(u);
+        Value *idx = gep != nullptr ? getMemAccessIndex(gep, mem) : nullptr;
+        if (idx == nullptr) {
+          continue;
+        }
+        for (User *gu : gep->users()) {
+          auto *li = dyn_cast<LoadInst>(gu);
+          if (li != nullptr && li->isSimple() &&
+              li->getPointerOperand() == gep) {
+            loads.push_back({li, idx});
+          }
+        }
+      }
+    }
+    unsigned before = folded;
+    for (auto [li, idx] : loads) {
+      Value *val = foldLoad(li, idx, data, DL);
+      if (val == nullptr) {
+        continue;
+      }
+      li->replaceAllUsesWith(val);
+      li->eraseFromParent();
+      foldConstantUsers(val, DL);
+      folded++;
+    }
+    if (folded == before) {
+      break;
+    }
+  }
+  if (logLevel >= level_info && folded != 0) {
+    std::cerr << "Info: Folded " << folded << " loads from read-only data."
+              << std::endl;
+  }
+  return folded;
+}
+
+bool mayPassMemAddress(llvm::ArrayRef<llvm::Function *> imports) {
+  using namespace llvm;
+  for (Function *import : imports) {
+    for (Use &use : import->uses()) {
+      auto *call = dyn_cast<CallBase>(use.getUser());
+      if (call == nullptr || !call->isCallee(&use)) {
+        // the address of the import is taken, e.g. for a table element.
+        return true;
+      }
+      for (Value *arg : call->args()) {
+        if (arg->getType()->isIntegerTy()) {
+          return true;
+        }
+      }
+    }
+  }
+  return false;
+}
+
+bool overlaps(const MemRanges &ranges, uint64_t begin, uint64_t end) {
+  auto it = ranges.upper_bound(begin);
+  if (it != ranges.begin() && std::prev(it)->second > begin) {
+    return true;
+  }
+  return it != ranges.end() && it->first < end;
+}
+
+} // namespace notdec::frontend::wasm
@@ -14,8 +14,11 @@ namespace notdec::frontend::wasm {
 void BlockContext::visitBlock(wabt::LabelType lty, llvm::BasicBlock *entry,
                               llvm::BasicBlock *exit,
                               wabt::BlockDeclaration &decl,
-                              wabt::ExprList &exprs) {
+                              wabt::ExprList &exprs, bool keepTarget,
+                              TryHandler *handler) {
   // create Phi for block type
+  // `keepTarget` keeps the label on the block stack and the results off the
+  // value stack, for the next arm (else or catch) of the same label.
   using namespace wabt;
   std::deque<llvm::PHINode *> phis;
   llvm::BasicBlock *breakTo;
@@ -31,6 +34,7 @@ void BlockContext::visitBlock(wabt::LabelType lty, llvm::BasicBlock *entry,
   case LabelType::Block:
   case LabelType::Func:
   case LabelType::If:
+  case LabelType::Try:
     assert(exit->getFirstNonPHIIt() == exit->end());
     // 把参数留在栈上
     // 为基本块返回值创建Phi
@@ -43,6 +47,7 @@ void BlockContext::visitBlock(wabt::LabelType lty, llvm::BasicBlock *entry,
       phis.push_back(phi);
     }
   case LabelType::Else:
+  case LabelType::Catch:
     isBlockLike = true;
     // 有跳出的直接跳到exit
     breakTo = exit;
@@ -61,7 +66,7 @@ void BlockContext::visitBlock(wabt::LabelType lty, llvm::BasicBlock *entry,
                               entry->getName() + "_" + std::to_string(i));
       phis.push_front(phi);
       // 给phi赋值，然后用Phi替换栈上值
-      phi->addIncoming(popStack(), entry);
+      phi->addIncoming(popStack(), entry->getSinglePredecessor());
     }
     // 把栈上参数转换为Phi
     for (auto phi : phis) {
@@ -71,9 +76,7 @@ void BlockContext::visitBlock(wabt::LabelType lty, llvm::BasicBlock *entry,
     // 有跳出的直接跳到entry
     breakTo = entry;
     break;
-  case LabelType::Try:
   case LabelType::InitExpr:
-  case LabelType::Catch:
   default:
     std::cerr << __FILE__ << ":" << __LINE__ << ": "
               << "Error: unexpected LabelType: " << labelTypeToString(lty)
@@ -84,15 +87,22 @@ void BlockContext::visitBlock(wabt::LabelType lty, llvm::BasicBlock *entry,
   std::size_t stack_pos = lty == LabelType::Func
                               ? stack.size()
                               : stack.size() - decl.GetNumParams();
-  if (lty != LabelType::Else) {
+  if (lty != LabelType::Else && lty != LabelType::Catch) {
+    // exceptions go to the enclosing handler, unless it is a try block
+    TryHandler *outer =
+        blockStack.empty() ? nullptr : blockStack.back().handler;
     blockStack.emplace_back(*breakTo, phis, stack_pos, decl, lty);
+    blockStack.back().handler = lty == LabelType::Try ? handler : outer;
   } else { // restore previous phis
     stack_pos = blockStack.back().pos;
     phis = blockStack.back().phis;
   }
   // 依次遍历每个指令，同时处理栈的变化。
   visitControlInsts(entry, exit, exprs);
-  if (lty != LabelType::If) {
+  if (lty == LabelType::Catch && irBuilder.GetInsertBlock() != nullptr) {
+    createEndCatch(blockStack.size() - 1); // falls through to the exit
+  }
+  if (!keepTarget) {
     assert(blockStack.size() >= 0);
     blockStack.pop_back();
   }
@@ -105,14 +115,14 @@ void BlockContext::visitBlock(wabt::LabelType lty, llvm::BasicBlock *entry,
                 << (stack.size() - stack_pos) << std::endl;
       std::abort();
     }
-    assert(stack.size() >= phis.size());
+    requireStack(phis.size());
     // 栈上值和Phi的转换，需要和创建的br一起。
     if (isBlockLike) {
       for (auto it = phis.rbegin(); it != phis.rend(); ++it) {
-        (*it)->addIncoming(stack.back(), irBuilder.GetInsertBlock());
+        (*it)->addIncoming(toV128(stack.back()), irBuilder.GetInsertBlock());
         stack.pop_back();
       }
-      if (lty != LabelType::If) {
+      if (!keepTarget) {
         for (auto phi : phis) {
           stack.push_back(phi);
         }
@@ -137,8 +147,10 @@ void BlockContext::visitBlock(wabt::LabelType lty, llvm::BasicBlock *entry,
       std::abort();
     }
     // push 返回值
-    for (auto phi : phis) {
-      stack.push_back(phi);
+    if (!keepTarget) {
+      for (auto phi : phis) {
+        stack.push_back(phi);
+      }
     }
   } // keep unreachable state if loop
 }
@@ -160,6 +172,29 @@ void BlockContext::unwindStackTo(std::size_t stack_pos) {
   }
 }
 
+// v128 values keep the vector type of the operation that produced them, and
+// are only converted to the canonical type where the types must match exactly.
+llvm::Value *BlockContext::toV128(llvm::Value *val) {
+  if (!val->getType()->isVectorTy() || val->getType() == type.v128Type) {
+    return val;
+  }
+  return irBuilder.CreateBitCast(val, type.v128Type);
+}
+
+void BlockContext::malformed(const std::string &msg) {
+  std::cerr << __FILE__ << ":" << __LINE__ << ": "
+            << "Error: Malformed function body of "
+            << function.getName().str() << ": " << msg << std::endl;
+  std::abort();
+}
+
+void BlockContext::normalizeStack(std::size_t num) {
+  requireStack(num);
+  for (std::size_t i = stack.size() - num; i < stack.size(); i++) {
+    stack[i] = toV128(stack[i]);
+  }
+}
+
 llvm::BasicBlock::iterator getFirstNonPHIOrDbgOrLifetime(llvm::BasicBlock *bb) {
   return bb->getFirstNonPHIOrDbgOrLifetime();
 }
@@ -218,6 +253,7 @@ void BlockContext::visitControlInsts(llvm::BasicBlock *entry,
       auto e = wabt::cast<wabt::LoopExpr>(&expr);
       BasicBlock *entryBlock =
           llvm::BasicBlock::Create(llvmContext, "loop_entry", &function);
+      normalizeStack(e->block.decl.GetNumParams());
       irBuilder.CreateBr(entryBlock);
       entry = entryBlock;
       irBuilder.SetInsertPoint(entry);
@@ -231,11 +267,9 @@ void BlockContext::visitControlInsts(llvm::BasicBlock *entry,
       auto e = wabt::cast<wabt::IfExpr>(&expr);
       std::vector<llvm::Value *> params;
       // boolean arg
-      assert(stack.size() >= 1);
-      Value *p1 = stack.back();
-      stack.pop_back();
+      Value *p1 = popStack();
       // save other args
-      assert(stack.size() >= e->true_.decl.GetNumParams());
+      requireStack(e->true_.decl.GetNumParams());
       std::size_t start_ind = stack.size() - e->true_.decl.GetNumParams();
       for (std::size_t i = start_ind; i < stack.size(); i++) {
         params.push_back(stack.at(i));
@@ -253,7 +287,7 @@ void BlockContext::visitControlInsts(llvm::BasicBlock *entry,
       entry = ifBlock;
       irBuilder.SetInsertPoint(entry);
       visitBlock(wabt::LabelType::If, entry, exitBlock, e->true_.decl,
-                 e->true_.exprs);
+                 e->true_.exprs, true);
       // duplicate parameter
       for (std::size_t i = 0; i < params.size(); i++) {
         stack.push_back(params.at(i));
@@ -266,10 +300,14 @@ void BlockContext::visitControlInsts(llvm::BasicBlock *entry,
       irBuilder.SetInsertPoint(entry);
       break;
     }
+    case wabt::ExprType::Try:
+      visitTry(wabt::cast<wabt::TryExpr>(&expr));
+      entry = irBuilder.GetInsertBlock();
+      break;
     case wabt::ExprType::BrIf: {
       using namespace llvm;
       auto e = wabt::cast<wabt::BrIfExpr>(&expr);
-      std::size_t brind = (e->var.index() + 1);
+      std::size_t target = getBrTarget(e->var.index());
       // boolean arg
       Value *p1 = popStack();
       // convert to i1
@@ -277,34 +315,39 @@ void BlockContext::visitControlInsts(llvm::BasicBlock *entry,
                                   "brif_val");
       BasicBlock *nextBlock =
           llvm::BasicBlock::Create(llvmContext, "brif_next", &function);
-      assert(blockStack.size() >= brind);
-      visitBr(e, blockStack.size() - brind, p1, nextBlock);
+      visitBr(e, target, p1, nextBlock);
       entry = nextBlock;
       irBuilder.SetInsertPoint(entry);
       break;
     }
     case wabt::ExprType::Br: {
-      // index里面有assert。
-      // add 1 for negative index
-      std::size_t brind = (wabt::cast<wabt::BrExpr>(&expr)->var.index() + 1);
-      assert(blockStack.size() >= brind); // 防止下溢
-      visitBr(&expr, blockStack.size() - brind, nullptr, nullptr);
+      visitBr(&expr, getBrTarget(wabt::cast<wabt::BrExpr>(&expr)->var.index()),
+              nullptr, nullptr);
       break;
     }
     case wabt::ExprType::BrTable: {
       using namespace llvm;
       wabt::BrTableExpr *brt = wabt::cast<wabt::BrTableExpr>(&expr);
       // 默认target
-      std::size_t defInd = (brt->default_target.index() + 1);
+      std::size_t defTarget = getBrTarget(brt->default_target.index());
       Value *p1 = popStack();
-      SwitchInst *si = cast<SwitchInst>(
-          visitBr(brt, blockStack.size() - defInd, p1, nullptr));
+      // all targets have the same arity.
+      normalizeStack(blockStack.at(defTarget).phis.size());
+      BasicBlock *current = irBuilder.GetInsertBlock();
+      SwitchInst *si =
+          cast<SwitchInst>(visitBr(brt, defTarget, p1, nullptr));
       // 其他target
       for (wabt::Index i = 0; i < brt->targets.size(); i++) {
-        std::size_t ind = (brt->targets.at(i).index() + 1);
-        BreakoutTarget &bt = blockStack.at(blockStack.size() - ind);
-        si->addCase(ConstantInt::get(Type::getInt32Ty(llvmContext), i),
-                    &bt.target);
+        std::size_t target = getBrTarget(brt->targets.at(i).index());
+        BreakoutTarget &bt = blockStack.at(target);
+        BasicBlock *from = current;
+        BasicBlock *dest = &bt.target;
+        if (leavesCatch(target)) {
+          irBuilder.SetInsertPoint(current);
+          dest = from = createLeaveBlock(target);
+          irBuilder.ClearInsertionPoint();
+        }
+        si->addCase(ConstantInt::get(Type::getInt32Ty(llvmContext), i), dest);
         auto stackIt = stack.rbegin();
         for (auto it = bt.phis.rbegin(); it != bt.phis.rend();
              ++it, ++stackIt) {
@@ -317,7 +360,7 @@ void BlockContext::visitControlInsts(llvm::BasicBlock *entry,
                       << " result num " << bt.sig.GetNumResults() << std::endl;
             std::abort();
           }
-          (*it)->addIncoming((*stackIt), irBuilder.GetInsertBlock());
+          (*it)->addIncoming((*stackIt), from);
         }
       }
       break;
@@ -327,6 +370,10 @@ void BlockContext::visitControlInsts(llvm::BasicBlock *entry,
       break;
     default:
       dispatchExprs(expr);
+      // some instructions (e.g. bound checks) split the current block.
+      if (irBuilder.GetInsertBlock() != nullptr) {
+        entry = irBuilder.GetInsertBlock();
+      }
       break;
     }
   }
@@ -341,23 +388,33 @@ llvm::Instruction *BlockContext::visitBr(wabt::Expr *expr, std::size_t ind,
     // 等价于直接跳转出最外面的函数体block
     assert(bt.lty == wabt::LabelType::Func);
   }
+  // leaving catch blocks releases their exceptions, on a separate edge block
+  // for conditional branches.
+  llvm::BasicBlock *dest = &bt.target;
+  llvm::BasicBlock *from = irBuilder.GetInsertBlock();
+  if (cond == nullptr) {
+    createEndCatch(ind);
+  } else if (leavesCatch(ind)) {
+    dest = createLeaveBlock(ind);
+    from = dest;
+  }
   // 返回值放到Phi里
-  assert(stack.size() >= bt.phis.size());
+  requireStack(bt.phis.size());
   auto stackIt = stack.rbegin();
   for (auto it = bt.phis.rbegin(); it != bt.phis.rend(); ++it, ++stackIt) {
-    (*it)->addIncoming((*stackIt), irBuilder.GetInsertBlock());
+    (*it)->addIncoming(toV128(*stackIt), from);
   }
   if (cond == nullptr && nextBlock == nullptr) {
     assert(expr->type() == wabt::ExprType::Br ||
            expr->type() == wabt::ExprType::Return);
-    ret = irBuilder.CreateBr(&bt.target);
+    ret = irBuilder.CreateBr(dest);
     irBuilder.ClearInsertionPoint(); // mark unreachable
   } else if (cond != nullptr && nextBlock != nullptr) {
     assert(expr->type() == wabt::ExprType::BrIf);
-    ret = irBuilder.CreateCondBr(cond, &bt.target, nextBlock);
+    ret = irBuilder.CreateCondBr(cond, dest, nextBlock);
   } else if (cond != nullptr && nextBlock == nullptr) {
     assert(expr->type() == wabt::ExprType::BrTable);
-    ret = irBuilder.CreateSwitch(cond, &bt.target);
+    ret = irBuilder.CreateSwitch(cond, dest);
     irBuilder.ClearInsertionPoint(); // mark unreachable
   } else {
     std::cerr << __FILE__ << ":" << __LINE__ << ": "
@@ -368,11 +425,134 @@ llvm::Instruction *BlockContext::visitBr(wabt::Expr *expr, std::size_t ind,
   return ret;
 }
 
+// Lower the exception handling proposal to invoke/landingpad with the
+// Itanium C++ personality, so the path without exceptions costs nothing. The
+// exceptions are created and inspected by lib/notdec-wasm2llvm-rt.
+//
+//   try_lpad:     landingpad catch-all, br try_dispatch
+//   try_dispatch: switch on the tag to the catch blocks. Unmatched exceptions
+//                 go to the enclosing handler, or are resumed to the caller.
+void BlockContext::visitTry(wabt::TryExpr *expr) {
+  using namespace llvm;
+  wabt::Block &block = expr->block;
+  BasicBlock *exitBlock =
+      BasicBlock::Create(llvmContext, "try_exit", &function);
+  TryHandler *outer = blockStack.back().handler;
+  if (expr->kind == wabt::TryKind::Delegate) {
+    // the label is counted from outside of the try block.
+    TryHandler *target =
+        blockStack.at(getBrTarget(expr->delegate_target.index())).handler;
+    visitBlock(wabt::LabelType::Try, irBuilder.GetInsertBlock(), exitBlock,
+               block.decl, block.exprs, false, target);
+    irBuilder.SetInsertPoint(exitBlock);
+    return;
+  }
+  if (expr->catches.empty()) {
+    visitBlock(wabt::LabelType::Try, irBuilder.GetInsertBlock(), exitBlock,
+               block.decl, block.exprs, false, outer);
+    irBuilder.SetInsertPoint(exitBlock);
+    return;
+  }
+
+  TryHandler *handler = createTryHandler();
+  visitBlock(wabt::LabelType::Try, irBuilder.GetInsertBlock(), exitBlock,
+             block.decl, block.exprs, true, handler);
+
+  irBuilder.SetInsertPoint(handler->dispatch);
+  Value *exn = irBuilder.CreateExtractValue(handler->exn, 0, "exn_ptr");
+  FunctionCallee tagFunc = ctx.llvmModule.getOrInsertFunction(
+      "__notdec_wasm_exception_tag", type.i32Type, type.i8PtrType);
+  Value *tag = irBuilder.CreateCall(tagFunc, {exn}, "exn_tag");
+  BasicBlock *unmatched =
+      BasicBlock::Create(llvmContext, "try_unmatched", &function);
+  SwitchInst *si = irBuilder.CreateSwitch(tag, unmatched);
+
+  FunctionCallee catchFunc = ctx.llvmModule.getOrInsertFunction(
+      "__notdec_wasm_catch", Type::getVoidTy(llvmContext), type.i8PtrType,
+      type.i8PtrType, type.i32Type);
+  uint32_t payloadSize = getExnPayloadSize();
+  for (std::size_t i = 0; i < expr->catches.size(); i++) {
+    wabt::Catch &c = expr->catches.at(i);
+    BasicBlock *catchBlock =
+        BasicBlock::Create(llvmContext, "catch", &function);
+    const wabt::FuncSignature *sig = nullptr;
+    if (c.IsCatchAll()) { // catch_all is always the last one
+      IRBuilder<> b(unmatched);
+      b.CreateBr(catchBlock);
+      unmatched = nullptr;
+    } else {
+      wabt::Index tagIndex = ctx.module->GetTagIndex(c.var);
+      sig = &ctx.module->tags.at(tagIndex)->decl.sig;
+      ConstantInt *caseValue = ConstantInt::get(type.i32Type, tagIndex);
+      // a duplicated tag is shadowed by the previous catch.
+      if (si->findCaseValue(caseValue) == si->case_default()) {
+        si->addCase(caseValue, catchBlock);
+      }
+    }
+    // copy out the payload and release the exception.
+    irBuilder.SetInsertPoint(catchBlock);
+    AllocaInst *payload = createEntryAlloca(
+        ArrayType::get(type.i8Type, payloadSize), "exn_payload");
+    irBuilder.CreateCall(catchFunc,
+                         {exn, payload,
+                          ConstantInt::get(type.i32Type, payloadSize)});
+    BreakoutTarget &bt = blockStack.back();
+    bt.lty = wabt::LabelType::Catch;
+    bt.handler = outer;
+    bt.exn = exn;
+    bt.exnTag = tag;
+    bt.exnPayload = payload;
+    if (sig != nullptr) {
+      for (wabt::Index j = 0; j < sig->GetNumParams(); j++) {
+        Value *slot =
+            irBuilder.CreateConstGEP1_32(type.i8Type, payload, j * 16);
+        stack.push_back(irBuilder.CreateLoad(
+            convertType(llvmContext, sig->GetParamType(j)), slot));
+      }
+    }
+    visitBlock(wabt::LabelType::Catch, catchBlock, exitBlock, block.decl,
+               c.exprs, i + 1 != expr->catches.size());
+  }
+  if (unmatched != nullptr) {
+    IRBuilder<> b(unmatched);
+    if (outer != nullptr) {
+      outer->exn->addIncoming(handler->exn, unmatched);
+      b.CreateBr(outer->dispatch);
+    } else {
+      b.CreateResume(handler->exn);
+    }
+  }
+  irBuilder.SetInsertPoint(exitBlock);
+}
+
+TryHandler *BlockContext::createTryHandler() {
+  using namespace llvm;
+  if (!function.hasPersonalityFn()) {
+    FunctionCallee personality = ctx.llvmModule.getOrInsertFunction(
+        "__gxx_personality_v0", FunctionType::get(type.i32Type, true));
+    function.setPersonalityFn(cast<Constant>(personality.getCallee()));
+  }
+  TryHandler &handler = tryHandlers.emplace_back();
+  handler.lpad = BasicBlock::Create(llvmContext, "try_lpad", &function);
+  handler.dispatch = BasicBlock::Create(llvmContext, "try_dispatch", &function);
+  StructType *lpType = StructType::get(type.i8PtrType, type.i32Type);
+  IRBuilder<> b(handler.lpad);
+  // catch everything, including foreign exceptions for catch_all.
+  LandingPadInst *lp = b.CreateLandingPad(lpType, 1);
+  lp->addClause(ConstantPointerNull::get(type.i8PtrType));
+  b.CreateBr(handler.dispatch);
+  b.SetInsertPoint(handler.dispatch);
+  handler.exn = b.CreatePHI(lpType, 1, "exn");
+  handler.exn->addIncoming(lp, handler.lpad);
+  return &handler;
+}
+
 bool isContainBlock(wabt::Expr &expr) {
   switch (expr.type()) {
   case wabt::ExprType::Block:
   case wabt::ExprType::Loop:
   case wabt::ExprType::If:
+  case wabt::ExprType::Try:
     return true;
   default:
     return false;
@@ -387,6 +567,8 @@ wabt::Block &getBlock(wabt::Expr &expr) {
     return wabt::cast<wabt::LoopExpr>(&expr)->block;
   case wabt::ExprType::If:
     return wabt::cast<wabt::IfExpr>(&expr)->true_;
+  case wabt::ExprType::Try:
+    return wabt::cast<wabt::TryExpr>(&expr)->block;
   default:
     std::cerr << __FILE__ << ":" << __LINE__ << ": "
               << "Error: Unsupported expr type for `getBlock`: "
@@ -405,10 +587,10 @@ bool checkBlockLike(wabt::LabelType lty) {
     return false;
   case LabelType::If:
   case LabelType::Else:
-    return true;
   case LabelType::Try:
-  case LabelType::InitExpr:
   case LabelType::Catch:
+    return true;
+  case LabelType::InitExpr:
   default:
     std::cerr << __FILE__ << ":" << __LINE__ << ": "
               << "Error: unexpected LabelType: " << labelTypeToString(lty)
@@ -484,6 +666,8 @@ extendType::extendType(llvm::LLVMContext &llvmContext) {
   i16x32Type = llvm::FixedVectorType::get(i16Type, 32);
   i32x16Type = llvm::FixedVectorType::get(i32Type, 16);
   i64x8Type = llvm::FixedVectorType::get(i64Type, 8);
+
+  v128Type = i32x4Type;
 }
 
 } // namespace notdec::frontend::wasm
@@ -1,7 +1,12 @@
+#include <algorithm>
+#include <cmath>
+
 #include <llvm/ADT/SmallVector.h>
 #include <llvm/IR/DerivedTypes.h>
 #include <llvm/IR/GlobalVariable.h>
 #include <llvm/IR/Instructions.h>
+#include <llvm/IR/MDBuilder.h>
+#include <llvm/IR/Operator.h>
 #include <llvm/Support/Alignment.h>
 #include <llvm/Support/Casting.h>
 #include <llvm/Support/raw_ostream.h>
@@ -37,9 +42,26 @@ void BlockContext::dispatchExprs(wabt::Expr &expr) {
   case ExprType::CallIndirect:
     visitCallIndirectInst(cast<CallIndirectExpr>(&expr));
     break;
+  case ExprType::ReturnCall:
+    visitReturnCall(cast<ReturnCallExpr>(&expr));
+    break;
+  case ExprType::ReturnCallIndirect:
+    visitReturnCallIndirect(cast<ReturnCallIndirectExpr>(&expr));
+    break;
   case ExprType::Load:
     visitLoadInst(cast<LoadExpr>(&expr));
     break;
+  case ExprType::LoadSplat: {
+    auto *e = cast<LoadSplatExpr>(&expr);
+    createLoad(e->opcode, e->align, e->offset);
+  } break;
+  case ExprType::LoadZero: {
+    auto *e = cast<LoadZeroExpr>(&expr);
+    createLoad(e->opcode, e->align, e->offset);
+  } break;
+  case ExprType::Ternary:
+    visitTernaryInst(cast<TernaryExpr>(&expr));
+    break;
   case ExprType::Store:
     visitStoreInst(cast<StoreExpr>(&expr));
     break;
@@ -58,6 +80,12 @@ void BlockContext::dispatchExprs(wabt::Expr &expr) {
   case ExprType::GlobalSet:
     visitGlobalSet(cast<GlobalSetExpr>(&expr));
     break;
+  case ExprType::Throw:
+    visitThrow(cast<ThrowExpr>(&expr));
+    break;
+  case ExprType::Rethrow:
+    visitRethrow(cast<RethrowExpr>(&expr));
+    break;
   case ExprType::Unreachable:
     irBuilder.CreateUnreachable();
     irBuilder.ClearInsertionPoint();
@@ -87,19 +115,63 @@ void BlockContext::dispatchExprs(wabt::Expr &expr) {
     llvm::Value *num = popStack();
     llvm::Value *src = convertStackAddr(0);
     llvm::Value *dest = convertStackAddr(0);
-    irBuilder.CreateMemCpy(dest, llvm::MaybeAlign(0), src, llvm::MaybeAlign(0),
-                           num, true);
+    // the ranges can overlap, e.g. in memmove.
+    irBuilder.CreateMemMove(dest, llvm::Align(1), src, llvm::Align(1), num);
   } break;
   case ExprType::MemoryFill: {
     llvm::Value *num = popStack();
     llvm::Value *byte = popStack();
     byte = irBuilder.CreateTrunc(byte, llvm::Type::getInt8Ty(llvmContext));
     llvm::Value *dest = convertStackAddr(0);
-    irBuilder.CreateMemSet(dest, byte, num, llvm::MaybeAlign(0), true);
+    irBuilder.CreateMemSet(dest, byte, num, llvm::Align(1));
   } break;
+  case ExprType::MemoryInit:
+    visitMemoryInit(cast<MemoryInitExpr>(&expr));
+    break;
+  case ExprType::DataDrop:
+    visitDataDrop(cast<DataDropExpr>(&expr));
+    break;
+  case ExprType::TableInit:
+    visitTableInit(cast<TableInitExpr>(&expr));
+    break;
+  case ExprType::TableCopy:
+    visitTableCopy(cast<TableCopyExpr>(&expr));
+    break;
+  case ExprType::ElemDrop:
+    visitElemDrop(cast<ElemDropExpr>(&expr));
+    break;
+  case ExprType::TableGet:
+    visitTableGet(cast<TableGetExpr>(&expr));
+    break;
+  case ExprType::TableSet:
+    visitTableSet(cast<TableSetExpr>(&expr));
+    break;
+  case ExprType::TableSize:
+    visitTableSize(cast<TableSizeExpr>(&expr));
+    break;
+  case ExprType::TableGrow:
+    visitTableGrow(cast<TableGrowExpr>(&expr));
+    break;
+  case ExprType::TableFill:
+    visitTableFill(cast<TableFillExpr>(&expr));
+    break;
+  case ExprType::RefNull:
+    stack.push_back(llvm::ConstantPointerNull::get(type.i8PtrType));
+    break;
+  case ExprType::RefIsNull:
+    visitRefIsNull(cast<RefIsNullExpr>(&expr));
+    break;
+  case ExprType::RefFunc: {
+    llvm::Function *target = ctx.findFunc(cast<RefFuncExpr>(&expr)->var);
+    // validation requires the reference to be declared by an elem segment.
+    if (target->getCallingConv() != llvm::CallingConv::C) {
+      malformed("undeclared function reference");
+    }
+    stack.push_back(target);
+    break;
+  }
   case ExprType::Drop:
-    assert(stack.size() > 0);
-    stack.pop_back();
+    popStack();
     break;
 
   case ExprType::SimdLaneOp:
@@ -140,30 +212,31 @@ void BlockContext::dispatchExprs(wabt::Expr &expr) {
 
 void BlockContext::visitLocalSet(wabt::LocalSetExpr *expr) {
   using namespace llvm;
-  Value *val = popStack();
-  Value *target = locals.at(expr->var.index());
+  Value *val = toV128(popStack());
+  Value *target = getLocal(expr->var);
   irBuilder.CreateStore(val, target);
 }
 
 void BlockContext::visitLocalTee(wabt::LocalTeeExpr *expr) {
   using namespace llvm;
-  assert(stack.size() > 0);
-  Value *val = stack.back(); /* stack.pop_back(); */
-  Value *target = locals.at(expr->var.index());
+  requireStack(1);
+  Value *val = toV128(stack.back()); /* stack.pop_back(); */
+  Value *target = getLocal(expr->var);
   irBuilder.CreateStore(val, target);
 }
 
 void BlockContext::visitGlobalSet(wabt::GlobalSetExpr *expr) {
   using namespace llvm;
-  Value *val = popStack();
-  Value *target = ctx.globs.at(ctx.module->GetGlobalIndex(expr->var));
+  Value *val = toV128(popStack());
+  Value *target = ctx.getGlobalPtr(irBuilder, instance,
+                                   ctx.module->GetGlobalIndex(expr->var));
   irBuilder.CreateStore(val, target);
 }
 
 void BlockContext::visitLocalGet(wabt::LocalGetExpr *expr) {
   using namespace llvm;
   // assert(expr->var.is_index()); // 冗余
-  Value *target = locals.at(expr->var.index());
+  Value *target = getLocal(expr->var);
   auto *alloca = cast<AllocaInst>(target);
   Value *loaded = irBuilder.CreateLoad(alloca->getAllocatedType(), target);
   stack.push_back(loaded);
@@ -171,8 +244,10 @@ void BlockContext::visitLocalGet(wabt::LocalGetExpr *expr) {
 
 void BlockContext::visitGlobalGet(wabt::GlobalGetExpr *expr) {
   using namespace llvm;
-  GlobalVariable *target = ctx.globs.at(ctx.module->GetGlobalIndex(expr->var));
-  Value *loaded = irBuilder.CreateLoad(target->getValueType(), target);
+  wabt::Index index = ctx.module->GetGlobalIndex(expr->var);
+  Value *target = ctx.getGlobalPtr(irBuilder, instance, index);
+  Value *loaded =
+      irBuilder.CreateLoad(ctx.globs.at(index)->getValueType(), target);
   stack.push_back(loaded);
 }
 
@@ -204,13 +279,28 @@ void BlockContext::visitStoreInst(wabt::StoreExpr *expr) {
     val = irBuilder.CreateTrunc(val, targetType);
     break;
   case wabt::Opcode::V128Store:
-    targetType = type.i64x2Type;
+    targetType = val->getType();
   default:
     break;
   }
   assert(targetType != nullptr);
   addr = irBuilder.CreateBitCast(addr, PointerType::get(llvmContext, 0));
-  irBuilder.CreateStore(val, addr);
+  StoreInst *store = irBuilder.CreateAlignedStore(
+      val, addr, getAccessAlign(expr->opcode, expr->align));
+  if (ctx.opts.GenTBAA) {
+    store->setMetadata(LLVMContext::MD_tbaa, ctx.getTBAATag(val->getType()));
+  }
+}
+
+// The memarg alignment is only a hint, and misaligned accesses are valid in
+// wasm, so it is an assumption. The memory itself has alignment 1.
+llvm::Align BlockContext::getAccessAlign(wabt::Opcode opcode,
+                                         wabt::Address align) {
+  if (!ctx.opts.TrustAlignHints) {
+    return llvm::Align(1);
+  }
+  // the hint never exceeds the natural alignment.
+  return llvm::Align(opcode.GetAlignment(align));
 }
 
 void BlockContext::visitSelectExpr(wabt::SelectExpr *expr) {
@@ -219,8 +309,8 @@ void BlockContext::visitSelectExpr(wabt::SelectExpr *expr) {
   // convert to i1
   cond = irBuilder.CreateICmpNE(
       cond, ConstantInt::getNullValue(cond->getType()), "select_cond");
-  Value *val2 = popStack();
-  Value *val1 = popStack();
+  Value *val2 = toV128(popStack());
+  Value *val1 = toV128(popStack());
   Value *res = irBuilder.CreateSelect(cond, val1, val2);
   stack.push_back(res);
 }
@@ -240,27 +330,282 @@ llvm::Value *BlockContext::convertStackAddr(uint64_t offset) {
     return irBuilder.CreateIntToPtr(base, PointerType::get(llvmContext, 0));
   }
 
+  // the address is unsigned, so extend it before indexing the base pointer.
+  if (memBase != nullptr) {
+    return irBuilder.CreateGEP(type.i8Type, memBase,
+                               irBuilder.CreateZExt(base, type.i64Type));
+  }
+
   // if ea+N/8 is larger than the length of mem, then trap?
   Value *arr[2] = {ConstantInt::getNullValue(base->getType()), base};
   return irBuilder.CreateGEP(
       mem->getValueType(), mem, ArrayRef<Value *>(arr, 2));
 }
 
+// Inverse of `convertStackAddr`: if `ptr` points into the linear memory `mem`,
+// return the wasm address, otherwise return nullptr.
+llvm::Value *getMemAccessIndex(llvm::Value *ptr, llvm::GlobalVariable *mem) {
+  using namespace llvm;
+  auto *gep = dyn_cast<GEPOperator>(ptr);
+  if (gep == nullptr) {
+    return nullptr;
+  }
+  if (mem->getValueType()->isPointerTy()) {
+    // MemBasePointer: gep i8, (load mem), (zext idx)
+    auto *li = dyn_cast<LoadInst>(gep->getPointerOperand());
+    if (li == nullptr || li->getPointerOperand() != mem ||
+        gep->getNumIndices() != 1 ||
+        !gep->getSourceElementType()->isIntegerTy(8)) {
+      return nullptr;
+    }
+    Value *idx = gep->getOperand(1);
+    if (auto *zext = dyn_cast<ZExtInst>(idx)) {
+      return zext->getOperand(0);
+    }
+    return idx;
+  }
+  if (gep->getPointerOperand() != mem) {
+    return nullptr;
+  }
+  if (gep->getNumIndices() == 2) {
+    auto *zero = dyn_cast<ConstantInt>(gep->getOperand(1));
+    if (zero == nullptr || !zero->isZero()) {
+      return nullptr;
+    }
+    return gep->getOperand(2);
+  }
+  // canonicalized form: gep i8, mem, idx
+  if (gep->getNumIndices() == 1 &&
+      gep->getSourceElementType()->isIntegerTy(8)) {
+    return gep->getOperand(1);
+  }
+  return nullptr;
+}
+
+// Branch to the shared trap block if `cond` is true, and continue in a new
+// block otherwise.
+void BlockContext::createTrapIf(llvm::Value *cond) {
+  using namespace llvm;
+  if (trapBlock == nullptr) {
+    trapBlock = BasicBlock::Create(llvmContext, "trap", &function);
+    IRBuilder<> trapBuilder(trapBlock);
+    trapBuilder.CreateCall(
+        Intrinsic::getOrInsertDeclaration(&ctx.llvmModule, Intrinsic::trap));
+    trapBuilder.CreateUnreachable();
+  }
+  BasicBlock *next = BasicBlock::Create(llvmContext, "trap_next", &function);
+  irBuilder.CreateCondBr(cond, trapBlock, next,
+                         MDBuilder(llvmContext).createUnlikelyBranchWeights());
+  irBuilder.SetInsertPoint(next);
+}
+
+// Trap if [offset, offset + num) is out of the segment, and return the
+// pointer to the segment blob at offset. A dropped segment has size 0. Return
+// nullptr for active segments, where only empty accesses are valid.
+llvm::Value *BlockContext::createSegmentAccess(SegmentInfo &seg,
+                                               llvm::Value *offset,
+                                               llvm::Value *num) {
+  using namespace llvm;
+  // calculate in i64 to avoid overflow
+  Value *end = irBuilder.CreateAdd(irBuilder.CreateZExt(offset, type.i64Type),
+                                   irBuilder.CreateZExt(num, type.i64Type));
+  Value *size = ConstantInt::get(type.i64Type, seg.size);
+  if (seg.blob != nullptr) {
+    Value *dropped =
+        irBuilder.CreateLoad(seg.dropped->getValueType(), seg.dropped);
+    size = irBuilder.CreateSelect(dropped, ConstantInt::get(type.i64Type, 0),
+                                  size);
+  }
+  createTrapIf(irBuilder.CreateICmpUGT(end, size, "seg_oob"));
+  if (seg.blob == nullptr) {
+    return nullptr;
+  }
+  Value *arr[2] = {ConstantInt::getNullValue(offset->getType()), offset};
+  return irBuilder.CreateGEP(seg.blob->getValueType(), seg.blob,
+                             ArrayRef<Value *>(arr, 2));
+}
+
+// Load the element array of the table, see `Context::getTableType`.
+llvm::Value *BlockContext::createTableElems(llvm::Value *table) {
+  using namespace llvm;
+  Value *elemsPtr = irBuilder.CreateStructGEP(ctx.getTableType(), table, 0);
+  return irBuilder.CreateLoad(type.i8PtrType, elemsPtr, "table_elems");
+}
+
+llvm::Value *BlockContext::createTableSize(llvm::Value *table) {
+  using namespace llvm;
+  Value *sizePtr = irBuilder.CreateStructGEP(ctx.getTableType(), table, 1);
+  return irBuilder.CreateLoad(type.i32Type, sizePtr, "table_size");
+}
+
+// Trap if [offset, offset + num) is out of the table, and return the pointer to
+// the table element at offset.
+llvm::Value *BlockContext::createTableAccess(llvm::Value *table,
+                                             llvm::Value *offset,
+                                             llvm::Value *num) {
+  using namespace llvm;
+  Value *end = irBuilder.CreateAdd(irBuilder.CreateZExt(offset, type.i64Type),
+                                   irBuilder.CreateZExt(num, type.i64Type));
+  Value *size = irBuilder.CreateZExt(createTableSize(table), type.i64Type);
+  createTrapIf(irBuilder.CreateICmpUGT(end, size, "table_oob"));
+  return irBuilder.CreateGEP(type.i8PtrType, createTableElems(table),
+                             irBuilder.CreateZExt(offset, type.i64Type));
+}
+
+// Byte size of `num` function pointers, independent of the data layout.
+llvm::Value *BlockContext::createPtrArraySize(llvm::Value *num) {
+  using namespace llvm;
+  Value *end = irBuilder.CreateGEP(
+      type.i8PtrType, ConstantPointerNull::get(type.i8PtrType), num);
+  return irBuilder.CreatePtrToInt(end, type.i64Type);
+}
+
+// memory.init: copy from the passive data segment blob into the memory.
+void BlockContext::visitMemoryInit(wabt::MemoryInitExpr *expr) {
+  using namespace llvm;
+  Value *num = popStack();
+  Value *src = popStack();
+  Value *dest = convertStackAddr(0);
+  SegmentInfo &seg =
+      ctx.dataSegs.at(ctx.module->GetDataSegmentIndex(expr->var));
+  Value *srcPtr = createSegmentAccess(seg, src, num);
+  if (srcPtr == nullptr) {
+    return;
+  }
+  irBuilder.CreateMemCpy(dest, Align(1), srcPtr, Align(1), num);
+}
+
+void BlockContext::visitDataDrop(wabt::DataDropExpr *expr) {
+  using namespace llvm;
+  SegmentInfo &seg =
+      ctx.dataSegs.at(ctx.module->GetDataSegmentIndex(expr->var));
+  if (seg.dropped != nullptr) {
+    irBuilder.CreateStore(ConstantInt::getTrue(llvmContext), seg.dropped);
+  }
+}
+
+// table.init: copy function pointers from the passive elem segment blob.
+void BlockContext::visitTableInit(wabt::TableInitExpr *expr) {
+  using namespace llvm;
+  Value *num = popStack();
+  Value *src = popStack();
+  Value *dest = popStack();
+  Value *table = getTablePtr(expr->table_index);
+  SegmentInfo &seg =
+      ctx.elemSegs.at(ctx.module->GetElemSegmentIndex(expr->segment_index));
+  Value *destPtr = createTableAccess(table, dest, num);
+  Value *srcPtr = createSegmentAccess(seg, src, num);
+  if (srcPtr == nullptr) {
+    return;
+  }
+  irBuilder.CreateMemCpy(destPtr, Align(1), srcPtr, Align(1),
+                         createPtrArraySize(num));
+}
+
+void BlockContext::visitTableCopy(wabt::TableCopyExpr *expr) {
+  using namespace llvm;
+  Value *num = popStack();
+  Value *src = popStack();
+  Value *dest = popStack();
+  Value *destTable = getTablePtr(expr->dst_table);
+  Value *srcTable = getTablePtr(expr->src_table);
+  Value *destPtr = createTableAccess(destTable, dest, num);
+  Value *srcPtr = createTableAccess(srcTable, src, num);
+  // the ranges can overlap when copying inside the same table.
+  irBuilder.CreateMemMove(destPtr, Align(1), srcPtr, Align(1),
+                          createPtrArraySize(num));
+}
+
+void BlockContext::visitElemDrop(wabt::ElemDropExpr *expr) {
+  using namespace llvm;
+  SegmentInfo &seg =
+      ctx.elemSegs.at(ctx.module->GetElemSegmentIndex(expr->var));
+  if (seg.dropped != nullptr) {
+    irBuilder.CreateStore(ConstantInt::getTrue(llvmContext), seg.dropped);
+  }
+}
+
+void BlockContext::visitTableGet(wabt::TableGetExpr *expr) {
+  using namespace llvm;
+  Value *table = getTablePtr(expr->var);
+  Value *index = popStack();
+  Value *ptr =
+      createTableAccess(table, index, ConstantInt::get(type.i32Type, 1));
+  stack.push_back(irBuilder.CreateLoad(type.i8PtrType, ptr));
+}
+
+void BlockContext::visitTableSet(wabt::TableSetExpr *expr) {
+  using namespace llvm;
+  Value *table = getTablePtr(expr->var);
+  Value *val = popStack();
+  Value *index = popStack();
+  Value *ptr =
+      createTableAccess(table, index, ConstantInt::get(type.i32Type, 1));
+  irBuilder.CreateStore(val, ptr);
+}
+
+void BlockContext::visitTableSize(wabt::TableSizeExpr *expr) {
+  using namespace llvm;
+  Value *table = getTablePtr(expr->var);
+  stack.push_back(createTableSize(table));
+}
+
+// table.grow: the runtime reallocates the elements with amortized growth, and
+// returns the old size, or -1 on failure.
+void BlockContext::visitTableGrow(wabt::TableGrowExpr *expr) {
+  using namespace llvm;
+  Value *table = getTablePtr(expr->var);
+  Value *delta = popStack();
+  Value *init = popStack();
+  FunctionCallee growFunc = ctx.llvmModule.getOrInsertFunction(
+      "__notdec_wasm_table_grow", type.i32Type, type.i8PtrType,
+      type.i8PtrType, type.i32Type);
+  stack.push_back(
+      irBuilder.CreateCall(growFunc, {table, init, delta}, "table_grow"));
+}
+
+void BlockContext::visitTableFill(wabt::TableFillExpr *expr) {
+  using namespace llvm;
+  Value *table = getTablePtr(expr->var);
+  Value *num = popStack();
+  Value *val = popStack();
+  Value *dest = popStack();
+  Value *ptr = createTableAccess(table, dest, num);
+  FunctionCallee fillFunc = ctx.llvmModule.getOrInsertFunction(
+      "__notdec_wasm_table_fill", Type::getVoidTy(llvmContext), type.i8PtrType,
+      type.i8PtrType, type.i32Type);
+  irBuilder.CreateCall(fillFunc, {ptr, val, num});
+}
+
+void BlockContext::visitRefIsNull(wabt::RefIsNullExpr *expr) {
+  using namespace llvm;
+  Value *ref = popStack();
+  Value *isNull = irBuilder.CreateICmpEQ(
+      ref, ConstantPointerNull::get(type.i8PtrType), "ref_is_null");
+  stack.push_back(irBuilder.CreateZExt(isNull, type.i32Type));
+}
+
 // 1. addr = mem + stack op
 // 2. addr += offset
 // 3. bit cast to expected ptr type
 // 4. load
 void BlockContext::visitLoadInst(wabt::LoadExpr *expr) {
+  createLoad(expr->opcode, expr->align, expr->offset);
+}
+
+// shared by plain loads and the SIMD load_splat / load_zero forms.
+void BlockContext::createLoad(wabt::Opcode opcode, wabt::Address align,
+                              wabt::Address offset) {
   using namespace llvm;
-  Value *addr = convertStackAddr(expr->offset);
+  Value *addr = convertStackAddr(offset);
 
   Type *targetType = nullptr;
-  switch (expr->opcode) {
+  switch (opcode) {
   case wabt::Opcode::I32Load:
   case wabt::Opcode::I64Load:
   case wabt::Opcode::F32Load:
   case wabt::Opcode::F64Load:
-    targetType = convertType(llvmContext, expr->opcode.GetResultType());
+    targetType = convertType(llvmContext, opcode.GetResultType());
     break;
   case wabt::Opcode::I32Load8S:
   case wabt::Opcode::I32Load8U:
@@ -287,7 +632,7 @@ void BlockContext::visitLoadInst(wabt::LoadExpr *expr) {
     targetType = Type::getInt64Ty(llvmContext);
     break;
   case wabt::Opcode::V128Load:
-    targetType = type.i64x2Type;
+    targetType = type.v128Type;
     break;
   case wabt::Opcode::V128Load8X8S:
   case wabt::Opcode::V128Load8X8U:
@@ -304,23 +649,28 @@ void BlockContext::visitLoadInst(wabt::LoadExpr *expr) {
 
   default:
     std::cerr << __FILE__ << ":" << __LINE__ << ": "
-              << "Error: Unsupported Opcode: " << expr->opcode.GetName()
+              << "Error: Unsupported Opcode: " << opcode.GetName()
               << std::endl;
     break;
   }
   assert(targetType != nullptr);
 
   addr = irBuilder.CreateBitCast(addr, PointerType::get(llvmContext, 0));
-  Value *result = irBuilder.CreateLoad(targetType, addr);
+  LoadInst *load = irBuilder.CreateAlignedLoad(targetType, addr,
+                                               getAccessAlign(opcode, align));
+  if (ctx.opts.GenTBAA) {
+    load->setMetadata(LLVMContext::MD_tbaa, ctx.getTBAATag(targetType));
+  }
+  Value *result = load;
   // possible extension
-  switch (expr->opcode) {
+  switch (opcode) {
   case wabt::Opcode::I32Load8S:
   case wabt::Opcode::I64Load8S:
   case wabt::Opcode::I32Load16S:
   case wabt::Opcode::I64Load16S:
   case wabt::Opcode::I64Load32S:
     result = irBuilder.CreateSExt(
-        result, convertType(llvmContext, expr->opcode.GetResultType()));
+        result, convertType(llvmContext, opcode.GetResultType()));
     break;
   case wabt::Opcode::I32Load16U:
   case wabt::Opcode::I64Load16U:
@@ -328,7 +678,7 @@ void BlockContext::visitLoadInst(wabt::LoadExpr *expr) {
   case wabt::Opcode::I64Load8U:
   case wabt::Opcode::I64Load32U:
     result = irBuilder.CreateZExt(
-        result, convertType(llvmContext, expr->opcode.GetResultType()));
+        result, convertType(llvmContext, opcode.GetResultType()));
     break;
   case wabt::Opcode::V128Load8Splat:
     result = irBuilder.CreateVectorSplat(16, result);
@@ -377,7 +727,7 @@ void BlockContext::visitLoadInst(wabt::LoadExpr *expr) {
     break;
   default:
     std::cerr << __FILE__ << ":" << __LINE__ << ": "
-              << "Error: Unsupported Opcode: " << expr->opcode.GetName()
+              << "Error: Unsupported Opcode: " << opcode.GetName()
               << std::endl;
     break;
   }
@@ -385,6 +735,47 @@ void BlockContext::visitLoadInst(wabt::LoadExpr *expr) {
     stack.push_back(result);
 }
 
+// trunc_sat: NaN becomes 0 and out-of-range values saturate, which is exactly
+// the semantics of llvm.fpto[su]i.sat. Works for vectors too.
+llvm::Value *BlockContext::createTruncSat(llvm::Value *val, llvm::Type *intType,
+                                          bool isSigned) {
+  using namespace llvm;
+  Function *f = Intrinsic::getOrInsertDeclaration(
+      &ctx.llvmModule,
+      isSigned ? Intrinsic::fptosi_sat : Intrinsic::fptoui_sat,
+      {intType, val->getType()});
+  return irBuilder.CreateCall(f, {val});
+}
+
+// trunc: trap on NaN or when the truncated value does not fit, so that the
+// following fpto[su]i never produces poison. The bounds are exact in the
+// source type, so the check is two compares without any libcall.
+llvm::Value *BlockContext::createTruncTrapping(llvm::Value *val,
+                                               llvm::Type *intType,
+                                               bool isSigned) {
+  using namespace llvm;
+  unsigned bits = intType->getIntegerBitWidth();
+  Type *fpType = val->getType();
+  // the first value that is too large: 2^(N-1) or 2^N
+  double upper = std::ldexp(1.0, isSigned ? bits - 1 : bits);
+  Value *tooSmall;
+  if (!isSigned) {
+    // (-1, 2^N), values in (-1, 0) truncate to 0
+    tooSmall = irBuilder.CreateFCmpULE(val, ConstantFP::get(fpType, -1.0));
+  } else if (bits == 32 && fpType->isDoubleTy()) {
+    // (-2^31 - 1, 2^31), f64 can represent the bound exactly
+    tooSmall = irBuilder.CreateFCmpULE(val, ConstantFP::get(fpType, -upper - 1));
+  } else {
+    // [-2^(N-1), 2^(N-1)), the nearest value below is already out of range
+    tooSmall = irBuilder.CreateFCmpULT(val, ConstantFP::get(fpType, -upper));
+  }
+  // unordered compares also catch NaN
+  Value *tooLarge = irBuilder.CreateFCmpUGE(val, ConstantFP::get(fpType, upper));
+  createTrapIf(irBuilder.CreateOr(tooSmall, tooLarge, "trunc_invalid"));
+  return isSigned ? irBuilder.CreateFPToSI(val, intType)
+                  : irBuilder.CreateFPToUI(val, intType);
+}
+
 void BlockContext::visitConvertExpr(wabt::ConvertExpr *expr) {
   using namespace llvm;
   Value *ret = nullptr, *p1;
@@ -406,19 +797,36 @@ void BlockContext::visitConvertExpr(wabt::ConvertExpr *expr) {
     break;
   case wabt::Opcode::I32TruncF32S:
   case wabt::Opcode::I32TruncF64S:
-    ret = irBuilder.CreateFPToSI(p1, Type::getInt32Ty(llvmContext));
+    ret = createTruncTrapping(p1, Type::getInt32Ty(llvmContext), true);
     break;
   case wabt::Opcode::I32TruncF32U:
   case wabt::Opcode::I32TruncF64U:
-    ret = irBuilder.CreateFPToUI(p1, Type::getInt32Ty(llvmContext));
+    ret = createTruncTrapping(p1, Type::getInt32Ty(llvmContext), false);
     break;
   case wabt::Opcode::I64TruncF32S:
   case wabt::Opcode::I64TruncF64S:
-    ret = irBuilder.CreateFPToSI(p1, Type::getInt64Ty(llvmContext));
+    ret = createTruncTrapping(p1, Type::getInt64Ty(llvmContext), true);
     break;
   case wabt::Opcode::I64TruncF32U:
   case wabt::Opcode::I64TruncF64U:
-    ret = irBuilder.CreateFPToUI(p1, Type::getInt64Ty(llvmContext));
+    ret = createTruncTrapping(p1, Type::getInt64Ty(llvmContext), false);
+    break;
+  // non-trapping float-to-int conversions
+  case wabt::Opcode::I32TruncSatF32S:
+  case wabt::Opcode::I32TruncSatF64S:
+    ret = createTruncSat(p1, Type::getInt32Ty(llvmContext), true);
+    break;
+  case wabt::Opcode::I32TruncSatF32U:
+  case wabt::Opcode::I32TruncSatF64U:
+    ret = createTruncSat(p1, Type::getInt32Ty(llvmContext), false);
+    break;
+  case wabt::Opcode::I64TruncSatF32S:
+  case wabt::Opcode::I64TruncSatF64S:
+    ret = createTruncSat(p1, Type::getInt64Ty(llvmContext), true);
+    break;
+  case wabt::Opcode::I64TruncSatF32U:
+  case wabt::Opcode::I64TruncSatF64U:
+    ret = createTruncSat(p1, Type::getInt64Ty(llvmContext), false);
     break;
 
   case wabt::Opcode::F32ConvertI32S:
@@ -742,15 +1150,12 @@ void BlockContext::visitUnaryInst(wabt::UnaryExpr *expr) {
     ret = irBuilder.CreateNot(p1);
     break;
   case wabt::Opcode::V128AnyTrue: {
-    ConstantInt *zero =
-        ConstantInt::get(Type::getInt64Ty(irBuilder.getContext()), 0);
-    Value *boolResult = irBuilder.CreateOr(
-        irBuilder.CreateICmpNE(irBuilder.CreateExtractElement(p1, uint64_t(0)),
-                               zero),
-        irBuilder.CreateICmpNE(irBuilder.CreateExtractElement(p1, uint64_t(1)),
-                               zero));
-    ret = irBuilder.CreateZExt(boolResult,
-                               Type::getInt32Ty(irBuilder.getContext()));
+    // a single ptest on x86
+    Type *i128Type = Type::getInt128Ty(llvmContext);
+    Value *boolResult = irBuilder.CreateICmpNE(
+        irBuilder.CreateBitCast(p1, i128Type),
+        ConstantInt::getNullValue(i128Type));
+    ret = irBuilder.CreateZExt(boolResult, type.i32Type);
     break;
   }
   // SIMD Splat
@@ -778,11 +1183,8 @@ void BlockContext::visitUnaryInst(wabt::UnaryExpr *expr) {
     Value *vec = irBuilder.CreateBitCast(p1, type.f64x2Type);
     vec = irBuilder.CreateFPTrunc(vec, type.f32x2Type);
     // two higher lanes of the result are initialized to zero
-    ret = Constant::getNullValue(type.f32x4Type);
-    ret = irBuilder.CreateInsertElement(
-        ret, irBuilder.CreateExtractElement(vec, uint64_t(0)), uint64_t(0));
-    ret = irBuilder.CreateInsertElement(
-        ret, irBuilder.CreateExtractElement(vec, uint64_t(1)), uint64_t(1));
+    ret = irBuilder.CreateShuffleVector(
+        vec, Constant::getNullValue(type.f32x2Type), (ArrayRef<int>){0, 1, 2, 3});
   } break;
   case wabt::Opcode::F64X2PromoteLowF32X4: {
     Value *vec = irBuilder.CreateBitCast(p1, type.f32x4Type);
@@ -812,7 +1214,7 @@ void BlockContext::visitUnaryInst(wabt::UnaryExpr *expr) {
     vec1 = irBuilder.CreateZExt(vec1, type.i16x8Type);
     vec2 = irBuilder.CreateZExt(vec2, type.i16x8Type);
     ret = irBuilder.CreateAdd(vec1, vec2);
-  }
+  } break;
   case wabt::Opcode::I32X4ExtaddPairwiseI16X8S: {
     Value *vec = irBuilder.CreateBitCast(p1, type.i16x8Type);
     Value *undef = UndefValue::get(type.i16x8Type);
@@ -874,56 +1276,56 @@ void BlockContext::visitUnaryInst(wabt::UnaryExpr *expr) {
     break;
   // SIMD Convert
   case wabt::Opcode::F32X4ConvertI32X4S:
-    EMIT_SIMD_UNARY_OP(type.f32x4Type,
+    EMIT_SIMD_UNARY_OP(type.i32x4Type,
                        irBuilder.CreateSIToFP(v, type.f32x4Type));
+    break;
   case wabt::Opcode::F32X4ConvertI32X4U:
-    EMIT_SIMD_UNARY_OP(type.f32x4Type,
+    EMIT_SIMD_UNARY_OP(type.i32x4Type,
                        irBuilder.CreateUIToFP(v, type.f32x4Type));
+    break;
   case wabt::Opcode::F64X2ConvertLowI32X4S: {
     Value *vec = irBuilder.CreateBitCast(p1, type.i32x4Type);
-    ret = Constant::getNullValue(type.i32x2Type);
-    for (uint32_t i = 0; i < 2; i++) {
-      ret = irBuilder.CreateInsertElement(
-          ret, irBuilder.CreateExtractElement(vec, i), i);
-    }
-    ret = irBuilder.CreateSIToFP(ret, type.f64x2Type);
+    vec = irBuilder.CreateShuffleVector(vec, (ArrayRef<int>){0, 1});
+    ret = irBuilder.CreateSIToFP(vec, type.f64x2Type);
   } break;
   case wabt::Opcode::F64X2ConvertLowI32X4U: {
     Value *vec = irBuilder.CreateBitCast(p1, type.i32x4Type);
-    ret = Constant::getNullValue(type.i32x2Type);
-    for (uint32_t i = 0; i < 2; i++) {
-      ret = irBuilder.CreateInsertElement(
-          ret, irBuilder.CreateExtractElement(vec, i), i);
-    }
-    ret = irBuilder.CreateUIToFP(ret, type.f64x2Type);
+    vec = irBuilder.CreateShuffleVector(vec, (ArrayRef<int>){0, 1});
+    ret = irBuilder.CreateUIToFP(vec, type.f64x2Type);
   } break;
   // SIMD Trunc
-  // TODO IR指令语义与Wasm指令不一致：上下界问题
   case wabt::Opcode::I32X4TruncSatF32X4S:
     ret = irBuilder.CreateBitCast(p1, type.f32x4Type);
-    ret = irBuilder.CreateFPToSI(ret, type.i32x4Type);
+    ret = createTruncSat(ret, type.i32x4Type, true);
     break;
   case wabt::Opcode::I32X4TruncSatF32X4U:
     ret = irBuilder.CreateBitCast(p1, type.f32x4Type);
-    ret = irBuilder.CreateFPToUI(ret, type.i32x4Type);
+    ret = createTruncSat(ret, type.i32x4Type, false);
     break;
-  case wabt::Opcode::I32X4TruncSatF64X2SZero: {
-    Value *vec = irBuilder.CreateBitCast(p1, type.f64x2Type);
-    vec = irBuilder.CreateFPToSI(ret, type.i32x2Type);
-    ret = Constant::getNullValue(type.i32x4Type);
-    for (uint32_t i = 0; i < 2; i++) {
-      ret = irBuilder.CreateInsertElement(
-          ret, irBuilder.CreateExtractElement(vec, i), i);
-    }
-  } break;
+  case wabt::Opcode::I32X4TruncSatF64X2SZero:
   case wabt::Opcode::I32X4TruncSatF64X2UZero: {
     Value *vec = irBuilder.CreateBitCast(p1, type.f64x2Type);
-    vec = irBuilder.CreateFPToUI(ret, type.i32x2Type);
-    ret = Constant::getNullValue(type.i32x4Type);
-    for (uint32_t i = 0; i < 2; i++) {
-      ret = irBuilder.CreateInsertElement(
-          ret, irBuilder.CreateExtractElement(vec, i), i);
-    }
+    vec = createTruncSat(vec, type.i32x2Type,
+                         expr->opcode == wabt::Opcode::I32X4TruncSatF64X2SZero);
+    // two higher lanes of the result are zero
+    ret = irBuilder.CreateShuffleVector(
+        vec, Constant::getNullValue(type.i32x2Type), (ArrayRef<int>){0, 1, 2, 3});
+  } break;
+  // relaxed: out of range lanes are unspecified, so a frozen fpto[su]i maps
+  // to a single cvttps2dq on x86.
+  case wabt::Opcode::I32X4RelaxedTruncF32X4S:
+  case wabt::Opcode::I32X4RelaxedTruncF32X4U: {
+    bool isSigned = expr->opcode == wabt::Opcode::I32X4RelaxedTruncF32X4S;
+    ret = createRelaxedTrunc(irBuilder.CreateBitCast(p1, type.f32x4Type),
+                             type.i32x4Type, isSigned);
+  } break;
+  case wabt::Opcode::I32X4RelaxedTruncF64X2SZero:
+  case wabt::Opcode::I32X4RelaxedTruncF64X2UZero: {
+    bool isSigned = expr->opcode == wabt::Opcode::I32X4RelaxedTruncF64X2SZero;
+    Value *vec = createRelaxedTrunc(irBuilder.CreateBitCast(p1, type.f64x2Type),
+                                    type.i32x2Type, isSigned);
+    ret = irBuilder.CreateShuffleVector(
+        vec, Constant::getNullValue(type.i32x2Type), (ArrayRef<int>){0, 1, 2, 3});
   } break;
   case wabt::Opcode::I32Extend8S: {
     ret = irBuilder.CreateTrunc(p1, Type::getInt8Ty(llvmContext));
@@ -962,21 +1364,73 @@ llvm::Value *BlockContext::createSIMDExtend(llvm::Value *vector,
                                             unsigned int startIdx, bool sign) {
   using namespace llvm;
   vector = irBuilder.CreateBitCast(vector, vectorType);
-  FixedVectorType *halfVectorType =
-      FixedVectorType::getHalfElementsVectorType(vectorType);
-  Value *halfVector = UndefValue::get(halfVectorType);
-  int elementCount = halfVectorType->getNumElements();
-  int mask[elementCount];
-  for (int i = startIdx; i < elementCount; i++)
-    mask[i] = i;
-  halfVector = irBuilder.CreateShuffleVector(
-      vector, halfVector, ArrayRef<int>(mask, elementCount));
+  unsigned int elementCount = vectorType->getNumElements() / 2;
+  SmallVector<int, 16> mask;
+  for (unsigned int i = 0; i < elementCount; i++)
+    mask.push_back(startIdx + i);
+  Value *halfVector = irBuilder.CreateShuffleVector(vector, mask);
   if (sign)
     return irBuilder.CreateSExt(halfVector, destType);
   else
     return irBuilder.CreateZExt(halfVector, destType);
 }
 
+// Concatenate the lanes of both operands, clamp them to the range of the
+// destination lanes (signed or unsigned) and truncate. Backends select the
+// clamp and trunc pattern as packss/packus.
+llvm::Value *BlockContext::createSIMDNarrow(llvm::Value *left,
+                                            llvm::Value *right,
+                                            llvm::FixedVectorType *vectorType,
+                                            llvm::FixedVectorType *destType,
+                                            bool sign) {
+  using namespace llvm;
+  left = irBuilder.CreateBitCast(left, vectorType);
+  right = irBuilder.CreateBitCast(right, vectorType);
+  SmallVector<int, 16> mask;
+  for (unsigned int i = 0; i < destType->getNumElements(); i++)
+    mask.push_back(i);
+  Value *vec = irBuilder.CreateShuffleVector(left, right, mask);
+  Type *wideType = vec->getType();
+  unsigned int srcBits = vectorType->getScalarSizeInBits();
+  unsigned int destBits = destType->getScalarSizeInBits();
+  APInt min = sign ? APInt::getSignedMinValue(destBits).sext(srcBits)
+                   : APInt(srcBits, 0);
+  APInt max = sign ? APInt::getSignedMaxValue(destBits).sext(srcBits)
+                   : APInt::getMaxValue(destBits).zext(srcBits);
+  Function *smax = Intrinsic::getOrInsertDeclaration(
+      &ctx.llvmModule, Intrinsic::smax, {wideType});
+  Function *smin = Intrinsic::getOrInsertDeclaration(
+      &ctx.llvmModule, Intrinsic::smin, {wideType});
+  vec = irBuilder.CreateCall(smax, {vec, ConstantInt::get(wideType, min)});
+  vec = irBuilder.CreateCall(smin, {vec, ConstantInt::get(wideType, max)});
+  return irBuilder.CreateTrunc(vec, destType);
+}
+
+// result = saturateS16((left * right + 0x4000) >> 15). It is computed as
+// ((left * right >> 14) + 1) >> 1, which is the same value and the pattern
+// of pmulhrsw on x86.
+llvm::Value *BlockContext::createQ15Mulr(llvm::Value *left, llvm::Value *right,
+                                         bool saturate) {
+  using namespace llvm;
+  left = irBuilder.CreateBitCast(left, type.i16x8Type);
+  right = irBuilder.CreateBitCast(right, type.i16x8Type);
+  // Extend the inputs to 32-bit, the product can not overflow.
+  left = irBuilder.CreateSExt(left, type.i32x8Type);
+  right = irBuilder.CreateSExt(right, type.i32x8Type);
+  Value *product = irBuilder.CreateMul(left, right);
+  Value *shift = irBuilder.CreateAShr(product, 14);
+  shift = irBuilder.CreateAdd(shift, ConstantInt::get(type.i32x8Type, 1));
+  shift = irBuilder.CreateAShr(shift, 1);
+  if (saturate) {
+    // only INT16_MIN * INT16_MIN overflows, and only upwards.
+    Function *f = Intrinsic::getOrInsertDeclaration(
+        &ctx.llvmModule, Intrinsic::smin, {type.i32x8Type});
+    shift = irBuilder.CreateCall(
+        f, {shift, ConstantInt::get(type.i32x8Type, INT16_MAX)});
+  }
+  return irBuilder.CreateTrunc(shift, type.i16x8Type);
+}
+
 void BlockContext::visitBinaryInst(wabt::BinaryExpr *expr) {
   using namespace llvm;
   Value *ret = nullptr, *p1, *p2;
@@ -1074,13 +1528,13 @@ void BlockContext::visitBinaryInst(wabt::BinaryExpr *expr) {
   // floor type only
   case wabt::Opcode::F32Min:
   case wabt::Opcode::F64Min:
-    f = Intrinsic::getOrInsertDeclaration(&ctx.llvmModule, Intrinsic::minnum,
+    f = Intrinsic::getOrInsertDeclaration(&ctx.llvmModule, Intrinsic::minimum,
                                   {p1->getType()});
     ret = irBuilder.CreateCall(f, {p2, p1});
     break;
   case wabt::Opcode::F32Max:
   case wabt::Opcode::F64Max:
-    f = Intrinsic::getOrInsertDeclaration(&ctx.llvmModule, Intrinsic::maxnum,
+    f = Intrinsic::getOrInsertDeclaration(&ctx.llvmModule, Intrinsic::maximum,
                                   {p1->getType()});
     ret = irBuilder.CreateCall(f, {p2, p1});
     break;
@@ -1093,27 +1547,28 @@ void BlockContext::visitBinaryInst(wabt::BinaryExpr *expr) {
 
   /* SIMD */
   case wabt::Opcode::V128Andnot:
-    ret = irBuilder.CreateAnd(p2, irBuilder.CreateNot(p1));
+    ret = irBuilder.CreateAnd(toV128(p2), irBuilder.CreateNot(toV128(p1)));
     break;
   case wabt::Opcode::V128And:
-    ret = irBuilder.CreateAnd(p2, p1);
+    ret = irBuilder.CreateAnd(toV128(p2), toV128(p1));
     break;
   case wabt::Opcode::V128Or:
-    ret = irBuilder.CreateOr(p2, p1);
+    ret = irBuilder.CreateOr(toV128(p2), toV128(p1));
     break;
   case wabt::Opcode::V128Xor:
-    ret = irBuilder.CreateXor(p2, p1);
+    ret = irBuilder.CreateXor(toV128(p2), toV128(p1));
+    break;
+  case wabt::Opcode::I8X16Swizzle:
+    ret = createSwizzle(p2, p1, true);
+    break;
+  case wabt::Opcode::I8X16RelaxedSwizzle:
+    ret = createSwizzle(p2, p1, ctx.opts.DeterministicSIMD);
     break;
-    // case wabt::Opcode::I8X16Swizzle:
-    //     //TODO
-    //     f = Intrinsic::getOrInsertDeclaration(&ctx.llvmModule,
-    //     Intrinsic::aarch64_neon_tbl1, {p1->getType()}); ret =
-    //     irBuilder.CreateCall(f, {p2, p1}); break;
 
 #define EMIT_SIMD_BINARY_OP(llvmType, emitCode)                                \
   {                                                                            \
-    Value *right = irBuilder.CreateBitCast(p2, llvmType);                      \
-    Value *left = irBuilder.CreateBitCast(p1, llvmType);                       \
+    Value *left = irBuilder.CreateBitCast(p2, llvmType);                       \
+    Value *right = irBuilder.CreateBitCast(p1, llvmType);                      \
     ret = emitCode;                                                            \
   }
 
@@ -1122,33 +1577,27 @@ void BlockContext::visitBinaryInst(wabt::BinaryExpr *expr) {
     break;
   case wabt::Opcode::I8X16AddSatS:
     f = Intrinsic::getOrInsertDeclaration(&ctx.llvmModule, Intrinsic::sadd_sat,
-                                  {p1->getType()});
+                                          {type.i8x16Type});
+    EMIT_SIMD_BINARY_OP(type.i8x16Type, irBuilder.CreateCall(f, {left, right}));
+    break;
+  case wabt::Opcode::I8X16AddSatU:
+    f = Intrinsic::getOrInsertDeclaration(&ctx.llvmModule, Intrinsic::uadd_sat,
+                                          {type.i8x16Type});
     EMIT_SIMD_BINARY_OP(type.i8x16Type, irBuilder.CreateCall(f, {left, right}));
     break;
-  case wabt::Opcode::I8X16AddSatU: {
-    Value *right = irBuilder.CreateBitCast(p1, type.i8x16Type);
-    Value *left = irBuilder.CreateBitCast(p2, type.i8x16Type);
-    Value *add = irBuilder.CreateAdd(left, right);
-    ret =
-        irBuilder.CreateSelect(irBuilder.CreateICmpUGT(left, add),
-                               Constant::getAllOnesValue(left->getType()), add);
-  } break;
   case wabt::Opcode::I16X8Add:
     EMIT_SIMD_BINARY_OP(type.i16x8Type, irBuilder.CreateAdd(left, right));
     break;
   case wabt::Opcode::I16X8AddSatS:
     f = Intrinsic::getOrInsertDeclaration(&ctx.llvmModule, Intrinsic::sadd_sat,
-                                  {p1->getType()});
+                                          {type.i16x8Type});
+    EMIT_SIMD_BINARY_OP(type.i16x8Type, irBuilder.CreateCall(f, {left, right}));
+    break;
+  case wabt::Opcode::I16X8AddSatU:
+    f = Intrinsic::getOrInsertDeclaration(&ctx.llvmModule, Intrinsic::uadd_sat,
+                                          {type.i16x8Type});
     EMIT_SIMD_BINARY_OP(type.i16x8Type, irBuilder.CreateCall(f, {left, right}));
     break;
-  case wabt::Opcode::I16X8AddSatU: {
-    Value *right = irBuilder.CreateBitCast(p1, type.i16x8Type);
-    Value *left = irBuilder.CreateBitCast(p2, type.i16x8Type);
-    Value *add = irBuilder.CreateAdd(left, right);
-    ret =
-        irBuilder.CreateSelect(irBuilder.CreateICmpUGT(left, add),
-                               Constant::getAllOnesValue(left->getType()), add);
-  } break;
   case wabt::Opcode::I32X4Add:
     EMIT_SIMD_BINARY_OP(type.i32x4Type, irBuilder.CreateAdd(left, right));
     break;
@@ -1167,29 +1616,27 @@ void BlockContext::visitBinaryInst(wabt::BinaryExpr *expr) {
     break;
   case wabt::Opcode::I8X16SubSatS:
     f = Intrinsic::getOrInsertDeclaration(&ctx.llvmModule, Intrinsic::ssub_sat,
-                                  {p1->getType()});
+                                          {type.i8x16Type});
+    EMIT_SIMD_BINARY_OP(type.i8x16Type, irBuilder.CreateCall(f, {left, right}));
+    break;
+  case wabt::Opcode::I8X16SubSatU:
+    f = Intrinsic::getOrInsertDeclaration(&ctx.llvmModule, Intrinsic::usub_sat,
+                                          {type.i8x16Type});
     EMIT_SIMD_BINARY_OP(type.i8x16Type, irBuilder.CreateCall(f, {left, right}));
     break;
-  case wabt::Opcode::I8X16SubSatU: {
-    Value *right = irBuilder.CreateBitCast(p1, type.i8x16Type);
-    Value *left = irBuilder.CreateBitCast(p2, type.i8x16Type);
-    Value *flag = irBuilder.CreateICmp(CmpInst::ICMP_UGT, left, right);
-    ret = irBuilder.CreateSub(irBuilder.CreateSelect(flag, left, right), right);
-  } break;
   case wabt::Opcode::I16X8Sub:
     EMIT_SIMD_BINARY_OP(type.i16x8Type, irBuilder.CreateSub(left, right));
     break;
   case wabt::Opcode::I16X8SubSatS:
     f = Intrinsic::getOrInsertDeclaration(&ctx.llvmModule, Intrinsic::ssub_sat,
-                                  {p1->getType()});
+                                          {type.i16x8Type});
+    EMIT_SIMD_BINARY_OP(type.i16x8Type, irBuilder.CreateCall(f, {left, right}));
+    break;
+  case wabt::Opcode::I16X8SubSatU:
+    f = Intrinsic::getOrInsertDeclaration(&ctx.llvmModule, Intrinsic::usub_sat,
+                                          {type.i16x8Type});
     EMIT_SIMD_BINARY_OP(type.i16x8Type, irBuilder.CreateCall(f, {left, right}));
     break;
-  case wabt::Opcode::I16X8SubSatU: {
-    Value *right = irBuilder.CreateBitCast(p1, type.i16x8Type);
-    Value *left = irBuilder.CreateBitCast(p2, type.i16x8Type);
-    Value *flag = irBuilder.CreateICmp(CmpInst::ICMP_UGT, left, right);
-    ret = irBuilder.CreateSub(irBuilder.CreateSelect(flag, left, right), right);
-  } break;
   case wabt::Opcode::I32X4Sub:
     EMIT_SIMD_BINARY_OP(type.i32x4Type, irBuilder.CreateSub(left, right));
     break;
@@ -1343,7 +1790,7 @@ void BlockContext::visitBinaryInst(wabt::BinaryExpr *expr) {
     EMIT_SIMD_BINARY_OP(
         type.f32x4Type,
         irBuilder.CreateCall(Intrinsic::getOrInsertDeclaration(&ctx.llvmModule,
-                                                       Intrinsic::minnum,
+                                                       Intrinsic::minimum,
                                                        type.f32x4Type),
                              {left, right}));
     break;
@@ -1351,7 +1798,7 @@ void BlockContext::visitBinaryInst(wabt::BinaryExpr *expr) {
     EMIT_SIMD_BINARY_OP(
         type.f64x2Type,
         irBuilder.CreateCall(Intrinsic::getOrInsertDeclaration(&ctx.llvmModule,
-                                                       Intrinsic::minnum,
+                                                       Intrinsic::minimum,
                                                        type.f64x2Type),
                              {left, right}));
     break;
@@ -1401,7 +1848,7 @@ void BlockContext::visitBinaryInst(wabt::BinaryExpr *expr) {
     EMIT_SIMD_BINARY_OP(
         type.f32x4Type,
         irBuilder.CreateCall(Intrinsic::getOrInsertDeclaration(&ctx.llvmModule,
-                                                       Intrinsic::maxnum,
+                                                       Intrinsic::maximum,
                                                        type.f32x4Type),
                              {left, right}));
     break;
@@ -1409,7 +1856,7 @@ void BlockContext::visitBinaryInst(wabt::BinaryExpr *expr) {
     EMIT_SIMD_BINARY_OP(
         type.f64x2Type,
         irBuilder.CreateCall(Intrinsic::getOrInsertDeclaration(&ctx.llvmModule,
-                                                       Intrinsic::maxnum,
+                                                       Intrinsic::maximum,
                                                        type.f64x2Type),
                              {left, right}));
     break;
@@ -1426,48 +1873,70 @@ void BlockContext::visitBinaryInst(wabt::BinaryExpr *expr) {
             irBuilder.CreateFCmp(CmpInst::FCMP_OLT, left, right), right, left));
     break;
 
-  case wabt::Opcode::I16X8Q15mulrSatS: {
+  case wabt::Opcode::I16X8Q15mulrSatS:
+    ret = createQ15Mulr(p2, p1, true);
+    break;
+  // relaxed: the result for NaN and signed zeros is unspecified, the select
+  // form is exactly minps/maxps.
+  case wabt::Opcode::F32X4RelaxedMin:
+  case wabt::Opcode::F64X2RelaxedMin:
+  case wabt::Opcode::F32X4RelaxedMax:
+  case wabt::Opcode::F64X2RelaxedMax: {
+    FixedVectorType *vectorType =
+        (expr->opcode == wabt::Opcode::F32X4RelaxedMin ||
+         expr->opcode == wabt::Opcode::F32X4RelaxedMax)
+            ? type.f32x4Type
+            : type.f64x2Type;
+    bool isMin = expr->opcode == wabt::Opcode::F32X4RelaxedMin ||
+                 expr->opcode == wabt::Opcode::F64X2RelaxedMin;
+    Value *left = irBuilder.CreateBitCast(p2, vectorType);
+    Value *right = irBuilder.CreateBitCast(p1, vectorType);
+    if (ctx.opts.DeterministicSIMD) {
+      f = Intrinsic::getOrInsertDeclaration(
+          &ctx.llvmModule, isMin ? Intrinsic::minimum : Intrinsic::maximum,
+          vectorType);
+      ret = irBuilder.CreateCall(f, {left, right});
+    } else if (isMin) {
+      ret = irBuilder.CreateSelect(irBuilder.CreateFCmpOLT(left, right), left,
+                                   right);
+    } else {
+      ret = irBuilder.CreateSelect(irBuilder.CreateFCmpOGT(left, right), left,
+                                   right);
+    }
+  } break;
+  // relaxed: the overflowing lane is unspecified.
+  case wabt::Opcode::I16X8RelaxedQ15mulrS:
+    ret = createQ15Mulr(p2, p1, ctx.opts.DeterministicSIMD);
+    break;
+  case wabt::Opcode::I16X8DotI8X16I7X16S:
+    ret = createRelaxedDot(p2, p1);
+    break;
+  case wabt::Opcode::I32X4DotI16X8S: {
     Value *left = irBuilder.CreateBitCast(p2, type.i16x8Type);
     Value *right = irBuilder.CreateBitCast(p1, type.i16x8Type);
-
-    // Extend the inputs to 64-bit to avoid overflow.
-    left = irBuilder.CreateSExt(left, type.i64x8Type);
-    right = irBuilder.CreateSExt(right, type.i64x8Type);
-
-    // result = saturateS16((left * right + 0x4000) >> 15)
+    left = irBuilder.CreateSExt(left, type.i32x8Type);
+    right = irBuilder.CreateSExt(right, type.i32x8Type);
+    // add adjacent pairs of the products, selected as pmaddwd on x86
     Value *product = irBuilder.CreateMul(left, right);
-    Value *sum = irBuilder.CreateAdd(
-        product, irBuilder.CreateVectorSplat(
-                     8, ConstantInt::get(llvmContext,
-                                         APInt(32, (uint64_t)0x4000, false))));
-    Value *shift = irBuilder.CreateAShr(sum, 15);
-    Value *minSplat = irBuilder.CreateVectorSplat(
-        8, ConstantInt::get(llvmContext, APInt(32, (int64_t)INT16_MIN, false)));
-    Value *maxSplat = irBuilder.CreateVectorSplat(
-        8, ConstantInt::get(llvmContext, APInt(32, (int64_t)INT16_MAX, false)));
-    Value *saturate = irBuilder.CreateSelect(
-        irBuilder.CreateICmpSGT(shift, maxSplat), maxSplat,
-        irBuilder.CreateSelect(irBuilder.CreateICmpSLT(shift, minSplat),
-                               minSplat, shift));
-    ret = irBuilder.CreateTrunc(saturate, type.i16x8Type);
+    Value *even =
+        irBuilder.CreateShuffleVector(product, (ArrayRef<int>){0, 2, 4, 6});
+    Value *odd =
+        irBuilder.CreateShuffleVector(product, (ArrayRef<int>){1, 3, 5, 7});
+    ret = irBuilder.CreateAdd(even, odd);
   } break;
   // SIMD Narrow
-  // case wabt::Opcode::I8X16NarrowI16X8S:
-  //     EMIT_SIMD_BINARY_OP(type.i16x8Type,
-  //     irBuilder.CreateCall(Intrinsic::getOrInsertDeclaration(&ctx.llvmModule,
-  //     Intrinsic::x86_sse2_packsswb_128), {left,right})); break;
-  // case wabt::Opcode::I8X16NarrowI16X8U:
-  //     EMIT_SIMD_BINARY_OP(type.i16x8Type,
-  //     irBuilder.CreateCall(Intrinsic::getOrInsertDeclaration(&ctx.llvmModule,
-  //     Intrinsic::x86_sse2_packuswb_128), {left,right})); break;
-  // case wabt::Opcode::I16X8NarrowI32X4S:
-  //     EMIT_SIMD_BINARY_OP(type.i32x4Type,
-  //     irBuilder.CreateCall(Intrinsic::getOrInsertDeclaration(&ctx.llvmModule,
-  //     Intrinsic::x86_sse2_packssdw_128), {left,right})); break;
-  // case wabt::Opcode::I16X8NarrowI32X4U:
-  //     EMIT_SIMD_BINARY_OP(type.i32x4Type,
-  //     irBuilder.CreateCall(Intrinsic::getOrInsertDeclaration(&ctx.llvmModule,
-  //     Intrinsic::x86_sse41_packusdw), {left,right})); break;
+  case wabt::Opcode::I8X16NarrowI16X8S:
+    ret = createSIMDNarrow(p2, p1, type.i16x8Type, type.i8x16Type, true);
+    break;
+  case wabt::Opcode::I8X16NarrowI16X8U:
+    ret = createSIMDNarrow(p2, p1, type.i16x8Type, type.i8x16Type, false);
+    break;
+  case wabt::Opcode::I16X8NarrowI32X4S:
+    ret = createSIMDNarrow(p2, p1, type.i32x4Type, type.i16x8Type, true);
+    break;
+  case wabt::Opcode::I16X8NarrowI32X4U:
+    ret = createSIMDNarrow(p2, p1, type.i32x4Type, type.i16x8Type, false);
+    break;
 
   // SIMD Extmul
   case wabt::Opcode::I16X8ExtmulLowI8X16S:
@@ -1753,16 +2222,17 @@ void BlockContext::visitCompareExpr(wabt::CompareExpr *expr) {
     resultType = type.i64x2Type;
     break;
 
+  // ne is true for NaN operands
   case wabt::Opcode::F32Ne:
   case wabt::Opcode::F64Ne:
-    ret = irBuilder.CreateFCmpOEQ(p2, p1);
+    ret = irBuilder.CreateFCmpUNE(p2, p1);
     break;
   case wabt::Opcode::F32X4Ne:
-    EMIT_SIMD_BINARY_OP(type.f32x4Type, irBuilder.CreateFCmpOEQ(left, right));
+    EMIT_SIMD_BINARY_OP(type.f32x4Type, irBuilder.CreateFCmpUNE(left, right));
     resultType = type.i32x4Type;
     break;
   case wabt::Opcode::F64X2Ne:
-    EMIT_SIMD_BINARY_OP(type.f64x2Type, irBuilder.CreateFCmpOEQ(left, right));
+    EMIT_SIMD_BINARY_OP(type.f64x2Type, irBuilder.CreateFCmpUNE(left, right));
     resultType = type.i64x2Type;
     break;
 
@@ -1825,9 +2295,11 @@ void BlockContext::visitCompareExpr(wabt::CompareExpr *expr) {
     break;
   }
   if (ret != nullptr) {
-    ret = irBuilder.CreateZExt(ret, Type::getInt32Ty(ctx.llvmContext));
+    // scalar: bool to i32, SIMD: <N x i1> to all ones / zero lanes
     if (resultType != nullptr)
       ret = irBuilder.CreateSExt(ret, resultType);
+    else
+      ret = irBuilder.CreateZExt(ret, Type::getInt32Ty(ctx.llvmContext));
     stack.push_back(ret);
   }
 }
@@ -1838,17 +2310,23 @@ void BlockContext::visitCallInst(wabt::CallExpr *expr) {
   // get wabt func
   wabt::Func *wfunc = ctx.module->GetFunc(expr->var);
   wabt::Index paramCount = wfunc->GetNumParams();
-  assert(target->getFunctionType()->getNumParams() == paramCount);
-  auto callArgsAlloca = (Value **)alloca(sizeof(Value *) * paramCount);
-  ArrayRef<Value *> callArgs = ArrayRef<Value *>(callArgsAlloca, paramCount);
+  // the instance is passed first with InstanceContext
+  wabt::Index argBase = instance != nullptr ? 1 : 0;
+  assert(target->getFunctionType()->getNumParams() == argBase + paramCount);
+  auto callArgsAlloca =
+      (Value **)alloca(sizeof(Value *) * (argBase + paramCount));
+  ArrayRef<Value *> callArgs =
+      ArrayRef<Value *>(callArgsAlloca, argBase + paramCount);
   // https://stackoverflow.com/questions/5458204/unsigned-int-reverse-iteration-with-for-loops
   for (wabt::Index i = paramCount; i-- > 0;) {
-    callArgsAlloca[i] = popStack();
+    callArgsAlloca[argBase + i] = toV128(popStack());
+  }
+  if (instance != nullptr) {
+    callArgsAlloca[0] = instance;
   }
   // TODO MultiValue
   assert(wfunc->GetNumResults() <= 1);
-  Value *ret =
-      irBuilder.CreateCall(target->getFunctionType(), target, callArgs);
+  Value *ret = createCall(target->getFunctionType(), target, callArgs);
   if (wfunc->GetNumResults() != 0) {
     stack.push_back(ret);
   }
@@ -1858,58 +2336,253 @@ llvm::Value *BlockContext::createAllTrue(llvm::Value *vector,
                                          llvm::FixedVectorType *vectorType) {
   using namespace llvm;
   vector = irBuilder.CreateBitCast(vector, vectorType);
-
-  const uintptr_t numLanes = vectorType->getNumElements();
-  Constant *zero = ConstantInt::get(
-      vectorType->getScalarType(), APInt(vectorType->getScalarSizeInBits(), 0));
-
-  Value *result = nullptr;
-  for (uintptr_t laneIndex = 0; laneIndex < numLanes; ++laneIndex) {
-    Value *scalar = irBuilder.CreateExtractElement(vector, laneIndex);
-    Value *scalarBool = irBuilder.CreateICmpNE(scalar, zero);
-
-    result = result ? irBuilder.CreateAnd(result, scalarBool) : scalarBool;
-  }
-  return irBuilder.CreateZExt(result, Type::getInt32Ty(irBuilder.getContext()));
+  // compare all lanes at once and reduce the mask.
+  Value *lanes =
+      irBuilder.CreateICmpNE(vector, Constant::getNullValue(vectorType));
+  Value *result = irBuilder.CreateAndReduce(lanes);
+  return irBuilder.CreateZExt(result, type.i32Type);
 }
 
-void BlockContext::visitCallIndirectInst(wabt::CallIndirectExpr *expr) {
+// Pop the table index and load the function pointer from the table.
+llvm::Value *BlockContext::createIndirectCallee(const wabt::Var &tableVar) {
   using namespace llvm;
-
   // 1 找到table对应的函数指针数组（全局变量）
-  GlobalVariable *table = ctx.tables.at(ctx.module->GetTableIndex(expr->table));
+  Value *table = getTablePtr(tableVar);
   // 2 获取index，保证index在范围内
   Value *index = popStack();
   // TODO 保证index在范围内
-  // 3 获取正确的函数指针类型
-  FunctionType *funcType = convertFuncType(llvmContext, expr->decl.sig);
-  wabt::Index paramCount = expr->decl.sig.param_types.size();
-  assert(funcType->getNumParams() == paramCount);
-  // 4 取下标，调用函数
-  Value *arr[2] = {ConstantInt::getNullValue(index->getType()), index};
-  Value *ptr = irBuilder.CreateGEP(table->getValueType(), table,
-                                   ArrayRef<Value *>(arr, 2));
-
-  Type *tableElemType = cast<ArrayType>(table->getValueType())->getElementType();
-  Value *funcPtr = irBuilder.CreateLoad(tableElemType, ptr, "callind_funcptr");
+  // 3 取下标
+  Value *ptr =
+      irBuilder.CreateGEP(type.i8PtrType, createTableElems(table),
+                          irBuilder.CreateZExt(index, type.i64Type));
+  Value *funcPtr = irBuilder.CreateLoad(type.i8PtrType, ptr, "callind_funcptr");
   // if (ctx.opts.GenIntToPtr)
-  funcPtr =
-      irBuilder.CreateBitOrPointerCast(funcPtr, PointerType::get(llvmContext, 0));
+  return irBuilder.CreateBitOrPointerCast(funcPtr,
+                                         PointerType::get(llvmContext, 0));
+}
+
+void BlockContext::visitCallIndirectInst(wabt::CallIndirectExpr *expr) {
+  using namespace llvm;
+
+  Value *funcPtr = createIndirectCallee(expr->table);
+  // 获取正确的函数指针类型
+  FunctionType *funcType = ctx.getFuncType(expr->decl.sig);
+  wabt::Index paramCount = expr->decl.sig.param_types.size();
+  wabt::Index argBase = instance != nullptr ? 1 : 0;
+  assert(funcType->getNumParams() == argBase + paramCount);
   // auto callArgsAlloca = (Value **)calloc(sizeof(Value *), paramCount);
-  llvm::SmallVector<Value *> callArgs(paramCount);
+  llvm::SmallVector<Value *> callArgs(argBase + paramCount);
   // https://stackoverflow.com/questions/5458204/unsigned-int-reverse-iteration-with-for-loops
   for (wabt::Index i = paramCount; i-- > 0;) {
-    callArgs[i] = popStack();
+    callArgs[argBase + i] = toV128(popStack());
+  }
+  if (instance != nullptr) {
+    callArgs[0] = instance;
   }
   // ArrayRef<Value *> callArgs = ArrayRef<Value *>(callArgsAlloca, paramCount);
   // TODO MultiValue
   assert(expr->decl.GetNumResults() <= 1);
-  Value *ret = irBuilder.CreateCall(funcType, funcPtr, callArgs);
+  Value *ret = createCall(funcType, funcPtr, callArgs);
   if (expr->decl.GetNumResults() != 0) {
     stack.push_back(ret);
   }
 }
 
+// Call the function, or invoke it if an exception handler is in effect. The
+// insertion point is moved to the normal destination of the invoke.
+llvm::Value *BlockContext::createCall(llvm::FunctionType *funcType,
+                                      llvm::Value *callee,
+                                      llvm::ArrayRef<llvm::Value *> args) {
+  using namespace llvm;
+  // direct calls use the calling convention of the callee, see
+  // `Context::setInternalCallingConv`.
+  auto *target = dyn_cast<Function>(callee);
+  CallingConv::ID cc =
+      target != nullptr ? target->getCallingConv() : CallingConv::C;
+  TryHandler *handler = blockStack.back().handler;
+  if (handler == nullptr) {
+    CallInst *call = irBuilder.CreateCall(funcType, callee, args);
+    call->setCallingConv(cc);
+    return call;
+  }
+  BasicBlock *next = BasicBlock::Create(llvmContext, "invoke_next", &function);
+  InvokeInst *ret = irBuilder.CreateInvoke(funcType, callee, next,
+                                           handler->lpad, args);
+  ret->setCallingConv(cc);
+  irBuilder.SetInsertPoint(next);
+  return ret;
+}
+
+// Byte size of the exception payload buffers: each param of a tag takes a 16
+// byte slot, so the buffer fits the payload of any tag.
+uint32_t BlockContext::getExnPayloadSize() {
+  std::size_t maxParams = 0;
+  for (wabt::Tag *tag : ctx.module->tags) {
+    maxParams = std::max<std::size_t>(maxParams, tag->decl.GetNumParams());
+  }
+  return maxParams * 16;
+}
+
+llvm::AllocaInst *BlockContext::createEntryAlloca(llvm::Type *ty,
+                                                  const llvm::Twine &name) {
+  using namespace llvm;
+  BasicBlock &entry = function.getEntryBlock();
+  IRBuilder<> b(&entry, entry.begin());
+  AllocaInst *alloca = b.CreateAlloca(ty, nullptr, name);
+  alloca->setAlignment(Align(16));
+  return alloca;
+}
+
+// Throw an exception with the tag and the payload, see the runtime library
+// in lib/notdec-wasm2llvm-rt.
+void BlockContext::createThrow(llvm::Value *tag, llvm::Value *payload) {
+  using namespace llvm;
+  FunctionCallee throwFunc = ctx.llvmModule.getOrInsertFunction(
+      "__notdec_wasm_throw", Type::getVoidTy(llvmContext), type.i32Type,
+      type.i8PtrType, type.i32Type);
+  cast<Function>(throwFunc.getCallee())->setDoesNotReturn();
+  Value *size = ConstantInt::get(type.i32Type, getExnPayloadSize());
+  createCall(throwFunc.getFunctionType(), throwFunc.getCallee(),
+             {tag, payload, size});
+  irBuilder.CreateUnreachable();
+  irBuilder.ClearInsertionPoint(); // mark unreachable
+}
+
+void BlockContext::visitThrow(wabt::ThrowExpr *expr) {
+  using namespace llvm;
+  wabt::Index tagIndex = ctx.module->GetTagIndex(expr->var);
+  wabt::Tag *tag = ctx.module->tags.at(tagIndex);
+  if (throwPayload == nullptr) {
+    throwPayload = createEntryAlloca(
+        ArrayType::get(type.i8Type, getExnPayloadSize()), "throw_payload");
+  }
+  // pack the params into 16 byte slots
+  for (wabt::Index i = tag->decl.GetNumParams(); i-- > 0;) {
+    Value *slot =
+        irBuilder.CreateConstGEP1_32(type.i8Type, throwPayload, i * 16);
+    irBuilder.CreateStore(toV128(popStack()), slot);
+  }
+  createThrow(ConstantInt::get(type.i32Type, tagIndex), throwPayload);
+}
+
+// Rethrow the exception caught by the catch block at the label. A wasm
+// exception is recreated from the saved tag and payload, and a foreign one is
+// rethrown as it is.
+void BlockContext::visitRethrow(wabt::RethrowExpr *expr) {
+  using namespace llvm;
+  std::size_t ind = getBrTarget(expr->var.index());
+  BreakoutTarget &bt = blockStack.at(ind);
+  if (bt.exnTag == nullptr) {
+    std::cerr << __FILE__ << ":" << __LINE__ << ": "
+              << "Error: rethrow target is not a catch block: "
+              << labelTypeToString(bt.lty) << std::endl;
+    std::abort();
+  }
+  // the catch blocks inside the target are left by the unwinding, unless a
+  // try block inside them handles the exception.
+  if (blockStack.back().handler == bt.handler) {
+    createEndCatch(ind + 1);
+  }
+  FunctionCallee rethrowFunc = ctx.llvmModule.getOrInsertFunction(
+      "__notdec_wasm_rethrow", Type::getVoidTy(llvmContext), type.i8PtrType,
+      type.i32Type, type.i8PtrType, type.i32Type);
+  cast<Function>(rethrowFunc.getCallee())->setDoesNotReturn();
+  Value *size = ConstantInt::get(type.i32Type, getExnPayloadSize());
+  createCall(rethrowFunc.getFunctionType(), rethrowFunc.getCallee(),
+             {bt.exn, bt.exnTag, bt.exnPayload, size});
+  irBuilder.CreateUnreachable();
+  irBuilder.ClearInsertionPoint(); // mark unreachable
+}
+
+// Whether a branch to the label at `ind` leaves catch blocks.
+bool BlockContext::leavesCatch(std::size_t ind) {
+  for (std::size_t i = ind; i < blockStack.size(); i++) {
+    if (blockStack[i].exn != nullptr) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Release the exceptions of the catch blocks left by a branch to the label at
+// `ind`, see `__notdec_wasm_end_catch`.
+void BlockContext::createEndCatch(std::size_t ind) {
+  using namespace llvm;
+  if (!leavesCatch(ind)) {
+    return;
+  }
+  FunctionCallee endCatch = ctx.llvmModule.getOrInsertFunction(
+      "__notdec_wasm_end_catch", Type::getVoidTy(llvmContext),
+      type.i8PtrType);
+  for (std::size_t i = blockStack.size(); i-- > ind;) {
+    if (blockStack[i].exn != nullptr) {
+      irBuilder.CreateCall(endCatch, {blockStack[i].exn});
+    }
+  }
+}
+
+// A block on the edge of a conditional branch to the label at `ind`, which
+// releases the exceptions of the catch blocks left and branches to the label.
+llvm::BasicBlock *BlockContext::createLeaveBlock(std::size_t ind) {
+  using namespace llvm;
+  BasicBlock *current = irBuilder.GetInsertBlock();
+  BasicBlock *leave = BasicBlock::Create(llvmContext, "catch_leave", &function);
+  irBuilder.SetInsertPoint(leave);
+  createEndCatch(ind);
+  irBuilder.CreateBr(&blockStack.at(ind).target);
+  irBuilder.SetInsertPoint(current);
+  return leave;
+}
+
+// Lower the tail call proposal. LLVM guarantees the tail call with musttail
+// when the caller and callee have the same calling convention, and either the
+// same prototype or the tailcc convention of the internal functions.
+// Otherwise, i.e. for the return calls between functions visible to the host
+// or through a table, fall back to a tail call hint, which the backend turns
+// into a sibling call when the ABI allows it.
+void BlockContext::createReturnCall(llvm::FunctionType *funcType,
+                                    llvm::Value *callee) {
+  using namespace llvm;
+  llvm::SmallVector<Value *> callArgs(funcType->getNumParams());
+  unsigned argBase = instance != nullptr ? 1 : 0;
+  for (unsigned i = funcType->getNumParams(); i-- > argBase;) {
+    callArgs[i] = toV128(popStack());
+  }
+  if (instance != nullptr) {
+    callArgs[0] = instance;
+  }
+  createEndCatch(0);
+  auto *target = dyn_cast<Function>(callee);
+  CallingConv::ID cc =
+      target != nullptr ? target->getCallingConv() : CallingConv::C;
+  CallInst *call = irBuilder.CreateCall(funcType, callee, callArgs);
+  call->setCallingConv(cc);
+  if (cc == function.getCallingConv() &&
+      (cc == CallingConv::Tail || funcType == function.getFunctionType())) {
+    call->setTailCallKind(CallInst::TCK_MustTail);
+  } else {
+    call->setTailCallKind(CallInst::TCK_Tail);
+  }
+  // validation guarantees the same result types as the caller.
+  if (funcType->getReturnType()->isVoidTy()) {
+    irBuilder.CreateRetVoid();
+  } else {
+    irBuilder.CreateRet(call);
+  }
+  irBuilder.ClearInsertionPoint(); // mark unreachable
+}
+
+void BlockContext::visitReturnCall(wabt::ReturnCallExpr *expr) {
+  llvm::Function *target = ctx.findFunc(expr->var);
+  createReturnCall(target->getFunctionType(), target);
+}
+
+void BlockContext::visitReturnCallIndirect(
+    wabt::ReturnCallIndirectExpr *expr) {
+  llvm::Value *funcPtr = createIndirectCallee(expr->table);
+  createReturnCall(ctx.getFuncType(expr->decl.sig), funcPtr);
+}
+
 void BlockContext::visitConstInst(wabt::ConstExpr *expr) {
   stack.push_back(visitConst(llvmContext, expr->const_));
 }
@@ -1917,7 +2590,7 @@ void BlockContext::visitConstInst(wabt::ConstExpr *expr) {
 llvm::Constant *visitConst(llvm::LLVMContext &llvmContext,
                            const wabt::Const &const_) {
   using namespace wabt;
-  uint64_t data[2];
+  uint32_t data[4];
   switch (const_.type()) {
   case Type::I32:
     return llvm::ConstantInt::get(convertType(llvmContext, const_.type()),
@@ -1932,11 +2605,11 @@ llvm::Constant *visitConst(llvm::LLVMContext &llvmContext,
     return llvm::ConstantFP::get(convertType(llvmContext, const_.type()),
                                  llvm::APFloat(ieee_double(const_.f64_bits())));
   case Type::V128:
-    data[0] = const_.vec128().u64(0);
-    data[1] = const_.vec128().u64(1);
-    return llvm::ConstantInt::get(
-        convertType(llvmContext, const_.type()),
-        llvm::APInt(128, llvm::ArrayRef<uint64_t>(data, 2)));
+    for (int i = 0; i < 4; i++) {
+      data[i] = const_.vec128().u32(i);
+    }
+    return llvm::ConstantDataVector::get(llvmContext,
+                                         llvm::ArrayRef<uint32_t>(data, 4));
   default:
     std::cerr << __FILE__ << ":" << __LINE__ << ": "
               << "Error: InitExpr type unknown: " << const_.type().GetName()
@@ -1951,6 +2624,10 @@ llvm::Value *BlockContext::createExtractLane(llvm::Value *vector,
   using namespace llvm;
   Value *ret =
       irBuilder.CreateExtractElement(irBuilder.CreateBitCast(vector, ty), imm);
+  // only i8 and i16 lanes are extended
+  if (!ret->getType()->isIntegerTy() ||
+      ret->getType()->getIntegerBitWidth() >= 32)
+    return ret;
   if (sign)
     ret = irBuilder.CreateSExt(ret, type.i32Type);
   else
@@ -1994,14 +2671,14 @@ void BlockContext::visitSimdLaneOp(wabt::SimdLaneOpExpr *expr) {
     x = vec;
     vec = popStack();
     ret = irBuilder.CreateBitCast(vec, type.i8x16Type);
-    ret = irBuilder.CreateTrunc(x, type.i8Type);
+    x = irBuilder.CreateTrunc(x, type.i8Type);
     ret = irBuilder.CreateInsertElement(ret, x, imm);
     break;
   case wabt::Opcode::I16X8ReplaceLane:
     x = vec;
     vec = popStack();
     ret = irBuilder.CreateBitCast(vec, type.i16x8Type);
-    ret = irBuilder.CreateTrunc(x, type.i16Type);
+    x = irBuilder.CreateTrunc(x, type.i16Type);
     ret = irBuilder.CreateInsertElement(ret, x, imm);
     break;
   case wabt::Opcode::I32X4ReplaceLane:
@@ -2044,9 +2721,9 @@ llvm::Value *BlockContext::createLoadLane(llvm::Value *vector,
                                           uint64_t imm) {
   using namespace llvm;
   vector = irBuilder.CreateBitCast(vector, ty);
-  Type *elementType = ty->getArrayElementType();
+  Type *elementType = cast<FixedVectorType>(ty)->getElementType();
   addr = irBuilder.CreateBitCast(addr, PointerType::get(llvmContext, 0));
-  Value *result = irBuilder.CreateLoad(elementType, addr);
+  Value *result = irBuilder.CreateAlignedLoad(elementType, addr, Align(1));
   return irBuilder.CreateInsertElement(vector, result, imm);
 }
 
@@ -2057,7 +2734,7 @@ llvm::Value *BlockContext::createStoreLane(llvm::Value *vector,
   vector = irBuilder.CreateBitCast(vector, ty);
   addr = irBuilder.CreateBitCast(addr, PointerType::get(llvmContext, 0));
   Value *result = irBuilder.CreateExtractElement(vector, imm);
-  return irBuilder.CreateStore(result, addr);
+  return irBuilder.CreateAlignedStore(result, addr, Align(1));
 }
 
 void BlockContext::visitSimdLoadLane(wabt::SimdLoadLaneExpr *expr) {
@@ -2065,7 +2742,7 @@ void BlockContext::visitSimdLoadLane(wabt::SimdLoadLaneExpr *expr) {
   Value *ret = nullptr, *vec, *addr;
   uint64_t imm = expr->val;
   vec = popStack();
-  addr = popStack();
+  addr = convertStackAddr(expr->offset);
   switch (expr->opcode) {
   case wabt::Opcode::V128Load8Lane:
     ret = createLoadLane(vec, addr, type.i8x16Type, imm);
@@ -2091,22 +2768,22 @@ void BlockContext::visitSimdLoadLane(wabt::SimdLoadLaneExpr *expr) {
 
 void BlockContext::visitSimdStoreLane(wabt::SimdStoreLaneExpr *expr) {
   using namespace llvm;
-  Value *ret = nullptr, *vec, *addr;
+  Value *vec, *addr;
   uint64_t imm = expr->val;
   vec = popStack();
-  addr = popStack();
+  addr = convertStackAddr(expr->offset);
   switch (expr->opcode) {
   case wabt::Opcode::V128Store8Lane:
-    ret = createStoreLane(vec, addr, type.i8x16Type, imm);
+    createStoreLane(vec, addr, type.i8x16Type, imm);
     break;
   case wabt::Opcode::V128Store16Lane:
-    ret = createStoreLane(vec, addr, type.i16x8Type, imm);
+    createStoreLane(vec, addr, type.i16x8Type, imm);
     break;
   case wabt::Opcode::V128Store32Lane:
-    ret = createStoreLane(vec, addr, type.i32x4Type, imm);
+    createStoreLane(vec, addr, type.i32x4Type, imm);
     break;
   case wabt::Opcode::V128Store64Lane:
-    ret = createStoreLane(vec, addr, type.i64x2Type, imm);
+    createStoreLane(vec, addr, type.i64x2Type, imm);
     break;
   default:
     std::cerr << __FILE__ << ":" << __LINE__ << ": "
@@ -2114,8 +2791,87 @@ void BlockContext::visitSimdStoreLane(wabt::SimdStoreLaneExpr *expr) {
               << std::endl;
     break;
   }
-  if (ret != nullptr)
-    stack.push_back(ret);
+}
+
+llvm::Value *BlockContext::createBitSelect(llvm::Value *trueValue,
+                                           llvm::Value *falseValue,
+                                           llvm::Value *mask) {
+  using namespace llvm;
+  mask = irBuilder.CreateBitCast(mask, type.i64x2Type);
+  falseValue = irBuilder.CreateBitCast(falseValue, type.i64x2Type);
+  trueValue = irBuilder.CreateBitCast(trueValue, type.i64x2Type);
+  return irBuilder.CreateOr(
+      irBuilder.CreateAnd(trueValue, mask),
+      irBuilder.CreateAnd(falseValue, irBuilder.CreateNot(mask)));
+}
+
+// Select the bytes of `vector` by the lanes of `index`. Extracting each lane
+// with the matching index lane is selected as a single pshufb on x86. Indices
+// out of range give 0 if `strict`, otherwise the index is only masked.
+llvm::Value *BlockContext::createSwizzle(llvm::Value *vector,
+                                         llvm::Value *index, bool strict) {
+  using namespace llvm;
+  vector = irBuilder.CreateBitCast(vector, type.i8x16Type);
+  index = irBuilder.CreateBitCast(index, type.i8x16Type);
+  // keep the index in range, so that the extract is never poison.
+  Value *lanes =
+      irBuilder.CreateAnd(index, ConstantInt::get(type.i8x16Type, 15));
+  Value *ret = PoisonValue::get(type.i8x16Type);
+  for (uint64_t i = 0; i < 16; i++) {
+    Value *lane = irBuilder.CreateExtractElement(lanes, i);
+    ret = irBuilder.CreateInsertElement(
+        ret, irBuilder.CreateExtractElement(vector, lane), i);
+  }
+  if (strict) {
+    Value *inRange =
+        irBuilder.CreateICmpULT(index, ConstantInt::get(type.i8x16Type, 16));
+    ret = irBuilder.CreateSelect(inRange, ret,
+                                 Constant::getNullValue(type.i8x16Type));
+  }
+  return ret;
+}
+
+// The relaxed truncations return INT_MIN for NaN and out of range lanes in the
+// signed case, the result of x86 cvttps2dq, and saturate in the unsigned case.
+// Both are allowed results, so the select is folded into the native
+// conversion where it matches.
+llvm::Value *BlockContext::createRelaxedTrunc(llvm::Value *vector,
+                                              llvm::FixedVectorType *destType,
+                                              bool sign) {
+  using namespace llvm;
+  if (ctx.opts.DeterministicSIMD || !sign) {
+    return createTruncSat(vector, destType, sign);
+  }
+  unsigned bits = destType->getScalarSizeInBits();
+  // [-2^(bits-1), 2^(bits-1)) is exact in the source type
+  double limit = std::ldexp(1.0, bits - 1);
+  Value *inRange = irBuilder.CreateAnd(
+      irBuilder.CreateFCmpOGE(vector,
+                              ConstantFP::get(vector->getType(), -limit)),
+      irBuilder.CreateFCmpOLT(vector,
+                              ConstantFP::get(vector->getType(), limit)));
+  Value *ret = irBuilder.CreateFPToSI(vector, destType);
+  return irBuilder.CreateSelect(
+      inRange, ret,
+      ConstantInt::get(destType, APInt::getSignedMinValue(bits)));
+}
+
+// i16x8.relaxed_dot_i8x16_i7x16_s: the sum of adjacent products of i8 lanes.
+// Whether the second operand is signed is unspecified if its top bit is set,
+// both modes treat it as signed.
+llvm::Value *BlockContext::createRelaxedDot(llvm::Value *left,
+                                            llvm::Value *right) {
+  using namespace llvm;
+  left = irBuilder.CreateBitCast(left, type.i8x16Type);
+  right = irBuilder.CreateBitCast(right, type.i8x16Type);
+  left = irBuilder.CreateSExt(left, type.i16x16Type);
+  right = irBuilder.CreateSExt(right, type.i16x16Type);
+  Value *product = irBuilder.CreateMul(left, right);
+  Value *even = irBuilder.CreateShuffleVector(
+      product, (ArrayRef<int>){0, 2, 4, 6, 8, 10, 12, 14});
+  Value *odd = irBuilder.CreateShuffleVector(
+      product, (ArrayRef<int>){1, 3, 5, 7, 9, 11, 13, 15});
+  return irBuilder.CreateAdd(even, odd);
 }
 
 void BlockContext::visitTernaryInst(wabt::TernaryExpr *expr) {
@@ -2125,13 +2881,63 @@ void BlockContext::visitTernaryInst(wabt::TernaryExpr *expr) {
   p2 = popStack();
   p3 = popStack();
   switch (expr->opcode) {
-  case wabt::Opcode::V128BitSelect: {
-    Value *mask = irBuilder.CreateBitCast(p1, type.i64x2Type);
-    Value *falseValue = irBuilder.CreateBitCast(p2, type.i64x2Type);
-    Value *trueValue = irBuilder.CreateBitCast(p3, type.i64x2Type);
-    ret = irBuilder.CreateOr(
-        irBuilder.CreateAnd(trueValue, mask),
-        irBuilder.CreateAnd(falseValue, irBuilder.CreateNot(mask)));
+  case wabt::Opcode::V128BitSelect:
+    ret = createBitSelect(p3, p2, p1);
+    break;
+  // relaxed: a * b + c, fused or not. Deterministic mode always fuses.
+  case wabt::Opcode::F32X4RelaxedMadd:
+  case wabt::Opcode::F32X4RelaxedNmadd:
+  case wabt::Opcode::F64X2RelaxedMadd:
+  case wabt::Opcode::F64X2RelaxedNmadd: {
+    FixedVectorType *vectorType =
+        (expr->opcode == wabt::Opcode::F32X4RelaxedMadd ||
+         expr->opcode == wabt::Opcode::F32X4RelaxedNmadd)
+            ? type.f32x4Type
+            : type.f64x2Type;
+    Value *a = irBuilder.CreateBitCast(p3, vectorType);
+    Value *b = irBuilder.CreateBitCast(p2, vectorType);
+    Value *c = irBuilder.CreateBitCast(p1, vectorType);
+    if (expr->opcode == wabt::Opcode::F32X4RelaxedNmadd ||
+        expr->opcode == wabt::Opcode::F64X2RelaxedNmadd) {
+      a = irBuilder.CreateFNeg(a);
+    }
+    Function *f = Intrinsic::getOrInsertDeclaration(
+        &ctx.llvmModule,
+        ctx.opts.DeterministicSIMD ? Intrinsic::fma : Intrinsic::fmuladd,
+        vectorType);
+    ret = irBuilder.CreateCall(f, {a, b, c});
+  } break;
+  // relaxed: the mask lanes are expected to be all ones or zero, otherwise
+  // either a bit select or a select on the top bit is allowed. The latter is
+  // blendv on x86.
+  case wabt::Opcode::I8X16RelaxedLaneSelect:
+  case wabt::Opcode::I16X8RelaxedLaneSelect:
+  case wabt::Opcode::I32X4RelaxedLaneSelect:
+  case wabt::Opcode::I64X2RelaxedLaneSelect: {
+    if (ctx.opts.DeterministicSIMD) {
+      ret = createBitSelect(p3, p2, p1);
+      break;
+    }
+    FixedVectorType *vectorType =
+        expr->opcode == wabt::Opcode::I8X16RelaxedLaneSelect   ? type.i8x16Type
+        : expr->opcode == wabt::Opcode::I16X8RelaxedLaneSelect ? type.i16x8Type
+        : expr->opcode == wabt::Opcode::I32X4RelaxedLaneSelect ? type.i32x4Type
+                                                               : type.i64x2Type;
+    Value *mask = irBuilder.CreateBitCast(p1, vectorType);
+    Value *cond =
+        irBuilder.CreateICmpSLT(mask, Constant::getNullValue(vectorType));
+    ret = irBuilder.CreateSelect(cond, irBuilder.CreateBitCast(p3, vectorType),
+                                 irBuilder.CreateBitCast(p2, vectorType));
+  } break;
+  case wabt::Opcode::I32X4DotI8X16I7X16AddS: {
+    Value *dot = createRelaxedDot(p3, p2);
+    dot = irBuilder.CreateSExt(dot, type.i32x8Type);
+    Value *even =
+        irBuilder.CreateShuffleVector(dot, (ArrayRef<int>){0, 2, 4, 6});
+    Value *odd =
+        irBuilder.CreateShuffleVector(dot, (ArrayRef<int>){1, 3, 5, 7});
+    ret = irBuilder.CreateAdd(irBuilder.CreateAdd(even, odd),
+                              irBuilder.CreateBitCast(p1, type.i32x4Type));
   } break;
   default:
     std::cerr << __FILE__ << ":" << __LINE__ << ": "
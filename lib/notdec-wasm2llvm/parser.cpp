@@ -3,6 +3,7 @@
 
 #include <cstring>
 #include <new>
+#include <optional>
 #include <set>
 #include <vector>
 #include <string>
@@ -11,19 +12,29 @@
 #include "wabt/ir.h"
 
 #include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/SmallString.h>
 #include <llvm/ADT/SmallVector.h>
 #include <llvm/ADT/StringRef.h>
 #include <llvm/IR/Attributes.h>
+#include <llvm/IR/CallingConv.h>
 #include <llvm/IR/Constant.h>
 #include <llvm/IR/Constants.h>
 #include <llvm/IR/DerivedTypes.h>
 #include <llvm/IR/Function.h>
 #include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/MDBuilder.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/raw_ostream.h>
 #include <llvm/TargetParser/Triple.h>
+#include <llvm/Transforms/Utils/ModuleUtils.h>
 
 
+#include "memory-analysis.h"
 #include "parser-block.h"
 #include "parser.h"
+#include "stack-recovery.h"
+#include "stream-output.h"
 #include "utils.h"
 
 namespace notdec::frontend::wasm {
@@ -31,6 +42,11 @@ namespace notdec::frontend::wasm {
 const char *DEFAULT_FUNCNAME_PREFIX = "func_";
 const char *DEFAULT_TABLE_PREFIX = "table_";
 
+// SplitMem splits the segments at zero runs of this length.
+const std::size_t MinZeroRun = 64;
+// IncbinData writes the pieces of at least this size to binary files.
+const std::size_t IncbinThreshold = 64 * 1024;
+
 std::vector<uint8_t *> GlobBuffers;
 
 void free_buffer() {
@@ -40,9 +56,21 @@ void free_buffer() {
   GlobBuffers.clear();
 }
 
+// wasm proposals that are enabled on top of the wabt defaults.
+static wabt::Features getFeatures() {
+  wabt::Features features;
+  features.enable_tail_call();
+  features.enable_relaxed_simd();
+  features.enable_exceptions();
+  features.enable_extended_const();
+  return features;
+}
+
 std::unique_ptr<Context> parse_wat(llvm::LLVMContext &llvmContext,
                                    llvm::Module &llvmModule, Options opts,
-                                   std::string file_name) {
+                                   std::string file_name,
+                                   std::string output_path,
+                                   FunctionStreamer *streamer) {
   using namespace wabt;
   std::vector<uint8_t> file_data;
   Result result = ReadFile(file_name, &file_data);
@@ -58,7 +86,7 @@ std::unique_ptr<Context> parse_wat(llvm::LLVMContext &llvmContext,
       std::make_unique<Context>(llvmContext, llvmModule, opts);
 
   Errors errors;
-  Features s_features;
+  Features s_features = getFeatures();
   // std::unique_ptr<FileStream> s_log_stream = FileStream::CreateStderr();
   WastParseOptions options(s_features);
   result = ParseWatModule(lexer.get(), (&(ret->module)), &errors, &options);
@@ -66,7 +94,7 @@ std::unique_ptr<Context> parse_wat(llvm::LLVMContext &llvmContext,
     std::cerr << "Read wat file failed." << std::endl;
     return std::unique_ptr<Context>(nullptr);
   }
-  bool s_validate = true;
+  bool s_validate = !opts.NoValidate;
   if (s_validate) {
     ValidateOptions options(s_features);
     result = ValidateModule(ret->module.get(), &errors, options);
@@ -76,13 +104,17 @@ std::unique_ptr<Context> parse_wat(llvm::LLVMContext &llvmContext,
     }
   }
   // do generation
+  ret->streamer = streamer;
+  ret->outputPath = output_path;
   ret->visitModule();
   return ret;
 }
 
 std::unique_ptr<Context> parse_wasm(llvm::LLVMContext &llvmContext,
                                     llvm::Module &llvmModule, Options opts,
-                                    std::string file_name) {
+                                    std::string file_name,
+                                    std::string output_path,
+                                    FunctionStreamer *streamer) {
   using namespace wabt;
   // 这部分代码来自WABT，解析wasm文件
   std::vector<uint8_t> file_data;
@@ -95,19 +127,33 @@ std::unique_ptr<Context> parse_wasm(llvm::LLVMContext &llvmContext,
     std::cerr << "Read wasm file failed." << std::endl;
     return std::unique_ptr<Context>(nullptr);
   }
+  // only the module level sections are read here with DecodePerFunction
+  CodeSectionIndex codeIndex;
+  std::vector<uint8_t> stripped;
+  std::vector<uint8_t> *module_data = &file_data;
+  if (opts.DecodePerFunction) {
+    if (!indexCodeSection(file_data, codeIndex)) {
+      std::cerr << "Read wasm file failed." << std::endl;
+      return std::unique_ptr<Context>(nullptr);
+    }
+    stripped = stripFunctionBodies(file_data, codeIndex);
+    module_data = &stripped;
+  }
   Errors errors;
   const bool kStopOnFirstError = true;
-  Features s_features;
+  Features s_features = getFeatures();
   // std::unique_ptr<FileStream> s_log_stream = FileStream::CreateStderr();
   ReadBinaryOptions options(s_features, nullptr, // s_log_stream.get(),
                             true, kStopOnFirstError, true);
-  result = ReadBinaryIr(file_name.c_str(), file_data.data(), file_data.size(),
-                        options, &errors, ret->module.get());
+  result =
+      ReadBinaryIr(file_name.c_str(), module_data->data(), module_data->size(),
+                   options, &errors, ret->module.get());
   if (!Succeeded(result)) {
     std::cerr << "Read wasm file failed." << std::endl;
     return std::unique_ptr<Context>(nullptr);
   }
-  bool s_validate = true;
+  stripped = std::vector<uint8_t>();
+  bool s_validate = !opts.NoValidate && !opts.DecodePerFunction;
   if (s_validate) {
     ValidateOptions options(s_features);
     result = ValidateModule(ret->module.get(), &errors, options);
@@ -116,7 +162,28 @@ std::unique_ptr<Context> parse_wasm(llvm::LLVMContext &llvmContext,
       return std::unique_ptr<Context>(nullptr);
     }
   }
+  ret->streamer = streamer;
+  ret->outputPath = output_path;
+  std::unique_ptr<BodyDecoder> decoder;
+  if (opts.DecodePerFunction) {
+    std::vector<Func *> funcs;
+    for (ModuleField &field : ret->module->fields) {
+      if (field.type() == ModuleFieldType::Func) {
+        funcs.push_back(&cast<FuncModuleField>(&field)->func);
+      }
+    }
+    if (funcs.size() != codeIndex.bodies.size()) {
+      std::cerr << "Read wasm file failed." << std::endl;
+      return std::unique_ptr<Context>(nullptr);
+    }
+    // the bodies are decoded while the module level items are translated
+    decoder = std::make_unique<BodyDecoder>(
+        file_data, codeIndex, *ret->module, std::move(funcs), s_features,
+        opts.DecodeThreads);
+    ret->bodyDecoder = decoder.get();
+  }
   ret->visitModule();
+  ret->bodyDecoder = nullptr;
   return ret;
 }
 
@@ -152,6 +219,9 @@ void Context::visitModule() {
               << std::endl;
     std::abort();
   }
+  if (opts.InstanceContext) {
+    declareInstanceType();
+  }
 
   // visit imports & build function index map
   for (Import *import : this->module->imports) {
@@ -185,6 +255,9 @@ void Context::visitModule() {
     } break;
 
     case ExternalKind::Tag:
+      // tags are identified by their index, see lib/notdec-wasm2llvm-rt
+      break;
+
     default:
       std::cerr << __FILE__ << ":" << __LINE__ << ": "
                 << "Error: Unknown import kind: "
@@ -194,37 +267,7 @@ void Context::visitModule() {
       break;
     }
   }
-  // visit global
-  for (Global *gl : this->module->globals) {
-    if (visitedGlobals.count(gl) > 0) {
-      continue;
-    }
-    visitGlobal(*gl, false);
-  }
-
-  // visit memory and data, create memory content
-  // for (Memory* mem: this->module->memories) {
-  //     declareMemory(*mem, false);
-  // }
-  for (ModuleField &field : module->fields) {
-    // wabt\src\wat-writer.cc WatWriter::WriteModule
-    if (field.type() != ModuleFieldType::Memory) {
-      continue;
-    }
-    Memory &mem = cast<MemoryModuleField>(&field)->memory;
-    declareMemory(mem, false);
-  }
-
-  for (ModuleField &field : module->fields) {
-    if (field.type() != ModuleFieldType::DataSegment) {
-      continue;
-    }
-    DataSegment &ds = cast<DataSegmentModuleField>(&field)->data_segment;
-    visitDataSegment(ds);
-  }
-
-  // TODO data
-
+  // declare functions first, for ref.func in the init exprs.
   std::vector<llvm::Function *> nonImportFuncs;
   // iterate without import function
   // see wabt src\wat-writer.cc WatWriter::WriteModule
@@ -262,26 +305,144 @@ void Context::visitModule() {
     nonImportFuncs.push_back(function);
   }
 
-  // visit elem and create function pointer array
-  for (Table *field : this->module->tables) {
-    visitTable(*field, false);
+  // visit global
+  for (Global *gl : this->module->globals) {
+    if (visitedGlobals.count(gl) > 0) {
+      continue;
+    }
+    visitGlobal(*gl, false);
+  }
+
+  // visit table and create function pointer array
+  // module->tables also contains the imported tables.
+  for (ModuleField &field : module->fields) {
+    if (field.type() != ModuleFieldType::Table) {
+      continue;
+    }
+    visitTable(cast<TableModuleField>(&field)->table, false);
+  }
+
+  // elem段需要函数指针，所以依赖func段
+  // visited before the functions, which need the passive segments.
+  for (ElemSegment *elem : this->module->elem_segments) {
+    visitElem(*elem);
+  }
+
+  // visit memory and data, create memory content
+  // for (Memory* mem: this->module->memories) {
+  //     declareMemory(*mem, false);
+  // }
+  for (ModuleField &field : module->fields) {
+    // wabt\src\wat-writer.cc WatWriter::WriteModule
+    if (field.type() != ModuleFieldType::Memory) {
+      continue;
+    }
+    Memory &mem = cast<MemoryModuleField>(&field)->memory;
+    declareMemory(mem, false);
   }
 
+  for (ModuleField &field : module->fields) {
+    if (field.type() != ModuleFieldType::DataSegment) {
+      continue;
+    }
+    DataSegment &ds = cast<DataSegmentModuleField>(&field)->data_segment;
+    visitDataSegment(ds);
+  }
+
+  // the names are final before the functions are written out by the streamer
+  visitExports();
+  // assign default names to functions
+  for (std::size_t i = 0; i < this->funcs.size(); i++) {
+    if (this->funcs[i]->getName().empty()) {
+      this->funcs[i]->setName(DEFAULT_FUNCNAME_PREFIX + std::to_string(i));
+    }
+  }
+
+  setInternalCallingConv();
+
   // visit function
+  llvm::GlobalVariable *sp = nullptr;
+  if (opts.LiftStackFrames && !opts.GenIntToPtr && !mems.empty() &&
+      instanceType == nullptr) {
+    sp = findStackPointer();
+  }
   std::size_t i = 0;
   for (ModuleField &field : module->fields) {
     if (field.type() != ModuleFieldType::Func) {
       continue;
     }
     Func &func = cast<FuncModuleField>(&field)->func;
-    visitFunc(func, nonImportFuncs.at(i));
+    llvm::Function *function = nonImportFuncs.at(i);
+    if (bodyDecoder != nullptr && !bodyDecoder->get(i)) {
+      std::abort();
+    }
+    visitFunc(func, function);
+    if (sp != nullptr) {
+      liftStackFrame(*function, sp, getMemAccessBase(0), opts.LogLevel);
+    }
+    if (streamer != nullptr) {
+      streamer->add(*function);
+    }
+    if (bodyDecoder != nullptr) {
+      func.exprs.clear();
+    }
     i++;
   }
-  // for (Func* func: this->module.funcs) {
-  //     std::cout << func->name << std::endl;
-  //     std::cout << "  " << func->exprs.size() << std::endl;
-  // }
-  // visit export and change visibility
+  // the read-only data analysis needs all function bodies
+  if (streamer != nullptr) {
+    streamer->flush();
+  } else {
+    findReadOnlyData();
+    if (!activeData.empty()) {
+      foldReadOnlyLoads(getMemAccessBase(0), activeData, opts.LogLevel);
+    }
+  }
+
+  // the start function runs after the segments are initialized.
+  if (!module->starts.empty()) {
+    llvm::Function *start = findFunc(*module->starts.front());
+    if (instanceType != nullptr) {
+      getInitBuilder()
+          .CreateCall(start, {getInitInstance()})
+          ->setCallingConv(start->getCallingConv());
+    } else {
+      getInitBuilder().CreateCall(start)->setCallingConv(
+          start->getCallingConv());
+    }
+  }
+  assert((this->funcs.size() == _func_index));
+}
+
+// Use the tailcc calling convention for the functions that are only called
+// directly by the translated code, so that their tail calls are guaranteed
+// even when the prototypes differ (see `BlockContext::createReturnCall`). The
+// functions visible to the host, or referenced by a table or ref.func, keep
+// the C calling convention.
+void Context::setInternalCallingConv() {
+  using namespace llvm;
+  std::set<Function *> referenced;
+  for (wabt::ElemSegment *elem : module->elem_segments) {
+    for (const wabt::ExprList &expr : elem->elem_exprs) {
+      for (const wabt::Expr &e : expr) {
+        if (auto *ref = dyn_cast<wabt::RefFuncExpr>(&e)) {
+          referenced.insert(funcs.at(module->GetFuncIndex(ref->var)));
+        }
+      }
+    }
+  }
+  for (std::size_t i = module->num_func_imports; i < funcs.size(); i++) {
+    Function *function = funcs[i];
+    // the uses so far are the references from globals and tables.
+    if (function->hasLocalLinkage() && function->use_empty() &&
+        referenced.count(function) == 0) {
+      function->setCallingConv(CallingConv::Tail);
+    }
+  }
+}
+
+// change the visibility of the exports, and rename the exported functions
+void Context::visitExports() {
+  using namespace wabt;
   for (Export *export_ : this->module->exports) {
     Index index;
     // Func* func;
@@ -320,6 +481,9 @@ void Context::visitModule() {
 
     case ExternalKind::Memory:
       index = module->GetMemoryIndex(export_->var);
+      if (this->mems[index] == nullptr) {
+        break; // owned by the host with InstanceContext
+      }
       // this->mems[index]->setInitializer(nullptr);
       this->mems[index]->setLinkage(
           llvm::GlobalValue::LinkageTypes::ExternalLinkage);
@@ -342,23 +506,22 @@ void Context::visitModule() {
       break;
     }
   }
-
-  // assign default names to functions
-  for (std::size_t i = 0; i < this->funcs.size(); i++) {
-    if (this->funcs[i]->getName().empty()) {
-      this->funcs[i]->setName(DEFAULT_FUNCNAME_PREFIX + std::to_string(i));
-    }
-  }
-
-  // elem段需要函数指针，所以依赖func段
-  for (ElemSegment *elem : this->module->elem_segments) {
-    visitElem(*elem);
-  }
-  assert((this->funcs.size() == _func_index));
 }
 
 llvm::GlobalVariable *Context::visitDataSegment(wabt::DataSegment &ds) {
   using namespace llvm;
+  if (ds.kind == wabt::SegmentKind::Passive) {
+    // keep the passive segment as a separate blob for memory.init
+    Constant *init =
+        ConstantDataArray::get(llvmContext, ArrayRef<uint8_t>(ds.data));
+    dataSegs.push_back(declareSegment(
+        init, ds.data.size(),
+        "__notdec_data_" + std::to_string(dataSegs.size())));
+    return nullptr;
+  }
+  // active segments are dropped after instantiation
+  dataSegs.emplace_back();
+
   wabt::Index index = module->GetMemoryIndex(ds.memory_var);
   if (index >= _mem_index) {
     std::cerr << __FILE__ << ":" << __LINE__ << ": "
@@ -368,8 +531,37 @@ llvm::GlobalVariable *Context::visitDataSegment(wabt::DataSegment &ds) {
   }
   // LLVM side mem manipulation
   GlobalVariable *mem = this->mems.at(index);
-  Type *memty = mem->getValueType();
   Constant *offset = visitInitExpr(ds.offset);
+  if (offset == nullptr || mem == nullptr) {
+    // relocatable modules place the segments at the imported __memory_base,
+    // and each instance has its own memory with InstanceContext.
+    if (!opts.NoMemInitializer || opts.SplitMem || mem == nullptr) {
+      Constant *init =
+          ConstantDataArray::get(llvmContext, ArrayRef<uint8_t>(ds.data));
+      GlobalVariable *blob = getDataBlob(
+          init, "__notdec_data_" + std::to_string(dataSegs.size() - 1));
+      IRBuilder<> &builder = getInitBuilder();
+      Value *base = evalInitExpr(ds.offset, &builder);
+      Value *dest;
+      if (mem == nullptr || memBases.at(index) != nullptr) {
+        Value *ptr = builder.CreateLoad(
+            PointerType::get(llvmContext, 0),
+            getMemBasePtr(builder, getInitInstance(), index));
+        base = builder.CreateZExt(base, builder.getInt64Ty());
+        dest = builder.CreateGEP(builder.getInt8Ty(), ptr, base);
+      } else {
+        Value *arr[2] = {ConstantInt::getNullValue(base->getType()), base};
+        dest = builder.CreateGEP(mem->getValueType(), mem,
+                                 ArrayRef<Value *>(arr, 2));
+      }
+      builder.CreateMemCpy(dest, Align(1), blob, Align(1), ds.data.size());
+    }
+    return mem;
+  }
+  Type *memty = mem->getValueType();
+  if (index == 0) {
+    activeData.push_back({cast<ConstantInt>(offset)->getZExtValue(), &ds.data});
+  }
 
   //
   if (!opts.SplitMem) {
@@ -393,9 +585,6 @@ llvm::GlobalVariable *Context::visitDataSegment(wabt::DataSegment &ds) {
       modMemInitializer(data, unwrapIntConstant(offset), ds.data);
     }
   } else {
-    auto data_size = ds.data.size();
-    auto int_offset = cast<ConstantInt>(offset);
-    ArrayType *ty = ArrayType::get(Type::getInt8Ty(llvmContext), data_size);
     bool isConstant = false;
 
     if (removeDollar(ds.name) == ".rodata") {
@@ -406,24 +595,33 @@ llvm::GlobalVariable *Context::visitDataSegment(wabt::DataSegment &ds) {
       isConstant = true;
     }
 
-    auto addr = int_to_hex(int_offset->getZExtValue());
-    auto name = mem->getName().str() + "_" + addr;
-
-    uint8_t *buffer = new uint8_t[data_size]; // TODO when to free?
-    OwnedBuffers.push_back(buffer);
-    // copy data
-    ::memcpy(buffer, ds.data.data(), data_size);
-
-    auto init =
-        ConstantDataArray::getRaw(StringRef((char *)buffer, data_size),
-                                  data_size, Type::getInt8Ty(llvmContext));
-    auto gv = new GlobalVariable(llvmModule, ty, isConstant,
-                                 GlobalValue::LinkageTypes::InternalLinkage,
-                                 init, name);
-    // place to a special section for later linking
-    gv->setSection(".addr_" + addr);
-    // byte aligned
-    gv->setAlignment(llvm::Align());
+    // the memory is zero initialized, so the long zero runs are left out.
+    uint64_t begin = cast<ConstantInt>(offset)->getZExtValue();
+    ArrayRef<uint8_t> data(ds.data);
+    std::size_t i = 0;
+    while (i < data.size()) {
+      if (data[i] == 0) {
+        i++;
+        continue;
+      }
+      // the piece ends before the next zero run
+      std::size_t end = i;
+      std::size_t zeros = 0;
+      for (std::size_t j = i; j < data.size() && zeros < MinZeroRun; j++) {
+        if (data[j] == 0) {
+          zeros++;
+        } else {
+          zeros = 0;
+          end = j + 1;
+        }
+      }
+      GlobalVariable *gv = declareDataPiece(
+          mem, begin + i, data.slice(i, end - i), isConstant);
+      if (index == 0) {
+        activeData.back().splits.push_back(gv);
+      }
+      i = end;
+    }
   }
 
   return mem;
@@ -452,6 +650,11 @@ void Context::visitFunc(wabt::Func &func, llvm::Function *function) {
 
   // handle locals (params)
   Function::arg_iterator llvmArgIt = function->arg_begin();
+  Value *instance = nullptr;
+  if (instanceType != nullptr) {
+    instance = &*llvmArgIt;
+    ++llvmArgIt;
+  }
   wabt::Index numParam = func.GetNumParams();
   for (wabt::Index i = 0; i < numParam; i++) {
     AllocaInst *alloca =
@@ -481,6 +684,13 @@ void Context::visitFunc(wabt::Func &func, llvm::Function *function) {
   }
 
   BlockContext bctx(*this, *function, irBuilder, std::move(locals));
+  bctx.instance = instance;
+  if (!mems.empty() && (mems.at(0) == nullptr || memBases.at(0) != nullptr)) {
+    // the memory is never moved, so the base can stay in a register.
+    bctx.memBase = irBuilder.CreateLoad(PointerType::get(llvmContext, 0),
+                                        getMemBasePtr(irBuilder, instance, 0),
+                                        "mem_base");
+  }
   bctx.visitBlock(wabt::LabelType::Func, allocaBlock, returnBlock, func.decl,
                   func.exprs);
 
@@ -511,10 +721,21 @@ void Context::visitGlobal(wabt::Global &gl, bool isExternal) {
       nullptr, gname);
   if (!isExternal) {
     Constant *init = visitInitExpr(gl.init_expr);
+    if (instanceType != nullptr && globFields.at(_glob_index) >= 0) {
+      // the instance field is initialized by __notdec_instance_init.
+      IRBuilder<> &builder = getInitBuilder();
+      Value *val =
+          init != nullptr ? init : evalInitExpr(gl.init_expr, &builder);
+      builder.CreateStore(
+          val, getGlobalPtr(builder, getInitInstance(), _glob_index));
+    } else if (init == nullptr) {
+      // depends on imported globals, store it in the module constructor.
+      IRBuilder<> &builder = getInitBuilder();
+      builder.CreateStore(evalInitExpr(gl.init_expr, &builder), gv);
+    }
     if (init == nullptr) {
-      // std::cerr << __FILE__ << ":" << __LINE__ << ": " << "Warn: use default
-      // InitExpr." << std::endl;
-      init = ConstantAggregateZero::get(ty);
+      gv->setConstant(false);
+      init = Constant::getNullValue(ty);
     }
     gv->setInitializer(init);
   }
@@ -523,34 +744,67 @@ void Context::visitGlobal(wabt::Global &gl, bool isExternal) {
 }
 
 // Declare the table. The initialization is done in elem section.
+// The table runtime structure, shared with lib/notdec-wasm2llvm-rt:
+//
+//   struct notdec_table { ptr elems; i32 size; i32 max; i32 capacity; }
+//
+// `elems` first points to a static array of the initial size, with capacity
+// 0. The runtime moves it to the heap on the first table.grow.
+llvm::StructType *Context::getTableType() {
+  using namespace llvm;
+  if (StructType *ty = StructType::getTypeByName(llvmContext, "notdec_table")) {
+    return ty;
+  }
+  Type *i32 = Type::getInt32Ty(llvmContext);
+  return StructType::create(llvmContext, {getFuncPointerType(), i32, i32, i32},
+                            "notdec_table");
+}
+
 void Context::visitTable(wabt::Table &table, bool isExternal) {
   using namespace llvm;
-  Type *ty;
-  if (table.elem_type == wabt::Type::FuncRef) {
-    // use a generic void func pointer, because the actual type is known.
-    // maybe migrate to https://llvm.org/docs/OpaquePointers.html in the future.
-    ty = getFuncPointerType();
-  } else {
+  // funcref and externref are both opaque pointers.
+  if (table.elem_type != wabt::Type::FuncRef &&
+      table.elem_type != wabt::Type::ExternRef) {
     std::cerr << __FILE__ << ":" << __LINE__ << ": "
               << "Error: table elem type not supported: "
               << table.elem_type.GetName() << std::endl;
     std::abort();
   }
 
-  if (table.elem_limits.has_max &&
-      table.elem_limits.max != table.elem_limits.initial) {
-    // TODO
-    if (opts.LogLevel >= level_warning)
-      std::cerr << __FILE__ << ":" << __LINE__ << ": "
-                << "Warning: table elem limits has max." << std::endl;
-  }
-
-  ArrayType *aty = ArrayType::get(ty, table.elem_limits.initial);
+  std::string name = table.name.empty()
+                         ? DEFAULT_TABLE_PREFIX + std::to_string(_table_index)
+                         : table.name;
   GlobalVariable *gv = new GlobalVariable(
-      llvmModule, aty, false, GlobalValue::LinkageTypes::ExternalLinkage,
-      nullptr,
-      table.name.empty() ? DEFAULT_TABLE_PREFIX + std::to_string(_table_index) : table.name);
+      llvmModule, getTableType(), false,
+      GlobalValue::LinkageTypes::ExternalLinkage, nullptr, name);
+  GlobalVariable *elems = nullptr;
+  if (!isExternal) {
+    ArrayType *aty =
+        ArrayType::get(getFuncPointerType(), table.elem_limits.initial);
+    elems = new GlobalVariable(
+        llvmModule, aty, false, GlobalValue::LinkageTypes::InternalLinkage,
+        ConstantAggregateZero::get(aty), name + "_elems");
+    Type *i32 = Type::getInt32Ty(llvmContext);
+    uint64_t max = table.elem_limits.has_max ? table.elem_limits.max
+                                             : UINT32_MAX;
+    gv->setInitializer(ConstantStruct::get(
+        getTableType(),
+        {elems, ConstantInt::get(i32, table.elem_limits.initial),
+         ConstantInt::get(i32, max), ConstantInt::get(i32, 0)}));
+  }
+  if (instanceType != nullptr && !isExternal) {
+    // each instance gets a copy of the elements, see
+    // lib/notdec-wasm2llvm-rt/table.c
+    FunctionCallee initTable = llvmModule.getOrInsertFunction(
+        "__notdec_wasm_table_init", Type::getVoidTy(llvmContext),
+        getFuncPointerType(), getFuncPointerType());
+    IRBuilder<> &builder = getInitBuilder();
+    builder.CreateCall(initTable,
+                       {getTablePtr(builder, getInitInstance(), _table_index),
+                        gv});
+  }
   this->tables.push_back(gv);
+  this->tableElems.push_back(elems);
   _table_index++;
 }
 
@@ -558,13 +812,34 @@ void Context::visitTable(wabt::Table &table, bool isExternal) {
 void Context::visitElem(wabt::ElemSegment &elem) {
   using namespace llvm;
   uint8_t flags = elem.GetFlags(module.get());
-  if (elem.elem_type != wabt::Type::FuncRef) {
+  if (elem.elem_type != wabt::Type::FuncRef &&
+      elem.elem_type != wabt::Type::ExternRef) {
     std::cerr << __FILE__ << ":" << __LINE__ << ": "
               << "Error: elem type not supported: " << elem.elem_type.GetName()
               << std::endl;
     std::abort();
   }
 
+  if (elem.kind == wabt::SegmentKind::Declared) {
+    // only used to declare ref.func targets, dropped immediately.
+    elemSegs.emplace_back();
+    return;
+  }
+  if (flags & wabt::SegPassive) {
+    // keep the passive segment as a separate blob for table.init
+    llvm::SmallVector<Constant *> buffer;
+    for (const wabt::ExprList &expr : elem.elem_exprs) {
+      buffer.push_back(visitElemExpr(expr));
+    }
+    ArrayType *arr = ArrayType::get(getFuncPointerType(), buffer.size());
+    elemSegs.push_back(
+        declareSegment(ConstantArray::get(arr, buffer), buffer.size(),
+                       "__notdec_elem_" + std::to_string(elemSegs.size())));
+    return;
+  }
+  // active segments are dropped after instantiation
+  elemSegs.emplace_back();
+
   // 1 根据table index找到对应的table
   wabt::Index table_index;
   if ((flags & (wabt::SegPassive | wabt::SegExplicitIndex)) ==
@@ -573,20 +848,47 @@ void Context::visitElem(wabt::ElemSegment &elem) {
   } else {
     table_index = 0;
   }
-  if (flags & wabt::SegPassive) {
-    std::cerr << __FILE__ << ":" << __LINE__ << ": "
-              << "Error: passive elem segment not supported." << std::endl;
-    std::abort();
-  }
 
-  GlobalVariable *gv = tables.at(table_index); // TODO index
+  GlobalVariable *gv = tableElems.at(table_index);
+  Constant *offset_constant = visitInitExpr(elem.offset);
+  if (gv == nullptr || offset_constant == nullptr) {
+    // imported table, or placed at the imported __table_base: copy the
+    // elements in the module constructor. The copy of the instance is
+    // created before with InstanceContext.
+    llvm::SmallVector<Constant *> buffer;
+    for (const wabt::ExprList &expr : elem.elem_exprs) {
+      buffer.push_back(visitElemExpr(expr));
+    }
+    ArrayType *arr = ArrayType::get(getFuncPointerType(), buffer.size());
+    GlobalVariable *blob = new GlobalVariable(
+        llvmModule, arr, true, GlobalValue::LinkageTypes::PrivateLinkage,
+        ConstantArray::get(arr, buffer),
+        "__notdec_elem_" + std::to_string(elemSegs.size() - 1));
+    blob->setUnnamedAddr(GlobalValue::UnnamedAddr::Global);
+    IRBuilder<> &builder = getInitBuilder();
+    Value *base = evalInitExpr(elem.offset, &builder);
+    Value *elems = builder.CreateLoad(
+        getFuncPointerType(),
+        builder.CreateStructGEP(
+            getTableType(),
+            getTablePtr(builder, getInitInstance(), table_index), 0));
+    Value *dest = builder.CreateGEP(
+        getFuncPointerType(), elems,
+        builder.CreateZExt(base, Type::getInt64Ty(llvmContext)));
+    // byte size of the pointers, independent of the data layout.
+    Value *size = builder.CreatePtrToInt(
+        builder.CreateGEP(getFuncPointerType(),
+                          ConstantPointerNull::get(getFuncPointerType()),
+                          builder.getInt64(buffer.size())),
+        Type::getInt64Ty(llvmContext));
+    builder.CreateMemCpy(dest, Align(1), blob, Align(1), size);
+    return;
+  }
 
   // 2 把函数指针填入
   ArrayType *arr = cast<ArrayType>(gv->getValueType());
-  // all null
   llvm::SmallVector<Constant *> buffer(arr->getNumElements());
   // 解析offset
-  Constant *offset_constant = visitInitExpr(elem.offset);
   wabt::Index offset = unwrapIntConstant(offset_constant);
   if (offset != 0) {
     if (opts.LogLevel >= level_warning)
@@ -594,60 +896,351 @@ void Context::visitElem(wabt::ElemSegment &elem) {
                 << "Warning: elem offset not zero." << std::endl;
   }
   for (wabt::Index i = 0; i < arr->getNumElements(); i++) {
+    // keep the elements of the previous segments
     if (!(i >= offset && i < offset + elem.elem_exprs.size())) {
-      buffer[i] = ConstantPointerNull::get(
-          llvm::cast<PointerType>(arr->getElementType()));
+      buffer[i] = gv->getInitializer()->getAggregateElement(i);
       continue;
     }
-    const wabt::ExprList &expr = elem.elem_exprs.at(i - offset);
-    if (flags & wabt::SegUseElemExprs) {
-      // TODO
-      std::cerr << __FILE__ << ":" << __LINE__ << ": "
-                << "Error: elem exprs not supported." << std::endl;
-      std::abort();
-    } else {
-      assert(expr.size() == 1);
-      assert(expr.front().type() == wabt::ExprType::RefFunc);
-      wabt::Index func_ind =
-          module->GetFuncIndex(cast<wabt::RefFuncExpr>(&expr.front())->var);
-      Constant *func_addr =
-          ConstantExpr::getBitCast(funcs.at(func_ind), getFuncPointerType());
-      buffer[i] = func_addr;
-    }
+    buffer[i] = visitElemExpr(elem.elem_exprs.at(i - offset));
   }
+  gv->setInitializer(ConstantArray::get(arr, buffer));
+}
 
-  Constant *init = ConstantArray::get(arr, buffer);
-  if (gv->hasInitializer()) {
-    gv->getInitializer()->replaceAllUsesWith(init);
-  } else {
-    gv->setInitializer(init);
+// Convert one element of an elem segment (ref.func or ref.null) to a function
+// pointer constant.
+llvm::Constant *Context::visitElemExpr(const wabt::ExprList &expr) {
+  using namespace llvm;
+  assert(expr.size() == 1);
+  switch (expr.front().type()) {
+  case wabt::ExprType::RefFunc: {
+    wabt::Index func_ind =
+        module->GetFuncIndex(cast<wabt::RefFuncExpr>(&expr.front())->var);
+    return ConstantExpr::getBitCast(funcs.at(func_ind), getFuncPointerType());
+  }
+  case wabt::ExprType::RefNull:
+    return ConstantPointerNull::get(getFuncPointerType());
+  default:
+    std::cerr << __FILE__ << ":" << __LINE__ << ": "
+              << "Error: elem expr not supported: "
+              << wabt::GetExprTypeName(expr.front()) << std::endl;
+    std::abort();
   }
 }
 
-llvm::Constant *Context::visitInitExpr(wabt::ExprList &expr) {
-  using namespace wabt;
-  if (expr.size() != 1) {
+SegmentInfo Context::declareSegment(llvm::Constant *init, uint64_t size,
+                                    const std::string &name) {
+  using namespace llvm;
+  SegmentInfo seg;
+  seg.size = size;
+  seg.blob = getDataBlob(init, name);
+  seg.dropped = new GlobalVariable(
+      llvmModule, Type::getInt1Ty(llvmContext), false,
+      GlobalValue::LinkageTypes::InternalLinkage,
+      ConstantInt::getFalse(llvmContext), name + "_dropped");
+  return seg;
+}
+
+// Get the private constant blob holding `init`, shared by the segments with
+// the same content.
+llvm::GlobalVariable *Context::getDataBlob(llvm::Constant *init,
+                                           const std::string &name) {
+  using namespace llvm;
+  GlobalVariable *&blob = dataBlobs[init];
+  if (blob == nullptr) {
+    blob = new GlobalVariable(llvmModule, init->getType(), true,
+                              GlobalValue::LinkageTypes::PrivateLinkage, init,
+                              name);
+    blob->setUnnamedAddr(GlobalValue::UnnamedAddr::Global);
+  }
+  return blob;
+}
+
+// Declare the global for the initialized bytes at `addr` of the memory with
+// SplitMem, placed to a special section for later linking. With IncbinData,
+// large pieces are written to a binary file and defined by the module asm.
+llvm::GlobalVariable *Context::declareDataPiece(llvm::GlobalVariable *mem,
+                                                uint64_t addr,
+                                                llvm::ArrayRef<uint8_t> bytes,
+                                                bool isConstant) {
+  using namespace llvm;
+  std::string hex = int_to_hex(addr);
+  std::string name = mem->getName().str() + "_" + hex;
+  std::string section = ".addr_" + hex;
+  ArrayType *ty = ArrayType::get(Type::getInt8Ty(llvmContext), bytes.size());
+  if (!opts.IncbinData || bytes.size() < IncbinThreshold) {
+    GlobalVariable *gv = new GlobalVariable(
+        llvmModule, ty, isConstant, GlobalValue::LinkageTypes::InternalLinkage,
+        ConstantDataArray::get(llvmContext, bytes), name);
+    gv->setSection(section);
+    // byte aligned
+    gv->setAlignment(Align());
+    return gv;
+  }
+
+  // <output>.<name>.bin, or <name>.bin without an output path
+  SmallString<128> path(outputPath);
+  sys::path::replace_extension(path, "");
+  if (!path.empty()) {
+    path += ".";
+  }
+  path += name + ".bin";
+  sys::fs::make_absolute(path);
+  std::error_code EC;
+  raw_fd_ostream os(path, EC);
+  if (EC) {
     std::cerr << __FILE__ << ":" << __LINE__ << ": "
-              << "Error: InitExpr size != 1." << std::endl;
+              << "Error: Cannot write data segment to " << path.str().str()
+              << ": " << EC.message() << std::endl;
     std::abort();
   }
+  os.write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+
+  std::string asmText;
+  raw_string_ostream as(asmText);
+  // hidden, so that the pieces of two translated modules do not collide.
+  as << "\t.section\t" << section << (isConstant ? ",\"a\"" : ",\"aw\"")
+     << ",@progbits\n"
+     << "\t.globl\t" << name << "\n"
+     << "\t.hidden\t" << name << "\n"
+     << name << ":\n"
+     << "\t.incbin\t\"" << path.str() << "\"\n"
+     << "\t.size\t" << name << ", " << bytes.size() << "\n"
+     << "\t.previous\n";
+  llvmModule.appendModuleInlineAsm(as.str());
+  GlobalVariable *gv = new GlobalVariable(
+      llvmModule, ty, isConstant, GlobalValue::LinkageTypes::ExternalLinkage,
+      nullptr, name);
+  gv->setVisibility(GlobalValue::HiddenVisibility);
+  gv->setAlignment(Align());
+  return gv;
+}
+
+// Fold the init expr to a constant, or return nullptr if it depends on the
+// value of an imported (or runtime initialized) global.
+llvm::Constant *Context::visitInitExpr(wabt::ExprList &expr) {
+  return llvm::cast_or_null<llvm::Constant>(evalInitExpr(expr, nullptr));
+}
 
-  if (expr.front().type() == ExprType::Const) {
-    const Const &const_ = cast<ConstExpr>(&expr.front())->const_;
-    return visitConst(llvmContext, const_);
-  } else if (expr.front().type() == ExprType::GlobalGet) {
-    // TODO
+// Evaluate the init expr, including the extended-const add/sub/mul. Globals
+// with a constant initializer are folded. Other globals are loaded with
+// `builder`, or nullptr is returned when there is no builder.
+llvm::Value *Context::evalInitExpr(wabt::ExprList &expr,
+                                   llvm::IRBuilder<> *builder) {
+  using namespace wabt;
+  std::vector<llvm::Value *> stack;
+  for (Expr &e : expr) {
+    switch (e.type()) {
+    case ExprType::Const:
+      stack.push_back(visitConst(llvmContext, cast<ConstExpr>(&e)->const_));
+      break;
+    case ExprType::RefNull:
+      stack.push_back(llvm::ConstantPointerNull::get(getFuncPointerType()));
+      break;
+    case ExprType::RefFunc:
+      stack.push_back(findFunc(cast<RefFuncExpr>(&e)->var));
+      break;
+    case ExprType::GlobalGet: {
+      Index index = module->GetGlobalIndex(cast<GlobalGetExpr>(&e)->var);
+      llvm::GlobalVariable *gv = globs.at(index);
+      if (gv->isConstant() && gv->hasInitializer()) {
+        stack.push_back(gv->getInitializer());
+      } else if (builder != nullptr) {
+        stack.push_back(builder->CreateLoad(
+            gv->getValueType(),
+            getGlobalPtr(*builder, getInitInstance(), index)));
+      } else {
+        return nullptr;
+      }
+    } break;
+    case ExprType::Binary: {
+      // reachable with NoValidate
+      if (stack.size() < 2) {
+        std::cerr << __FILE__ << ":" << __LINE__ << ": "
+                  << "Error: InitExpr stack underflow at "
+                  << cast<BinaryExpr>(&e)->opcode.GetName() << std::endl;
+        std::abort();
+      }
+      llvm::Value *rhs = stack.back();
+      stack.pop_back();
+      llvm::Value *lhs = stack.back();
+      stack.pop_back();
+      if (lhs->getType() != rhs->getType() ||
+          !lhs->getType()->isIntegerTy()) {
+        std::cerr << __FILE__ << ":" << __LINE__ << ": "
+                  << "Error: InitExpr type mismatch at "
+                  << cast<BinaryExpr>(&e)->opcode.GetName() << std::endl;
+        std::abort();
+      }
+      auto *l = llvm::dyn_cast<llvm::ConstantInt>(lhs);
+      auto *r = llvm::dyn_cast<llvm::ConstantInt>(rhs);
+      // the operands are only non-constant with a builder.
+      switch (cast<BinaryExpr>(&e)->opcode) {
+      case Opcode::I32Add:
+      case Opcode::I64Add:
+        stack.push_back(l && r ? llvm::ConstantInt::get(
+                                     llvmContext, l->getValue() + r->getValue())
+                               : builder->CreateAdd(lhs, rhs));
+        break;
+      case Opcode::I32Sub:
+      case Opcode::I64Sub:
+        stack.push_back(l && r ? llvm::ConstantInt::get(
+                                     llvmContext, l->getValue() - r->getValue())
+                               : builder->CreateSub(lhs, rhs));
+        break;
+      case Opcode::I32Mul:
+      case Opcode::I64Mul:
+        stack.push_back(l && r ? llvm::ConstantInt::get(
+                                     llvmContext, l->getValue() * r->getValue())
+                               : builder->CreateMul(lhs, rhs));
+        break;
+      default:
+        std::cerr << __FILE__ << ":" << __LINE__ << ": "
+                  << "Error: unsupported opcode in InitExpr: "
+                  << cast<BinaryExpr>(&e)->opcode.GetName() << std::endl;
+        std::abort();
+      }
+    } break;
+    default:
+      std::cerr << __FILE__ << ":" << __LINE__ << ": "
+                << "Error: unsupported expr in InitExpr: "
+                << GetExprTypeName(e) << std::endl;
+      std::abort();
+    }
+  }
+  if (stack.size() != 1) {
     std::cerr << __FILE__ << ":" << __LINE__ << ": "
-              << "Error: InitExpr with global.get is currently not supported."
-              << std::endl;
+              << "Error: InitExpr leaves " << stack.size()
+              << " values on stack." << std::endl;
     std::abort();
   }
-  return nullptr;
+  return stack.back();
+}
+
+// The module constructor `__notdec_init` runs before main, through
+// llvm.global_ctors. New code is inserted before its return, so it follows the
+// instantiation order of wasm: globals, elem segments, data segments, and then
+// the start function. The static parts of the segments stay in initializers.
+//
+// With InstanceContext, it is instead the external `__notdec_instance_init`,
+// which the host calls for each instance, see `declareInstanceType`.
+llvm::IRBuilder<> &Context::getInitBuilder() {
+  using namespace llvm;
+  if (initFunc == nullptr) {
+    if (instanceType != nullptr) {
+      initFunc = Function::Create(
+          FunctionType::get(Type::getVoidTy(llvmContext),
+                            {PointerType::get(llvmContext, 0)}, false),
+          GlobalValue::LinkageTypes::ExternalLinkage, "__notdec_instance_init",
+          llvmModule);
+      initFunc->getArg(0)->setName("instance");
+    } else {
+      initFunc = Function::Create(
+          FunctionType::get(Type::getVoidTy(llvmContext), false),
+          GlobalValue::LinkageTypes::InternalLinkage, "__notdec_init",
+          llvmModule);
+      appendToGlobalCtors(llvmModule, initFunc, 65535);
+    }
+    BasicBlock *entry = BasicBlock::Create(llvmContext, "entry", initFunc);
+    ReturnInst *ret = ReturnInst::Create(llvmContext, entry);
+    initBuilder = std::make_unique<IRBuilder<>>(ret);
+  }
+  return *initBuilder;
+}
+
+// The instance struct of InstanceContext:
+//
+//   struct notdec_instance {
+//     ptr mem_base[memories]; globals...; notdec_table tables[tables];
+//   }
+//
+// Immutable globals with a constant initializer stay shared module globals.
+// The host allocates the instance and its memories, stores the memory bases
+// and the imported globals and tables in it, and then calls
+// `__notdec_instance_init`, which initializes the rest and runs the start
+// function.
+void Context::declareInstanceType() {
+  using namespace llvm;
+  SmallVector<Type *> fields;
+  for (wabt::Index i = 0; i < module->memories.size(); i++) {
+    memFields.push_back(fields.size());
+    fields.push_back(PointerType::get(llvmContext, 0));
+  }
+  for (wabt::Index i = 0; i < module->globals.size(); i++) {
+    wabt::Global *gl = module->globals.at(i);
+    bool shared = i >= module->num_global_imports && !gl->mutable_;
+    for (wabt::Expr &e : gl->init_expr) {
+      if (e.type() == wabt::ExprType::GlobalGet) {
+        shared = false;
+      }
+    }
+    globFields.push_back(shared ? -1 : fields.size());
+    if (!shared) {
+      fields.push_back(convertType(llvmContext, gl->type));
+    }
+  }
+  for (wabt::Index i = 0; i < module->tables.size(); i++) {
+    tableFields.push_back(fields.size());
+    fields.push_back(getTableType());
+  }
+  instanceType = StructType::create(llvmContext, fields, "notdec_instance");
+  // always created, so that the host can call it.
+  getInitBuilder();
+}
+
+// Add the instance parameter to the converted signature with
+// InstanceContext.
+llvm::FunctionType *Context::getFuncType(const wabt::FuncSignature &sig) {
+  using namespace llvm;
+  FunctionType *funcType = convertFuncType(llvmContext, sig);
+  if (instanceType == nullptr) {
+    return funcType;
+  }
+  SmallVector<Type *> params{PointerType::get(llvmContext, 0)};
+  params.append(funcType->param_begin(), funcType->param_end());
+  return FunctionType::get(funcType->getReturnType(), params, false);
+}
+
+// The instance argument of `__notdec_instance_init`, or nullptr.
+llvm::Value *Context::getInitInstance() {
+  return instanceType != nullptr ? initFunc->getArg(0) : nullptr;
+}
+
+llvm::Value *Context::getGlobalPtr(llvm::IRBuilder<> &builder,
+                                   llvm::Value *instance, wabt::Index index) {
+  if (instanceType == nullptr || globFields.at(index) < 0) {
+    return globs.at(index);
+  }
+  return builder.CreateStructGEP(instanceType, instance, globFields.at(index));
+}
+
+llvm::Value *Context::getTablePtr(llvm::IRBuilder<> &builder,
+                                  llvm::Value *instance, wabt::Index index) {
+  if (instanceType == nullptr) {
+    return tables.at(index);
+  }
+  return builder.CreateStructGEP(instanceType, instance, tableFields.at(index));
+}
+
+// The variable holding the base pointer of the memory, with MemBasePointer or
+// InstanceContext.
+llvm::Value *Context::getMemBasePtr(llvm::IRBuilder<> &builder,
+                                    llvm::Value *instance, wabt::Index index) {
+  if (instanceType == nullptr) {
+    return memBases.at(index);
+  }
+  return builder.CreateStructGEP(instanceType, instance, memFields.at(index));
 }
 
 llvm::GlobalVariable *Context::declareMemory(wabt::Memory &mem,
                                              bool isExternal) {
   using namespace llvm;
+  if (instanceType != nullptr) {
+    // the host allocates the memory, and stores its base in the instance.
+    this->mems.push_back(nullptr);
+    this->memBases.push_back(nullptr);
+    _mem_index++;
+    return nullptr;
+  }
   uint64_t len = mem.page_limits.initial;
   if (mem.page_limits.has_max) {
     uint64_t max = mem.page_limits.max;
@@ -667,13 +1260,21 @@ llvm::GlobalVariable *Context::declareMemory(wabt::Memory &mem,
     gv->setInitializer(ConstantAggregateZero::get(ty));
   }
   this->mems.push_back(gv);
+  GlobalVariable *base = nullptr;
+  if (opts.MemBasePointer) {
+    // points to the memory above until the host replaces it.
+    base = new GlobalVariable(llvmModule, PointerType::get(llvmContext, 0),
+                              false, GlobalValue::LinkageTypes::ExternalLinkage,
+                              gv, "__notdec_mem0_base");
+  }
+  this->memBases.push_back(base);
   _mem_index++;
   return gv;
 }
 
 llvm::Function *Context::declareFunc(wabt::Func &func, bool isExternal) {
   using namespace llvm;
-  FunctionType *funcType = convertFuncType(llvmContext, func.decl.sig);
+  FunctionType *funcType = getFuncType(func.decl.sig);
   std::string fname = func.name;
   if (!opts.NoRemoveDollar) {
     fname = removeDollar(func.name);
@@ -738,11 +1339,16 @@ void Context::setFuncArgName(llvm::Function &func,
                              const wabt::FuncSignature &decl) {
   using namespace llvm;
   wabt::Index argSize = decl.GetNumParams();
+  wabt::Index argBase = 0;
+  if (instanceType != nullptr) {
+    func.getArg(0)->setName("instance");
+    argBase = 1;
+  }
   for (wabt::Index i = 0; i < argSize; i++) {
     if (decl.param_type_names.count(i) != 0) {
-      func.getArg(i)->setName(decl.param_type_names.at(i));
+      func.getArg(argBase + i)->setName(decl.param_type_names.at(i));
     } else {
-      func.getArg(i)->setName(ARG_PREFIX + std::to_string(i));
+      func.getArg(argBase + i)->setName(ARG_PREFIX + std::to_string(i));
     }
     // std::cout << func.getArg(i)->getName().str() << std::endl;
   }
@@ -758,6 +1364,111 @@ llvm::Function *Context::findFunc(wabt::Var &var) {
   return funcs.at(ind);
 }
 
+// Mark the active data segments that are never written after instantiation as
+// read-only, and make their split globals constant. The host is assumed to
+// write only to buffers passed to it, which are not in read-only data.
+void Context::findReadOnlyData() {
+  if (activeData.empty() || opts.GenIntToPtr || mems.empty() ||
+      mems.at(0) == nullptr || mems.at(0)->isDeclaration()) {
+    return;
+  }
+  // the host may write an exported memory, the memory behind a replaced base
+  // pointer, or the buffers passed to the imports (e.g. WASI fd_read), which
+  // the analysis cannot see.
+  llvm::ArrayRef<llvm::Function *> imports(funcs.data(),
+                                           module->num_func_imports);
+  if (!opts.NoHostWrites &&
+      (!mems.at(0)->hasLocalLinkage() || memBases.at(0) != nullptr ||
+       module->num_table_imports > 0 || mayPassMemAddress(imports))) {
+    if (opts.LogLevel >= level_info) {
+      std::cerr << "Info: the host may write the memory, no read-only data."
+                << std::endl;
+    }
+    return;
+  }
+  std::optional<MemRanges> writes = collectMemWrites(getMemAccessBase(0));
+  if (!writes.has_value()) {
+    if (opts.LogLevel >= level_info) {
+      std::cerr << "Info: memory writes are unbounded, no read-only data."
+                << std::endl;
+    }
+    return;
+  }
+  std::size_t count = 0;
+  for (DataRange &range : activeData) {
+    uint64_t end = range.begin + range.bytes->size();
+    range.readOnly = !overlaps(*writes, range.begin, end);
+    // overlapping segments overwrite each other
+    for (DataRange &other : activeData) {
+      if (&other != &range && other.begin < end &&
+          range.begin < other.begin + other.bytes->size()) {
+        range.readOnly = false;
+      }
+    }
+    if (range.readOnly) {
+      count++;
+      for (llvm::GlobalVariable *gv : range.splits) {
+        gv->setConstant(true);
+      }
+    }
+  }
+  if (opts.LogLevel >= level_info) {
+    std::cerr << "Info: " << count << " of " << activeData.size()
+              << " data segments are read-only." << std::endl;
+  }
+}
+
+// Find the __stack_pointer global of the shadow stack, by its name, or by the
+// wasm-ld convention that it is the first global.
+llvm::GlobalVariable *Context::findStackPointer() {
+  using namespace llvm;
+  for (GlobalVariable *gv : globs) {
+    StringRef name = gv->getName();
+    if (name == "__stack_pointer" || name.ends_with(".__stack_pointer")) {
+      return gv;
+    }
+  }
+  if (!globs.empty() && !globs.front()->isConstant() &&
+      globs.front()->getValueType()->isIntegerTy(32)) {
+    if (opts.LogLevel >= level_notice) {
+      std::cerr << "Notice: Assuming the first global "
+                << globs.front()->getName().str() << " is the stack pointer."
+                << std::endl;
+    }
+    return globs.front();
+  }
+  return nullptr;
+}
+
+// Get the TBAA access tag for a memory access of type `ty`. i8 accesses use the
+// omnipotent char type that aliases everything, and all v128 accesses share one
+// type, because SIMD code freely reinterprets the lanes. This is only an
+// assumption: wasm memory is untyped, so it is enabled by `GenTBAA`.
+llvm::MDNode *Context::getTBAATag(llvm::Type *ty) {
+  using namespace llvm;
+  auto it = tbaaTags.find(ty);
+  if (it != tbaaTags.end()) {
+    return it->second;
+  }
+  MDBuilder mdb(llvmContext);
+  if (tbaaChar == nullptr) {
+    MDNode *root = mdb.createTBAARoot("notdec wasm TBAA");
+    tbaaChar = mdb.createTBAAScalarTypeNode("omnipotent char", root);
+  }
+  MDNode *node = tbaaChar;
+  if (ty->isVectorTy()) {
+    node = mdb.createTBAAScalarTypeNode("v128", tbaaChar);
+  } else if (!ty->isIntegerTy(8)) {
+    std::string name;
+    raw_string_ostream os(name);
+    ty->print(os);
+    node = mdb.createTBAAScalarTypeNode(os.str(), tbaaChar);
+  }
+  MDNode *tag = mdb.createTBAAStructTagNode(node, node, 0);
+  tbaaTags[ty] = tag;
+  return tag;
+}
+
 llvm::FunctionType *convertFuncType(llvm::LLVMContext &llvmContext,
                                     const wabt::FuncSignature &decl) {
   using namespace llvm;
@@ -804,8 +1515,13 @@ llvm::Type *convertType(llvm::LLVMContext &llvmContext, const wabt::Type &ty) {
     return Type::getFloatTy(llvmContext);
   case wabt::Type::F64:
     return Type::getDoubleTy(llvmContext);
+  case wabt::Type::FuncRef:
+  case wabt::Type::ExternRef:
+    return PointerType::get(llvmContext, 0);
   case wabt::Type::V128:
-    return Type::getInt128Ty(llvmContext);
+    // same as v128_t in wasm_simd128.h, so that the values stay in vector
+    // registers.
+    return FixedVectorType::get(Type::getInt32Ty(llvmContext), 4);
   case wabt::Type::Void:
     return Type::getVoidTy(llvmContext);
   default:
@@ -828,7 +1544,11 @@ llvm::Constant *convertZeroValue(llvm::LLVMContext &llvmContext,
   case wabt::Type::F64:
     return llvm::ConstantFP::get(Type::getDoubleTy(llvmContext), 0);
   case wabt::Type::V128:
-    return ConstantInt::get(Type::getInt128Ty(llvmContext), 0);
+    return ConstantAggregateZero::get(
+        FixedVectorType::get(Type::getInt32Ty(llvmContext), 4));
+  case wabt::Type::FuncRef:
+  case wabt::Type::ExternRef:
+    return ConstantPointerNull::get(PointerType::get(llvmContext, 0));
   case wabt::Type::Void:
   default:
     std::cerr << __FILE__ << ":" << __LINE__ << ": "
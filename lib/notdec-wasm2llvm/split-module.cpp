@@ -0,0 +1,158 @@
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/DenseSet.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/InstIterator.h>
+#include <llvm/IR/Instructions.h>
+
+#include "split-module.h"
+#include "stream-output.h"
+#include "utils.h"
+
+namespace notdec::frontend::wasm {
+
+namespace {
+
+// Union-find over the functions, tracking the instruction count of each group.
+struct FunctionGroups {
+  std::vector<unsigned> parent;
+  std::vector<uint64_t> size;
+
+  unsigned find(unsigned i) {
+    while (parent[i] != i) {
+      parent[i] = parent[parent[i]];
+      i = parent[i];
+    }
+    return i;
+  }
+
+  void merge(unsigned a, unsigned b) {
+    a = find(a);
+    b = find(b);
+    if (a != b) {
+      parent[b] = a;
+      size[a] += size[b];
+    }
+  }
+};
+
+} // namespace
+
+bool splitModule(llvm::Module &mod, const std::string &outputPath,
+                 unsigned parts, bool summary, int logLevel) {
+  using namespace llvm;
+  std::vector<Function *> funcs;
+  DenseMap<const Function *, unsigned> funcIndex;
+  FunctionGroups groups;
+  uint64_t total = 0;
+  for (Function &F : mod) {
+    if (F.isDeclaration()) {
+      continue;
+    }
+    funcIndex[&F] = funcs.size();
+    groups.parent.push_back(funcs.size());
+    groups.size.push_back(std::max<uint64_t>(F.getInstructionCount(), 1));
+    total += groups.size.back();
+    funcs.push_back(&F);
+  }
+
+  // 1. group the functions along the direct calls, the most frequent call
+  // edges first. A group is capped at half a partition to keep the balance.
+  std::map<std::pair<unsigned, unsigned>, unsigned> edges;
+  for (unsigned i = 0; i < funcs.size(); i++) {
+    for (Instruction &inst : instructions(*funcs[i])) {
+      auto *call = dyn_cast<CallBase>(&inst);
+      if (call == nullptr) {
+        continue;
+      }
+      auto it = funcIndex.find(call->getCalledFunction());
+      if (it != funcIndex.end() && it->second != i) {
+        edges[{std::min(i, it->second), std::max(i, it->second)}]++;
+      }
+    }
+  }
+  std::vector<std::pair<std::pair<unsigned, unsigned>, unsigned>> sorted(
+      edges.begin(), edges.end());
+  std::stable_sort(sorted.begin(), sorted.end(),
+                   [](const auto &a, const auto &b) {
+                     return a.second > b.second;
+                   });
+  uint64_t maxGroup = std::max<uint64_t>(total / parts / 2, 1);
+  for (const auto &edge : sorted) {
+    unsigned a = groups.find(edge.first.first);
+    unsigned b = groups.find(edge.first.second);
+    if (a != b && groups.size[a] + groups.size[b] <= maxGroup) {
+      groups.merge(a, b);
+    }
+  }
+
+  // 2. assign the largest groups first to the least loaded partition
+  std::vector<unsigned> roots;
+  for (unsigned i = 0; i < funcs.size(); i++) {
+    if (groups.find(i) == i) {
+      roots.push_back(i);
+    }
+  }
+  std::stable_sort(roots.begin(), roots.end(), [&](unsigned a, unsigned b) {
+    return groups.size[a] > groups.size[b];
+  });
+  std::vector<uint64_t> load(parts, 0);
+  std::vector<unsigned> groupPart(funcs.size(), 0);
+  for (unsigned root : roots) {
+    unsigned part = std::min_element(load.begin(), load.end()) - load.begin();
+    groupPart[root] = part;
+    load[part] += groups.size[root];
+  }
+  std::vector<DenseSet<const GlobalValue *>> partFuncs(parts);
+  for (unsigned i = 0; i < funcs.size(); i++) {
+    partFuncs[groupPart[groups.find(i)]].insert(funcs[i]);
+  }
+
+  // 3. write the partitions and the manifest
+  exportLocalSymbols(mod);
+  StringRef prefix(outputPath);
+  prefix.consume_back(".bc");
+  std::string manifestPath = prefix.str() + ".manifest";
+  std::ofstream manifest(manifestPath);
+  if (!manifest) {
+    std::cerr << "Error: Cannot open output file " << manifestPath
+              << std::endl;
+    return false;
+  }
+  for (unsigned part = 0; part < parts; part++) {
+    // the global variables and the module asm are kept in the first
+    // partition
+    if (part != 0 && partFuncs[part].empty()) {
+      continue;
+    }
+    std::unique_ptr<Module> partMod = cloneDefinitions(
+        mod,
+        [&](const GlobalValue *gv) {
+          if (isa<Function>(gv)) {
+            return partFuncs[part].contains(gv);
+          }
+          return part == 0;
+        },
+        part == 0);
+    std::string path = prefix.str() + "." + std::to_string(part) + ".bc";
+    if (!writeBitcode(*partMod, path, summary)) {
+      return false;
+    }
+    manifest << path << "\n";
+    if (logLevel >= level_info) {
+      std::cerr << "Info: Wrote " << partFuncs[part].size() << " functions ("
+                << load[part] << " instructions) to " << path << std::endl;
+    }
+  }
+  return true;
+}
+
+} // namespace notdec::frontend::wasm
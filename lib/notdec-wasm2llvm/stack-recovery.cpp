@@ -0,0 +1,247 @@
+#include <cstdint>
+#include <iostream>
+#include <optional>
+#include <utility>
+
+#include <llvm/ADT/DenseSet.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/DataLayout.h>
+#include <llvm/IR/Dominators.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/IntrinsicInst.h>
+#include <llvm/Support/Casting.h>
+#include <llvm/Transforms/Utils/PromoteMemToReg.h>
+
+#include "parser.h"
+#include "stack-recovery.h"
+#include "utils.h"
+
+namespace notdec::frontend::wasm {
+
+namespace {
+
+struct FrameAccess {
+  llvm::GetElementPtrInst *gep;
+  // offset from the frame base, if it is a constant.
+  std::optional<int64_t> offset;
+};
+
+// Promote the locals created by `Context::visitFunc` that hold the stack
+// pointer loaded by `spLoad` or a value derived from it, so that the frame base
+// kept in a local becomes an SSA value. The other locals are left alone.
+void promoteFrameLocals(llvm::LoadInst *spLoad) {
+  using namespace llvm;
+  Function &F = *spLoad->getFunction();
+  SmallVector<AllocaInst *> allocas;
+  SmallVector<Value *> worklist{spLoad};
+  DenseSet<Value *> visited{spLoad};
+  while (!worklist.empty()) {
+    Value *val = worklist.pop_back_val();
+    for (User *u : val->users()) {
+      Value *next = nullptr;
+      if (isa<BinaryOperator>(u)) {
+        next = u;
+      } else if (auto *si = dyn_cast<StoreInst>(u)) {
+        auto *ai = dyn_cast<AllocaInst>(si->getPointerOperand());
+        if (si->getValueOperand() == val && ai != nullptr &&
+            ai->getParent() == &F.getEntryBlock() && isAllocaPromotable(ai) &&
+            visited.insert(ai).second) {
+          allocas.push_back(ai);
+          // the loads of the local are derived as well
+          for (User *au : ai->users()) {
+            if (isa<LoadInst>(au) && visited.insert(au).second) {
+              worklist.push_back(au);
+            }
+          }
+        }
+      }
+      if (next != nullptr && visited.insert(next).second) {
+        worklist.push_back(next);
+      }
+    }
+  }
+  if (allocas.empty()) {
+    return;
+  }
+  DominatorTree DT(F);
+  PromoteMemToReg(allocas, DT);
+}
+
+// Check that every user of the frame pointer `gep` only accesses the memory
+// through it, and that accesses with a constant offset stay in the frame.
+bool checkFrameAccess(llvm::GetElementPtrInst *gep,
+                      std::optional<int64_t> offset, uint64_t frameSize,
+                      const llvm::DataLayout &DL) {
+  using namespace llvm;
+  for (User *u : gep->users()) {
+    std::optional<uint64_t> size;
+    if (auto *li = dyn_cast<LoadInst>(u)) {
+      size = DL.getTypeStoreSize(li->getType());
+    } else if (auto *si = dyn_cast<StoreInst>(u)) {
+      if (si->getValueOperand() == gep) {
+        return false;
+      }
+      size = DL.getTypeStoreSize(si->getValueOperand()->getType());
+    } else if (auto *mi = dyn_cast<MemIntrinsic>(u)) {
+      if (mi->getLength() == gep) {
+        return false;
+      }
+      if (auto *len = dyn_cast<ConstantInt>(mi->getLength())) {
+        size = len->getZExtValue();
+      }
+    } else {
+      return false;
+    }
+    if (offset.has_value() && size.has_value() &&
+        (*offset < 0 || *offset + *size > frameSize)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+bool liftStackFrame(llvm::Function &F, llvm::GlobalVariable *sp,
+                    llvm::GlobalVariable *mem, int logLevel) {
+  using namespace llvm;
+  if (F.isDeclaration()) {
+    return false;
+  }
+
+  // 1. find the prologue: frame = load(sp) - N. Functions without a stack
+  // pointer load are left untouched.
+  LoadInst *spLoad = nullptr;
+  for (User *u : sp->users()) {
+    auto *li = dyn_cast<LoadInst>(u);
+    if (li == nullptr || li->getFunction() != &F) {
+      continue;
+    }
+    if (spLoad != nullptr) { // more than one frame
+      return false;
+    }
+    spLoad = li;
+  }
+  if (spLoad == nullptr) {
+    return false;
+  }
+  promoteFrameLocals(spLoad);
+  BinaryOperator *frame = nullptr;
+  uint64_t frameSize = 0;
+  for (User *u : spLoad->users()) {
+    // epilogue: restore the saved stack pointer
+    if (auto *si = dyn_cast<StoreInst>(u)) {
+      if (si->getPointerOperand() == sp && si->getValueOperand() == spLoad) {
+        continue;
+      }
+      return false;
+    }
+    auto *bo = dyn_cast<BinaryOperator>(u);
+    if (frame == nullptr && bo != nullptr &&
+        bo->getOpcode() == Instruction::Sub && bo->getOperand(0) == spLoad) {
+      if (auto *size = dyn_cast<ConstantInt>(bo->getOperand(1))) {
+        frame = bo;
+        frameSize = size->getZExtValue();
+        continue;
+      }
+    }
+    return false;
+  }
+  if (frame == nullptr || frameSize == 0) {
+    return false;
+  }
+
+  // 2. collect all accesses derived from the frame base. Any other use makes
+  // the frame escape.
+  const DataLayout &DL = F.getParent()->getDataLayout();
+  SmallVector<FrameAccess> accesses;
+  SmallVector<std::pair<Value *, std::optional<int64_t>>> worklist;
+  DenseSet<Value *> visited;
+  worklist.push_back({frame, 0});
+  visited.insert(frame);
+  while (!worklist.empty()) {
+    auto [val, offset] = worklist.pop_back_val();
+    for (User *u : val->users()) {
+      // publish the new stack pointer, or restore it with frame + N
+      if (auto *si = dyn_cast<StoreInst>(u)) {
+        if (si->getPointerOperand() == sp && si->getValueOperand() == val) {
+          continue;
+        }
+        return false;
+      }
+      if (auto *bo = dyn_cast<BinaryOperator>(u)) {
+        // adding two frame pointers
+        if (!visited.insert(bo).second) {
+          return false;
+        }
+        Value *other =
+            bo->getOperand(0) == val ? bo->getOperand(1) : bo->getOperand(0);
+        auto *c = dyn_cast<ConstantInt>(other);
+        std::optional<int64_t> next;
+        if (bo->getOpcode() == Instruction::Add) {
+          if (c != nullptr && offset.has_value()) {
+            next = *offset + c->getSExtValue();
+          }
+        } else if (bo->getOpcode() == Instruction::Sub &&
+                   bo->getOperand(0) == val && c != nullptr) {
+          if (offset.has_value()) {
+            next = *offset - c->getSExtValue();
+          }
+        } else {
+          return false;
+        }
+        worklist.push_back({bo, next});
+        continue;
+      }
+      if (auto *gep = dyn_cast<GetElementPtrInst>(u)) {
+        if (getMemAccessIndex(gep, mem) == val &&
+            checkFrameAccess(gep, offset, frameSize, DL)) {
+          accesses.push_back({gep, offset});
+          continue;
+        }
+      }
+      // MemBasePointer: the address is extended to index the base pointer
+      if (auto *zext = dyn_cast<ZExtInst>(u)) {
+        for (User *zu : zext->users()) {
+          auto *gep = dyn_cast<GetElementPtrInst>(zu);
+          if (gep == nullptr || getMemAccessIndex(gep, mem) != val ||
+              !checkFrameAccess(gep, offset, frameSize, DL)) {
+            return false;
+          }
+          accesses.push_back({gep, offset});
+        }
+        continue;
+      }
+      return false;
+    }
+  }
+
+  // 3. rewrite the accesses to the native frame
+  IRBuilder<> builder(&F.getEntryBlock(), F.getEntryBlock().begin());
+  AllocaInst *alloca = builder.CreateAlloca(
+      ArrayType::get(builder.getInt8Ty(), frameSize), nullptr, "stack_frame");
+  // the shadow stack is 16 byte aligned
+  alloca->setAlignment(Align(16));
+  for (FrameAccess &access : accesses) {
+    Value *idx = getMemAccessIndex(access.gep, mem);
+    builder.SetInsertPoint(access.gep);
+    Value *offset =
+        access.offset.has_value()
+            ? ConstantInt::get(idx->getType(), *access.offset, true)
+            : builder.CreateSub(idx, frame, "frame_offset");
+    Value *ptr = builder.CreateGEP(builder.getInt8Ty(), alloca, offset);
+    access.gep->replaceAllUsesWith(ptr);
+    access.gep->eraseFromParent();
+  }
+
+  if (logLevel >= level_info) {
+    std::cerr << "Info: Lifted stack frame of " << F.getName().str() << " ("
+              << frameSize << " bytes, " << accesses.size() << " accesses)"
+              << std::endl;
+  }
+  return true;
+}
+
+} // namespace notdec::frontend::wasm
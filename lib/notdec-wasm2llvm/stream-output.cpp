@@ -0,0 +1,151 @@
+#include <iostream>
+#include <memory>
+
+#include <llvm/ADT/DenseSet.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/Analysis/ModuleSummaryAnalysis.h>
+#include <llvm/Analysis/ProfileSummaryInfo.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/IR/ModuleSummaryIndex.h>
+#include <llvm/IR/GlobalValue.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#include <llvm/Transforms/Utils/ValueMapper.h>
+
+#include "stream-output.h"
+#include "utils.h"
+
+namespace notdec::frontend::wasm {
+
+void exportLocalSymbols(llvm::Module &mod) {
+  using namespace llvm;
+  for (GlobalValue &gv : mod.global_values()) {
+    if (!gv.hasLocalLinkage()) {
+      continue;
+    }
+    if (!gv.hasName()) {
+      gv.setName("__notdec_anon");
+    }
+    gv.setLinkage(GlobalValue::ExternalLinkage);
+    gv.setVisibility(GlobalValue::HiddenVisibility);
+  }
+}
+
+std::unique_ptr<llvm::Module>
+cloneDefinitions(const llvm::Module &mod,
+                 llvm::function_ref<bool(const llvm::GlobalValue *)>
+                     shouldClone,
+                 bool keepAsm) {
+  using namespace llvm;
+  ValueToValueMapTy VMap;
+  std::unique_ptr<Module> ret = CloneModule(mod, VMap, shouldClone);
+  if (!keepAsm) {
+    ret->setModuleInlineAsm("");
+  }
+  // drop the declarations that are not used, including the appending globals
+  // like llvm.global_ctors that are not cloned.
+  SmallVector<GlobalValue *> unused;
+  for (GlobalValue &gv : ret->global_values()) {
+    gv.removeDeadConstantUsers();
+    if (gv.isDeclaration() && gv.use_empty()) {
+      unused.push_back(&gv);
+    }
+  }
+  for (GlobalValue *gv : unused) {
+    gv->eraseFromParent();
+  }
+  return ret;
+}
+
+bool writeBitcode(llvm::Module &mod, const std::string &path, bool summary) {
+  using namespace llvm;
+  std::error_code EC;
+  raw_fd_ostream os(path, EC);
+  if (EC) {
+    std::cerr << "Error: Cannot open output file " << path << ": "
+              << EC.message() << std::endl;
+    return false;
+  }
+  if (!summary) {
+    WriteBitcodeToFile(mod, os);
+    return true;
+  }
+  // the same summary that clang -flto=thin writes, without profile data
+  ProfileSummaryInfo PSI(mod);
+  ModuleSummaryIndex index = buildModuleSummaryIndex(mod, nullptr, &PSI);
+  WriteBitcodeToFile(mod, os, false, &index, true);
+  return true;
+}
+
+FunctionStreamer::FunctionStreamer(const std::string &outputPath,
+                                   uint64_t chunkSize, bool summary,
+                                   int logLevel)
+    : outputPath(outputPath), chunkSize(chunkSize), summary(summary),
+      logLevel(logLevel) {
+  llvm::StringRef path(outputPath);
+  path.consume_back(".bc");
+  prefix = path.str();
+}
+
+void FunctionStreamer::setTarget(const llvm::Triple &triple,
+                                 const std::string &dataLayout) {
+  targetTriple = triple;
+  targetDataLayout = dataLayout;
+}
+
+void FunctionStreamer::add(llvm::Function &F) {
+  if (F.isDeclaration()) {
+    return;
+  }
+  pending.push_back(&F);
+  pendingSize += F.getInstructionCount();
+  if (pendingSize >= chunkSize) {
+    flush();
+  }
+}
+
+void FunctionStreamer::flush() {
+  using namespace llvm;
+  if (pending.empty()) {
+    return;
+  }
+  Module &mod = *pending.front()->getParent();
+  // the chunks refer to the symbols of the module by name
+  exportLocalSymbols(mod);
+
+  DenseSet<const GlobalValue *> chunkFuncs(pending.begin(), pending.end());
+  // the module asm stays in the residual module written by `finish`.
+  std::unique_ptr<Module> chunk = cloneDefinitions(
+      mod, [&](const GlobalValue *gv) { return chunkFuncs.contains(gv); },
+      false);
+  if (!targetTriple.empty()) {
+    chunk->setTargetTriple(targetTriple);
+    chunk->setDataLayout(targetDataLayout);
+  }
+  std::string path = prefix + "." + std::to_string(chunkPaths.size()) + ".bc";
+  if (writeBitcode(*chunk, path, summary)) {
+    chunkPaths.push_back(path);
+    if (logLevel >= level_info) {
+      std::cerr << "Info: Wrote " << pending.size() << " functions ("
+                << pendingSize << " instructions) to " << path << std::endl;
+    }
+  } else {
+    failed = true;
+  }
+  chunk.reset();
+  for (Function *F : pending) {
+    F->deleteBody();
+  }
+  pending.clear();
+  pendingSize = 0;
+}
+
+bool FunctionStreamer::finish(llvm::Module &mod) {
+  flush();
+  if (!writeBitcode(mod, outputPath, summary)) {
+    failed = true;
+  }
+  return !failed;
+}
+
+} // namespace notdec::frontend::wasm
@@ -0,0 +1,7 @@
+; A minimal host module for --link-host, with a native target.
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-i128:128-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+define i32 @host_answer() {
+  ret i32 42
+}
@@ -0,0 +1,33 @@
+#!/usr/bin/env python3
+# Write a wasm binary whose only function "f" has a malformed body that still
+# decodes, for the checks of the translation without validation.
+#
+# usage: malformed.py <stack|branch|local> <output.wasm>
+import sys
+
+BODIES = {
+    # i32.add on an empty value stack
+    'stack': [0x6a],
+    # br out of the function
+    'branch': [0x0c, 0x05],
+    # local.get of a missing local, then drop
+    'local': [0x20, 0x07, 0x1a],
+}
+
+
+def section(id, payload):
+    return bytes([id, len(payload)] + payload)
+
+
+if __name__ == '__main__':
+    # no locals, the instructions, end
+    body = [0x00] + BODIES[sys.argv[1]] + [0x0b]
+    out = b'\0asm' + bytes([1, 0, 0, 0])
+    # type 0: [] -> []
+    out += section(1, [1, 0x60, 0, 0])
+    out += section(3, [1, 0])
+    # export "f" as function 0
+    out += section(7, [1, 1, ord('f'), 0, 0])
+    out += section(10, [1, len(body)] + body)
+    with open(sys.argv[2], 'wb') as f:
+        f.write(out)
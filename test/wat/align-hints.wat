@@ -0,0 +1,19 @@
+;; The alignment hint of a memarg is not a guarantee, so the memory accesses
+;; are unaligned unless --trust-align-hints is given.
+;; RUN: %notdec-wasm2llvm %s -o %t.ll
+;; RUN: %FileCheck %s < %t.ll
+;; RUN: %notdec-wasm2llvm --trust-align-hints %s -o %t.trust.ll
+;; RUN: %FileCheck --check-prefix=TRUST %s < %t.trust.ll
+
+(module
+  (memory 1)
+
+  ;; CHECK-LABEL: define void @copy(
+  ;; CHECK: load i64, ptr %{{.*}}, align 1
+  ;; CHECK: store i64 %{{.*}}, ptr %{{.*}}, align 1
+  ;; TRUST-LABEL: define void @copy(
+  ;; TRUST: load i64, ptr %{{.*}}, align 8
+  ;; TRUST: store i64 %{{.*}}, ptr %{{.*}}, align 4
+  (func $copy (export "copy") (param i32 i32)
+    (i64.store align=4 (local.get 1) (i64.load (local.get 0))))
+)
@@ -0,0 +1,37 @@
+;; memory.init and data.drop on passive and active data segments.
+;; RUN: %notdec-wasm2llvm %s -o %t.ll
+;; RUN: %FileCheck %s < %t.ll
+
+;; CHECK: @__notdec_data_0_dropped = internal global i1 false
+
+(module
+  (memory 1)
+  (data $passive "hello")
+  (data (i32.const 16) "active")
+
+  ;; the passive segment traps when it is dropped or the access is out of it
+  ;; CHECK-LABEL: define {{.*}}@init(
+  ;; CHECK: load i1, ptr @__notdec_data_0_dropped
+  ;; CHECK: %seg_oob = icmp ugt i64
+  ;; CHECK: br i1 %seg_oob, label %trap, label %trap_next
+  ;; CHECK: trap:
+  ;; CHECK-NEXT: call void @llvm.trap()
+  ;; CHECK: trap_next:
+  ;; CHECK: call void @llvm.memcpy.p0.p0.i32(
+  (func $init (export "init") (param i32 i32 i32)
+    (memory.init $passive (local.get 0) (local.get 1) (local.get 2)))
+
+  ;; CHECK-LABEL: define {{.*}}@drop(
+  ;; CHECK: store i1 true, ptr @__notdec_data_0_dropped
+  (func $drop (export "drop")
+    (data.drop $passive))
+
+  ;; active segments are dropped after instantiation, so only empty accesses
+  ;; are valid
+  ;; CHECK-LABEL: define {{.*}}@init_active(
+  ;; CHECK: %seg_oob = icmp ugt i64 %{{.*}}, 0
+  ;; CHECK-NOT: @llvm.memcpy
+  ;; CHECK: ret void
+  (func $init_active (export "init_active") (param i32 i32 i32)
+    (memory.init 1 (local.get 0) (local.get 1) (local.get 2)))
+)
@@ -0,0 +1,18 @@
+;; Large byte array initializers are written to .ll as packed structs, where
+;; the long zero runs become zeroinitializer, and the output is still valid
+;; IR.
+;; RUN: %notdec-wasm2llvm %s -o %t.ll
+;; RUN: %FileCheck %s < %t.ll
+;; RUN: test $(wc -c < %t.ll) -lt 8192
+;; RUN: %llvm-as %t.ll -o %t.bc
+;; RUN: %llvm-dis %t.bc -o - | %FileCheck %s
+
+;; CHECK: @__notdec_mem0 = {{.*}}global <{ [256 x i8], [3 x i8], [32509 x i8], [3 x i8], [32765 x i8] }> <{ [256 x i8] zeroinitializer, [3 x i8] c"abc", [32509 x i8] zeroinitializer, [3 x i8] c"xyz", [32765 x i8] zeroinitializer }>
+
+(module
+  (memory 1)
+  (data (i32.const 256) "abc")
+  (data (i32.const 32768) "xyz")
+  (func $get (export "get") (param i32) (result i32)
+    (i32.load (local.get 0)))
+)
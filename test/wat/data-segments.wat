@@ -0,0 +1,37 @@
+;; With --split-mem, an active segment is split at long zero runs and its
+;; leading and trailing zeros are dropped. Passive segments with the same
+;; content share one blob, and each keeps its own dropped flag.
+;; RUN: %notdec-wasm2llvm --split-mem %s -o %t.ll
+;; RUN: %FileCheck %s < %t.ll
+;; RUN: %FileCheck --check-prefix=NO %s < %t.ll
+
+;; CHECK-DAG: @__notdec_data_0 = private unnamed_addr constant [4 x i8] c"same"
+;; CHECK-DAG: @__notdec_data_0_dropped = internal global i1 false
+;; CHECK-DAG: @__notdec_data_1_dropped = internal global i1 false
+;; CHECK-DAG: @__notdec_mem0_0x14 = internal {{.*}}[3 x i8] c"abc", section ".addr_0x14", align 1
+;; CHECK-DAG: @__notdec_mem0_0x5d = internal {{.*}}[3 x i8] c"def", section ".addr_0x5d", align 1
+;; NO-NOT: @__notdec_data_1 =
+;; NO-NOT: section ".addr_0x10"
+
+;; CHECK-LABEL: define void @init(
+;; CHECK: load i1, ptr @__notdec_data_0_dropped
+;; CHECK: call void @llvm.memcpy.p0.p0.i32({{.*}}@__notdec_data_0
+;; CHECK: load i1, ptr @__notdec_data_1_dropped
+;; CHECK: call void @llvm.memcpy.p0.p0.i32({{.*}}@__notdec_data_0
+
+(module
+  (memory 1)
+  (data $p1 "same")
+  (data $p2 "same")
+  ;; 4 leading zeros, "abc", a run of 70 zeros, "def" and 2 trailing zeros
+  (data (i32.const 16) "\00\00\00\00abc"
+    "\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00"
+    "\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00"
+    "\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00"
+    "\00\00\00\00\00\00\00\00\00\00"
+    "def\00\00")
+
+  (func $init (export "init") (param i32)
+    (memory.init $p1 (local.get 0) (i32.const 0) (i32.const 4))
+    (memory.init $p2 (local.get 0) (i32.const 0) (i32.const 4)))
+)
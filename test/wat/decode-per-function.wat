@@ -0,0 +1,44 @@
+;; --decode-per-function decodes each function body of a .wasm input right
+;; before it is translated, and gives the same functions as the whole module
+;; decoding.
+;; RUN: %wat2wasm %s -o %t.wasm
+;; RUN: %notdec-wasm2llvm %t.wasm -o %t.ref.ll
+;; RUN: %FileCheck %s < %t.ref.ll
+;; RUN: %notdec-wasm2llvm --decode-per-function %t.wasm -o %t.ll
+;; RUN: %FileCheck %s < %t.ll
+
+;; CHECK-LABEL: define i32 @fac(
+;; CHECK: icmp eq i32
+;; CHECK: call i32 @fac(
+;; CHECK: mul i32
+;; CHECK-LABEL: define i64 @sum(
+;; CHECK: load i64
+;; CHECK: add i64
+;; CHECK: store i64
+;; CHECK-LABEL: define i32 @pick(
+;; CHECK: add i32
+;; CHECK: %callind_funcptr = load ptr
+;; CHECK: call i32 %{{.*}}(i32 %{{.*}})
+
+(module
+  (type $unary (func (param i32) (result i32)))
+  (memory 1)
+  (table 1 funcref)
+  (elem (i32.const 0) $fac)
+  (global $acc (mut i64) (i64.const 0))
+  (func $fac (export "fac") (param i32) (result i32)
+    (if (result i32) (i32.eq (local.get 0) (i32.const 0))
+      (then (i32.const 1))
+      (else
+        (i32.mul (local.get 0)
+          (call $fac (i32.sub (local.get 0) (i32.const 1)))))))
+  (func $sum (export "sum") (param i32) (result i64)
+    (global.set $acc
+      (i64.add (global.get $acc) (i64.load (local.get 0))))
+    (global.get $acc))
+  ;; the block and call_indirect signatures come from the module's types
+  (func $pick (export "pick") (param i32) (result i32)
+    (local.get 0)
+    (block (type $unary) (i32.add (i32.const 1)))
+    (call_indirect (type $unary) (i32.const 0)))
+)
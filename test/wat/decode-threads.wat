@@ -0,0 +1,28 @@
+;; --decode-threads=N decodes the function bodies of a .wasm input on N
+;; threads ahead of the translation. The module has more functions than the
+;; window of bodies decoded ahead, and the per-function and threaded outputs
+;; must be the same as the whole module decoding, except for the output path.
+;; RUN: python3 -c 'n = 80; print("(module (type $t (func (param i32) (result i32))) (memory 1) (table " + str(n) + " funcref) (elem (i32.const 0) " + " ".join("$f%d" % i for i in range(n)) + ") (global $g (mut i32) (i32.const 0))" + "".join("(func $f%d (export \"f%d\") (type $t) (local i32) (local.set 1 (i32.load offset=%d (local.get 0))) (loop $l (local.set 1 (i32.add (local.get 1) (i32.const %d))) (br_if $l (i32.lt_u (local.get 1) (local.get 0)))) (global.set $g (local.get 1)) (if (result i32) (local.get 1) (then (call $f%d (local.get 1))) (else (call_indirect (type $t) (local.get 0) (i32.const %d)))))" % (i, i, 4 * i, i + 1, (i + 1) % n, (i + 7) % n) for i in range(n)) + ")")' > %t.wat
+;; RUN: %wat2wasm %t.wat -o %t.wasm
+;; RUN: %notdec-wasm2llvm %t.wasm -o %t.ref.ll
+;; RUN: %notdec-wasm2llvm --decode-per-function %t.wasm -o %t.per.ll
+;; RUN: %notdec-wasm2llvm --decode-per-function --decode-threads=1 %t.wasm -o %t.t1.ll
+;; RUN: %notdec-wasm2llvm --decode-per-function --decode-threads=4 %t.wasm -o %t.t4.ll
+;; RUN: grep -v -e '^; ModuleID' -e '^source_filename' %t.ref.ll > %t.ref.txt
+;; RUN: grep -v -e '^; ModuleID' -e '^source_filename' %t.per.ll > %t.per.txt
+;; RUN: grep -v -e '^; ModuleID' -e '^source_filename' %t.t1.ll > %t.t1.txt
+;; RUN: grep -v -e '^; ModuleID' -e '^source_filename' %t.t4.ll > %t.t4.txt
+;; RUN: diff %t.ref.txt %t.per.txt
+;; RUN: diff %t.ref.txt %t.t1.txt
+;; RUN: diff %t.ref.txt %t.t4.txt
+;; RUN: %FileCheck %s < %t.ref.txt
+
+;; the reference output has all the functions
+;; CHECK-LABEL: define i32 @f0(
+;; CHECK: call i32 @f1(
+;; CHECK: %callind_funcptr = load ptr
+;; CHECK-LABEL: define i32 @f79(
+;; CHECK: call i32 @f0(
+
+;; The input is generated by the first RUN line.
+(module)
@@ -0,0 +1,53 @@
+;; Exception handling is lowered to invoke/landingpad with the Itanium C++
+;; personality and the runtime functions in lib/notdec-wasm2llvm-rt.
+;; RUN: %notdec-wasm2llvm %s -o %t.ll
+;; RUN: %FileCheck %s < %t.ll
+
+(module
+  (tag $e (param i32))
+  (import "env" "may_throw" (func $may_throw))
+
+  ;; CHECK-LABEL: define void @thrower(
+  ;; CHECK: call void @__notdec_wasm_throw(i32 0, ptr %throw_payload, i32 16)
+  ;; CHECK-NEXT: unreachable
+  (func $thrower (export "thrower") (param i32)
+    (throw $e (local.get 0)))
+
+  ;; CHECK-LABEL: define i32 @catcher() personality ptr @__gxx_personality_v0
+  ;; CHECK: invoke void @{{.*}}()
+  ;; CHECK-NEXT: to label %invoke_next unwind label %try_lpad
+  ;; CHECK: try_lpad:
+  ;; CHECK-NEXT: landingpad { ptr, i32 }
+  ;; CHECK-NEXT: catch ptr null
+  ;; CHECK: try_dispatch:
+  ;; CHECK-NEXT: %exn = phi { ptr, i32 }
+  ;; CHECK: %exn_tag = call i32 @__notdec_wasm_exception_tag(ptr %exn_ptr)
+  ;; CHECK: switch i32 %exn_tag, label %try_unmatched [
+  ;; CHECK-NEXT: i32 0, label %catch
+  ;; CHECK: try_unmatched:
+  ;; CHECK-NEXT: resume { ptr, i32 } %exn
+  ;; CHECK: catch:
+  ;; CHECK: call void @__notdec_wasm_catch(ptr %exn_ptr, ptr %exn_payload, i32 16)
+  ;; CHECK: load i32, ptr %{{.*}}
+  ;; CHECK: call void @__notdec_wasm_end_catch(ptr %exn_ptr)
+  (func $catcher (export "catcher") (result i32)
+    (try (result i32)
+      (do
+        (call $may_throw)
+        (i32.const 0))
+      (catch $e)))
+
+  ;; A caught exception is not released before it is rethrown.
+  ;; CHECK-LABEL: define void @rethrower() personality ptr @__gxx_personality_v0
+  ;; CHECK: try_unmatched:
+  ;; CHECK-NEXT: br label %catch
+  ;; CHECK: catch:
+  ;; CHECK: call void @__notdec_wasm_catch(ptr %exn_ptr, ptr %exn_payload, i32 16)
+  ;; CHECK-NOT: @__notdec_wasm_end_catch
+  ;; CHECK: call void @__notdec_wasm_rethrow(ptr %exn_ptr, i32 %exn_tag, ptr %exn_payload, i32 16)
+  ;; CHECK-NEXT: unreachable
+  (func $rethrower (export "rethrower")
+    (try
+      (do (call $may_throw))
+      (catch_all (rethrow 0))))
+)
@@ -0,0 +1,20 @@
+;; Extended constant expressions are folded into the global initializer, or
+;; computed in the module constructor when they read an imported global.
+;; RUN: %notdec-wasm2llvm %s -o %t.ll
+;; RUN: %FileCheck %s < %t.ll
+
+;; CHECK-DAG: @a = internal constant i32 42
+;; CHECK-DAG: @b = internal constant i64 42
+;; CHECK-DAG: @c = internal global i32 0
+
+;; CHECK-LABEL: define internal void @__notdec_init()
+;; CHECK: [[BASE:%.*]] = load i32, ptr @{{.*}}
+;; CHECK-NEXT: [[C:%.*]] = add i32 [[BASE]], 8
+;; CHECK-NEXT: store i32 [[C]], ptr @c
+
+(module
+  (import "env" "base" (global $base i32))
+  (global $a i32 (i32.add (i32.const 40) (i32.const 2)))
+  (global $b i64 (i64.mul (i64.sub (i64.const 10) (i64.const 3)) (i64.const 6)))
+  (global $c i32 (i32.add (global.get $base) (i32.const 8)))
+)
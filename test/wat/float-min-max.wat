@@ -0,0 +1,29 @@
+;; min and max propagate NaN and order -0.0 below +0.0, which matches
+;; llvm.minimum/llvm.maximum rather than llvm.minnum/llvm.maxnum.
+;; RUN: %notdec-wasm2llvm %s -o %t.ll
+;; RUN: %FileCheck %s < %t.ll
+
+(module
+  ;; CHECK-LABEL: define float @min32(
+  ;; CHECK: call float @llvm.minimum.f32(float
+  (func $min32 (export "min32") (param f32 f32) (result f32)
+    (f32.min (local.get 0) (local.get 1)))
+
+  ;; CHECK-LABEL: define double @max64(
+  ;; CHECK: call double @llvm.maximum.f64(double
+  (func $max64 (export "max64") (param f64 f64) (result f64)
+    (f64.max (local.get 0) (local.get 1)))
+
+  ;; CHECK-LABEL: define <4 x i32> @min32x4(
+  ;; CHECK: call <4 x float> @llvm.minimum.v4f32(<4 x float>
+  (func $min32x4 (export "min32x4") (param v128 v128) (result v128)
+    (f32x4.min (local.get 0) (local.get 1)))
+
+  ;; CHECK-LABEL: define <4 x i32> @max64x2(
+  ;; CHECK: call <2 x double> @llvm.maximum.v2f64(<2 x double>
+  (func $max64x2 (export "max64x2") (param v128 v128) (result v128)
+    (f64x2.max (local.get 0) (local.get 1)))
+
+  ;; CHECK-NOT: @llvm.minnum
+  ;; CHECK-NOT: @llvm.maxnum
+)
@@ -0,0 +1,27 @@
+;; Float inequality is unordered: ne(x, NaN) is true.
+;; RUN: %notdec-wasm2llvm %s -o %t.ll
+;; RUN: %FileCheck %s < %t.ll
+
+(module
+  ;; CHECK-LABEL: define i32 @ne32(
+  ;; CHECK: fcmp une float
+  ;; CHECK-NOT: fcmp oeq
+  (func $ne32 (export "ne32") (param f32 f32) (result i32)
+    (f32.ne (local.get 0) (local.get 1)))
+
+  ;; CHECK-LABEL: define i32 @ne64(
+  ;; CHECK: fcmp une double
+  ;; CHECK-NOT: fcmp oeq
+  (func $ne64 (export "ne64") (param f64 f64) (result i32)
+    (f64.ne (local.get 0) (local.get 1)))
+
+  ;; CHECK-LABEL: define <4 x i32> @ne32x4(
+  ;; CHECK: fcmp une <4 x float>
+  (func $ne32x4 (export "ne32x4") (param v128 v128) (result v128)
+    (f32x4.ne (local.get 0) (local.get 1)))
+
+  ;; CHECK-LABEL: define <4 x i32> @ne64x2(
+  ;; CHECK: fcmp une <2 x double>
+  (func $ne64x2 (export "ne64x2") (param v128 v128) (result v128)
+    (f64x2.ne (local.get 0) (local.get 1)))
+)
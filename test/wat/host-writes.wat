@@ -0,0 +1,23 @@
+;; The host may write the buffers passed to the imports, so the data
+;; segments are only read-only with --no-host-writes.
+;; RUN: %notdec-wasm2llvm %s -o %t.ll
+;; RUN: %FileCheck %s < %t.ll
+;; RUN: %notdec-wasm2llvm --no-host-writes %s -o %t.assume.ll
+;; RUN: %FileCheck --check-prefix=ASSUME %s < %t.assume.ll
+
+(module
+  (import "env" "fd_read" (func $fd_read (param i32 i32) (result i32)))
+  (memory 1)
+  (data (i32.const 16) "\2a\00\00\00")
+
+  (func $read (export "read") (result i32)
+    (call $fd_read (i32.const 16) (i32.const 4)))
+
+  ;; CHECK-LABEL: define i32 @get(
+  ;; CHECK: load i32, ptr {{.*}}@__notdec_mem0
+  ;; ASSUME-LABEL: define i32 @get(
+  ;; ASSUME-NOT: @__notdec_mem0
+  ;; ASSUME: ret i32
+  (func $get (export "get") (result i32)
+    (i32.load (i32.const 16)))
+)
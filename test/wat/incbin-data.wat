@@ -0,0 +1,28 @@
+;; With --split-mem --incbin-data, a data piece of 64 KiB or more is written
+;; to <output>.<name>.bin and defined by the module asm. Only one of the
+;; modules written by --split-module or --stream-output keeps the module asm,
+;; so that the parts link back together.
+;; RUN: python3 -c 'print("(module (memory 2) (data (i32.const 4096) \"" + "a" * 65536 + "\") (func (export \"f\") (result i32) (i32.load (i32.const 4096))) (func (export \"g\") (param i32) (i32.store (local.get 0) (i32.const 1))))")' > %t.wat
+;; RUN: %notdec-wasm2llvm --split-mem --incbin-data %t.wat -o %t.ll
+;; RUN: %FileCheck %s < %t.ll
+;; RUN: test $(wc -c < %t.__notdec_mem0_0x1000.bin) -eq 65536
+
+;; CHECK: module asm "\09.section\09.addr_0x1000,\22aw\22,@progbits"
+;; CHECK-NEXT: module asm "\09.globl\09__notdec_mem0_0x1000"
+;; CHECK-NEXT: module asm "\09.hidden\09__notdec_mem0_0x1000"
+;; CHECK-NEXT: module asm "__notdec_mem0_0x1000:"
+;; CHECK-NEXT: module asm "\09.incbin\09\22{{.*}}incbin-data.__notdec_mem0_0x1000.bin\22"
+;; CHECK-NEXT: module asm "\09.size\09__notdec_mem0_0x1000, 65536"
+;; CHECK: @__notdec_mem0_0x1000 = external hidden global [65536 x i8], align 1
+
+;; RUN: %notdec-wasm2llvm --split-mem --incbin-data --split-module=2 %t.wat -o %t.split.bc
+;; RUN: %llvm-dis %t.split.0.bc -o - | %FileCheck --check-prefix=ASM %s
+;; RUN: %llvm-dis %t.split.1.bc -o - | %FileCheck --check-prefix=NOASM %s
+
+;; RUN: %notdec-wasm2llvm --split-mem --incbin-data --stream-output --stream-chunk-size=1 %t.wat -o %t.stream.bc
+;; RUN: %llvm-dis %t.stream.bc -o - | %FileCheck --check-prefix=ASM %s
+;; RUN: %llvm-dis %t.stream.0.bc -o - | %FileCheck --check-prefix=NOASM %s
+;; RUN: %llvm-dis %t.stream.1.bc -o - | %FileCheck --check-prefix=NOASM %s
+
+;; ASM: module asm "\09.globl\09__notdec_mem0_0x1000"
+;; NOASM-NOT: module asm
@@ -0,0 +1,58 @@
+;; --instance-context passes the state of an instance as the first argument of
+;; every function. The instance struct holds the memory base, the globals that
+;; are not shared constants, and the tables, and `__notdec_instance_init`
+;; initializes it: globals, table copy, segments, and then the start function.
+;; RUN: %notdec-wasm2llvm --instance-context %s -o %t.ll
+;; RUN: %FileCheck %s < %t.ll
+;; RUN: %FileCheck --check-prefix=FUNC %s < %t.ll
+
+;; memory base, $g, $counter, $copy ($k is shared), table
+;; CHECK: %notdec_instance = type { ptr, i32, i32, i32, %notdec_table }
+;; CHECK-NOT: @__notdec_mem0 =
+
+;; CHECK-LABEL: define void @__notdec_instance_init(ptr %instance)
+;; CHECK: [[COUNTER:%.*]] = getelementptr inbounds {{.*}}%notdec_instance, ptr %instance, i32 0, i32 2
+;; CHECK-NEXT: store i32 0, ptr [[COUNTER]]
+;; CHECK-NEXT: [[G:%.*]] = getelementptr inbounds {{.*}}%notdec_instance, ptr %instance, i32 0, i32 1
+;; CHECK-NEXT: [[GV:%.*]] = load i32, ptr [[G]]
+;; CHECK-NEXT: [[COPY:%.*]] = getelementptr inbounds {{.*}}%notdec_instance, ptr %instance, i32 0, i32 3
+;; CHECK-NEXT: store i32 [[GV]], ptr [[COPY]]
+;; CHECK-NEXT: [[T:%.*]] = getelementptr inbounds {{.*}}%notdec_instance, ptr %instance, i32 0, i32 4
+;; CHECK-NEXT: call void @__notdec_wasm_table_init(ptr [[T]], ptr @{{.*}})
+;; CHECK: call void @llvm.memcpy.p0.p0.i64(ptr align 1 %{{.*}}, ptr align 1 @__notdec_elem_0,
+;; CHECK: [[M:%.*]] = getelementptr inbounds {{.*}}%notdec_instance, ptr %instance, i32 0, i32 0
+;; CHECK-NEXT: [[BASE:%.*]] = load ptr, ptr [[M]]
+;; CHECK-NEXT: [[DEST:%.*]] = getelementptr i8, ptr [[BASE]], i64 16
+;; CHECK-NEXT: call void @llvm.memcpy.p0.p0.i64(ptr align 1 [[DEST]], ptr align 1 @__notdec_data_0, i64 2, i1 false)
+;; CHECK-NEXT: call {{.*}}void @init(ptr %instance)
+;; CHECK-NEXT: ret void
+
+;; FUNC: declare void @log(ptr{{.*}}, i32{{.*}})
+;; FUNC-LABEL: define i32 @bump(ptr %instance, i32 %_arg_0)
+;; FUNC: [[M:%.*]] = getelementptr inbounds {{.*}}%notdec_instance, ptr %instance, i32 0, i32 0
+;; FUNC-NEXT: %mem_base = load ptr, ptr [[M]]
+;; FUNC: getelementptr inbounds {{.*}}%notdec_instance, ptr %instance, i32 0, i32 2
+;; FUNC: call void @log(ptr %instance, i32 %{{.*}})
+;; FUNC: getelementptr i8, ptr %mem_base,
+;; FUNC-LABEL: define internal {{.*}}void @init(ptr %instance)
+;; FUNC: getelementptr inbounds {{.*}}%notdec_instance, ptr %instance, i32 0, i32 3
+
+(module
+  (import "env" "log" (func $log (param i32)))
+  (import "env" "g" (global $g i32))
+  (memory 1)
+  (table 2 funcref)
+  (global $counter (mut i32) (i32.const 0))
+  (global $k i32 (i32.const 42))
+  (global $copy i32 (global.get $g))
+  (elem (global.get $g) $bump)
+  (data (i32.const 16) "hi")
+  (start $init)
+  (func $bump (export "bump") (param i32) (result i32)
+    (global.set $counter
+      (i32.add (global.get $counter) (local.get 0)))
+    (call $log (global.get $counter))
+    (i32.load (local.get 0)))
+  (func $init
+    (global.set $counter (global.get $copy)))
+)
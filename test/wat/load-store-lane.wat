@@ -0,0 +1,24 @@
+;; load_lane and store_lane pop the vector before the address and apply
+;; the memarg offset to the address.
+;; RUN: %notdec-wasm2llvm %s -o %t.ll
+;; RUN: %FileCheck %s < %t.ll
+
+(module
+  (memory 1)
+
+  ;; CHECK-LABEL: define <4 x i32> @load_lane(
+  ;; CHECK: %calcOffset = add i32 %{{.*}}, 8
+  ;; CHECK: [[P:%.*]] = getelementptr {{.*}}@__notdec_mem0, i32 0, i32 %calcOffset
+  ;; CHECK: [[X:%.*]] = load i32, ptr [[P]], align 1
+  ;; CHECK: insertelement <4 x i32> %{{.*}}, i32 [[X]], i64 1
+  (func $load_lane (export "load_lane") (param i32 v128) (result v128)
+    (v128.load32_lane offset=8 1 (local.get 0) (local.get 1)))
+
+  ;; CHECK-LABEL: define void @store_lane(
+  ;; CHECK: %calcOffset = add i32 %{{.*}}, 4
+  ;; CHECK: [[P:%.*]] = getelementptr {{.*}}@__notdec_mem0, i32 0, i32 %calcOffset
+  ;; CHECK: [[X:%.*]] = extractelement <8 x i16> %{{.*}}, i64 3
+  ;; CHECK: store i16 [[X]], ptr [[P]], align 1
+  (func $store_lane (export "store_lane") (param i32 v128)
+    (v128.store16_lane offset=4 3 (local.get 0) (local.get 1)))
+)
@@ -0,0 +1,18 @@
+;; A loop parameter becomes a phi in the loop header whose first incoming
+;; edge comes from the block that enters the loop.
+;; RUN: %notdec-wasm2llvm %s -o %t.ll
+;; RUN: %FileCheck %s < %t.ll
+
+(module
+  ;; CHECK-LABEL: define i32 @count(
+  ;; CHECK: allocator:
+  ;; CHECK: br label %loop_entry
+  ;; CHECK: loop_entry:
+  ;; CHECK-NEXT: %loop_entry_0 = phi i32 [ %{{.*}}, %allocator ], [ %{{.*}}, %loop_entry ]
+  (func $count (export "count") (param i32) (result i32)
+    (local.get 0)
+    (loop $l (param i32) (result i32)
+      (i32.sub (i32.const 1))
+      (local.tee 0)
+      (br_if $l (local.get 0))))
+)
@@ -0,0 +1,20 @@
+;; Without validation, malformed function bodies stop the translation with a
+;; clean error instead of a crash.
+;; RUN: python3 %S/Inputs/malformed.py stack %t.stack.wasm
+;; RUN: ! %notdec-wasm2llvm --no-validate %t.stack.wasm -o %t.ll 2> %t.stack.err
+;; RUN: %FileCheck --check-prefix=STACK %s < %t.stack.err
+;; RUN: ! %notdec-wasm2llvm --decode-per-function %t.stack.wasm -o %t.ll 2> %t.decode.err
+;; RUN: %FileCheck --check-prefix=STACK %s < %t.decode.err
+;; RUN: python3 %S/Inputs/malformed.py branch %t.branch.wasm
+;; RUN: ! %notdec-wasm2llvm --no-validate %t.branch.wasm -o %t.ll 2> %t.branch.err
+;; RUN: %FileCheck --check-prefix=BRANCH %s < %t.branch.err
+;; RUN: python3 %S/Inputs/malformed.py local %t.local.wasm
+;; RUN: ! %notdec-wasm2llvm --no-validate %t.local.wasm -o %t.ll 2> %t.local.err
+;; RUN: %FileCheck --check-prefix=LOCAL %s < %t.local.err
+
+;; STACK: Error: Malformed function body of f: value stack underflow
+;; BRANCH: Error: Malformed function body of f: branch depth 5 out of range
+;; LOCAL: Error: Malformed function body of f: local 7 out of range
+
+;; The inputs are binaries written by Inputs/malformed.py.
+(module)
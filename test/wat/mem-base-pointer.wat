@@ -0,0 +1,70 @@
+;; --mem-base-pointer accesses the memory through @__notdec_mem0_base, loaded
+;; once in the entry block of each function and indexed by the zero extended
+;; address. The stack frame lifting and the read-only data folding start from
+;; that load.
+;; RUN: %notdec-wasm2llvm --mem-base-pointer --lift-stack-frames %s -o %t.ll
+;; RUN: %FileCheck %s < %t.ll
+
+;; CHECK: @__notdec_mem0_base = global ptr @__notdec_mem0
+
+(module
+  (memory 1)
+  (global $__stack_pointer (mut i32) (i32.const 65536))
+  (data (i32.const 16)
+    "\01\00\00\00\02\00\00\00\03\00\00\00\04\00\00\00"
+    "\05\00\00\00\06\00\00\00\07\00\00\00\08\00\00\00")
+
+  ;; CHECK-LABEL: define i32 @sum(
+  ;; CHECK-NEXT: allocator:
+  ;; CHECK: %mem_base = load ptr, ptr @__notdec_mem0_base
+  ;; CHECK-NOT: @__notdec_mem0_base
+  ;; CHECK: [[A:%.*]] = zext i32 %{{.*}} to i64
+  ;; CHECK-NEXT: [[P:%.*]] = getelementptr i8, ptr %mem_base, i64 [[A]]
+  ;; CHECK-NEXT: load i32, ptr [[P]]
+  ;; CHECK-NOT: @__notdec_mem0_base
+  ;; CHECK: [[B:%.*]] = zext i32 %{{.*}} to i64
+  ;; CHECK-NEXT: [[Q:%.*]] = getelementptr i8, ptr %mem_base, i64 [[B]]
+  ;; CHECK-NEXT: load i32, ptr [[Q]]
+  ;; CHECK-NOT: @__notdec_mem0_base
+  ;; CHECK: ret i32
+  (func $sum (export "sum") (param i32) (result i32)
+    (i32.add
+      (i32.load offset=4 (local.get 0))
+      (i32.load offset=8 (local.get 0))))
+
+  ;; CHECK-LABEL: define i32 @frame(
+  ;; CHECK-NEXT: allocator:
+  ;; CHECK-NEXT: %stack_frame = alloca [16 x i8], align 16
+  ;; CHECK: %mem_base = load ptr, ptr @__notdec_mem0_base
+  ;; CHECK-NOT: getelementptr i8, ptr %mem_base
+  ;; CHECK: [[P:%.*]] = getelementptr i8, ptr %stack_frame, i32 12
+  ;; CHECK-NEXT: store i32 %{{.*}}, ptr [[P]]
+  ;; CHECK-NOT: getelementptr i8, ptr %mem_base
+  ;; CHECK: [[Q:%.*]] = getelementptr i8, ptr %stack_frame, i32 12
+  ;; CHECK-NEXT: load i32, ptr [[Q]]
+  ;; CHECK-NOT: getelementptr i8, ptr %mem_base
+  ;; CHECK: ret i32
+  (func $frame (export "frame") (param i32) (result i32)
+    (local i32)
+    (global.set $__stack_pointer
+      (local.tee 1 (i32.sub (global.get $__stack_pointer) (i32.const 16))))
+    (i32.store offset=12 (local.get 1) (local.get 0))
+    (local.set 0 (i32.load offset=12 (local.get 1)))
+    (global.set $__stack_pointer (i32.add (local.get 1) (i32.const 16)))
+    (local.get 0))
+
+  ;; CHECK-LABEL: define i32 @get(
+  ;; CHECK-NOT: load i32
+  ;; CHECK: ret i32
+  (func $get (export "get") (result i32)
+    (i32.load (i32.const 20)))
+
+  ;; CHECK-LABEL: define i32 @lookup(
+  ;; CHECK: icmp eq i32 %calcOffset, 20
+  ;; CHECK-NEXT: %rodata_select = select i1 %{{.*}}, i32 2, i32 1
+  ;; CHECK-NOT: load i32, ptr %{{.*}}
+  ;; CHECK: ret i32
+  (func $lookup (export "lookup") (param i32) (result i32)
+    (i32.load offset=16
+      (i32.shl (i32.and (local.get 0) (i32.const 7)) (i32.const 2))))
+)
@@ -0,0 +1,16 @@
+;; memory.copy allows overlapping ranges, so it is lowered to memmove.
+;; RUN: %notdec-wasm2llvm %s -o %t.ll
+;; RUN: %FileCheck %s < %t.ll
+
+(module
+  (memory 1)
+
+  ;; CHECK-LABEL: define void @shift(
+  ;; CHECK: call void @llvm.memmove.p0.p0.i32(ptr align 1 %{{.*}}, ptr align 1 %{{.*}}, i32 %{{.*}}, i1 false)
+  ;; CHECK-NOT: @llvm.memcpy
+  (func $shift (export "shift") (param i32 i32)
+    (memory.copy
+      (i32.add (local.get 0) (i32.const 1))
+      (local.get 0)
+      (local.get 1)))
+)
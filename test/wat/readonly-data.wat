@@ -0,0 +1,30 @@
+;; Loads from active data segments that are never written are folded, and a
+;; load from a table indexed by a masked and shifted value becomes a select
+;; chain over the table entries, stepped by the entry size.
+;; RUN: %notdec-wasm2llvm %s -o %t.ll
+;; RUN: %FileCheck %s < %t.ll
+
+(module
+  (memory 1)
+  (data (i32.const 16)
+    "\01\00\00\00\02\00\00\00\03\00\00\00\04\00\00\00"
+    "\05\00\00\00\06\00\00\00\07\00\00\00\08\00\00\00")
+
+  ;; CHECK-LABEL: define i32 @get(
+  ;; CHECK-NOT: @__notdec_mem0
+  ;; CHECK: ret i32
+  (func $get (export "get") (result i32)
+    (i32.load (i32.const 20)))
+
+  ;; CHECK-LABEL: define i32 @lookup(
+  ;; CHECK: icmp eq i32 %calcOffset, 20
+  ;; CHECK-NEXT: %rodata_select = select i1 %{{.*}}, i32 2, i32 1
+  ;; CHECK-NEXT: icmp eq i32 %calcOffset, 24
+  ;; CHECK-NEXT: select i1 %{{.*}}, i32 3, i32 %rodata_select
+  ;; CHECK: icmp eq i32 %calcOffset, 44
+  ;; CHECK-NEXT: select i1 %{{.*}}, i32 8, i32 %rodata_select
+  ;; CHECK-NOT: icmp eq i32 %calcOffset
+  (func $lookup (export "lookup") (param i32) (result i32)
+    (i32.load offset=16
+      (i32.shl (i32.and (local.get 0) (i32.const 7)) (i32.const 2))))
+)
@@ -0,0 +1,20 @@
+;; The relaxed truncations return INT_MIN for NaN and out of range lanes in
+;; the signed case, and saturate in the unsigned case.
+;; RUN: %notdec-wasm2llvm %s -o %t.ll
+;; RUN: %FileCheck %s < %t.ll
+
+(module
+  ;; CHECK-LABEL: define <4 x i32> @trunc_s(
+  ;; CHECK: fcmp oge <4 x float>
+  ;; CHECK: fcmp olt <4 x float>
+  ;; CHECK: fptosi <4 x float> %{{.*}} to <4 x i32>
+  ;; CHECK: select <4 x i1> %{{.*}}, <4 x i32> %{{.*}}, <4 x i32> splat (i32 -2147483648)
+  ;; CHECK-NOT: freeze
+  (func $trunc_s (export "trunc_s") (param v128) (result v128)
+    (i32x4.relaxed_trunc_f32x4_s (local.get 0)))
+
+  ;; CHECK-LABEL: define <4 x i32> @trunc_u(
+  ;; CHECK: call <4 x i32> @llvm.fptoui.sat.v4i32.v4f32(<4 x float>
+  (func $trunc_u (export "trunc_u") (param v128) (result v128)
+    (i32x4.relaxed_trunc_f32x4_u (local.get 0)))
+)
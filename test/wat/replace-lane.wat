@@ -0,0 +1,17 @@
+;; replace_lane on i8 and i16 lanes keeps the low bits of the i32 operand.
+;; RUN: %notdec-wasm2llvm %s -o %t.ll
+;; RUN: %FileCheck %s < %t.ll
+
+(module
+  ;; CHECK-LABEL: define <4 x i32> @replace8(
+  ;; CHECK: [[X:%.*]] = trunc i32 %{{.*}} to i8
+  ;; CHECK: insertelement <16 x i8> %{{.*}}, i8 [[X]], i64 5
+  (func $replace8 (export "replace8") (param v128 i32) (result v128)
+    (i8x16.replace_lane 5 (local.get 0) (local.get 1)))
+
+  ;; CHECK-LABEL: define <4 x i32> @replace16(
+  ;; CHECK: [[X:%.*]] = trunc i32 %{{.*}} to i16
+  ;; CHECK: insertelement <8 x i16> %{{.*}}, i16 [[X]], i64 7
+  (func $replace16 (export "replace16") (param v128 i32) (result v128)
+    (i16x8.replace_lane 7 (local.get 0) (local.get 1)))
+)
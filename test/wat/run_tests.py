@@ -0,0 +1,85 @@
+#!/usr/bin/env python3
+# Run the .wat test cases. Each case lists its commands in `;; RUN:` lines,
+# which are run by the shell in order, and checks the output with FileCheck.
+#
+# Substitutions in the RUN lines:
+#   %notdec-wasm2llvm, %FileCheck, %wat2wasm, %llvm-dis, %llvm-as: the tools
+#   %s: the test case, %S: the directory of the test case,
+#   %t: a temporary path prefix for the test case
+import argparse
+import os
+import subprocess
+import sys
+
+RED = '\033[0;34m'
+NC = '\033[0m'  # No Color
+
+
+def get_run_lines(path):
+    lines = []
+    with open(path) as f:
+        for line in f:
+            line = line.strip()
+            if line.startswith(';; RUN:'):
+                lines.append(line[len(';; RUN:'):].strip())
+    return lines
+
+
+def run_case(path, tools, out_dir):
+    name = os.path.splitext(os.path.basename(path))[0]
+    subs = dict(tools)
+    subs['%s'] = path
+    subs['%S'] = os.path.dirname(os.path.abspath(path))
+    subs['%t'] = os.path.join(out_dir, name)
+    lines = get_run_lines(path)
+    if len(lines) == 0:
+        print(RED + "No RUN line in " + path + NC)
+        return False
+    for line in lines:
+        # longer names first, so that no name is replaced by a prefix
+        for key in sorted(subs, key=len, reverse=True):
+            line = line.replace(key, subs[key])
+        p = subprocess.run(line, shell=True, stdout=subprocess.PIPE,
+                           stderr=subprocess.STDOUT)
+        if p.returncode != 0:
+            print(p.stdout.decode(errors='replace'))
+            print(RED + "Failed: " + name + NC)
+            print("command: " + line)
+            return False
+    print(RED + "Pass: " + name + NC)
+    return True
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--notdec-wasm2llvm', required=True)
+    parser.add_argument('--filecheck', required=True)
+    parser.add_argument('--wat2wasm', required=True)
+    parser.add_argument('--llvm-dis', required=True)
+    parser.add_argument('--llvm-as', required=True)
+    parser.add_argument('--out', required=True)
+    parser.add_argument('cases', nargs='+',
+                        help='test cases, or directories of them')
+    args = parser.parse_args()
+
+    tools = {
+        '%notdec-wasm2llvm': args.notdec_wasm2llvm,
+        '%FileCheck': args.filecheck,
+        '%wat2wasm': args.wat2wasm,
+        '%llvm-dis': args.llvm_dis,
+        '%llvm-as': args.llvm_as,
+    }
+    cases = []
+    for case in args.cases:
+        if os.path.isdir(case):
+            cases += sorted(os.path.join(case, f) for f in os.listdir(case)
+                            if f.endswith('.wat'))
+        else:
+            cases.append(case)
+    os.makedirs(args.out, exist_ok=True)
+    failed = [c for c in cases if not run_case(c, tools, args.out)]
+    print("%d of %d test cases passed." % (len(cases) - len(failed),
+                                           len(cases)))
+    for c in failed:
+        print("  failed: " + c)
+    sys.exit(1 if failed else 0)
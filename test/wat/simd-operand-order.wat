@@ -0,0 +1,22 @@
+;; Binary v128 operations take the first pushed operand as the left
+;; operand.
+;; RUN: %notdec-wasm2llvm %s -o %t.ll
+;; RUN: %FileCheck %s < %t.ll
+
+(module
+  ;; CHECK-LABEL: define <4 x i32> @sub(
+  ;; CHECK-DAG: [[A:%.*]] = load <4 x i32>, ptr %_param_0
+  ;; CHECK-DAG: [[B:%.*]] = load <4 x i32>, ptr %_param_1
+  ;; CHECK: sub <4 x i32> [[A]], [[B]]
+  (func $sub (export "sub") (param v128 v128) (result v128)
+    (i32x4.sub (local.get 0) (local.get 1)))
+
+  ;; CHECK-LABEL: define <4 x i32> @lt(
+  ;; CHECK-DAG: [[A:%.*]] = load <4 x i32>, ptr %_param_0
+  ;; CHECK-DAG: [[B:%.*]] = load <4 x i32>, ptr %_param_1
+  ;; CHECK-DAG: [[L:%.*]] = bitcast <4 x i32> [[A]] to <4 x float>
+  ;; CHECK-DAG: [[R:%.*]] = bitcast <4 x i32> [[B]] to <4 x float>
+  ;; CHECK: fcmp olt <4 x float> [[L]], [[R]]
+  (func $lt (export "lt") (param v128 v128) (result v128)
+    (f32x4.lt (local.get 0) (local.get 1)))
+)
@@ -0,0 +1,24 @@
+;; v128 values are lowered to <4 x i32> and bitcast to the lane type of each
+;; operation.
+;; RUN: %notdec-wasm2llvm %s -o %t.ll
+;; RUN: %FileCheck %s < %t.ll
+
+(module
+  ;; CHECK-LABEL: define <4 x i32> @add(<4 x i32> %_arg_0, <4 x i32> %_arg_1)
+  ;; CHECK: add <16 x i8>
+  ;; CHECK: ret <4 x i32>
+  (func $add (export "add") (param v128 v128) (result v128)
+    (i8x16.add (local.get 0) (local.get 1)))
+
+  ;; CHECK-LABEL: define <4 x i32> @splat(i32 %_arg_0)
+  ;; CHECK: insertelement <2 x i64>
+  ;; CHECK: shufflevector <2 x i64>
+  (func $splat (export "splat") (param i32) (result v128)
+    (i64x2.splat (i64.extend_i32_u (local.get 0))))
+
+  ;; CHECK-LABEL: define i32 @extract(<4 x i32> %_arg_0)
+  ;; CHECK: extractelement <8 x i16> %{{.*}}, i64 3
+  ;; CHECK: sext i16 %{{.*}} to i32
+  (func $extract (export "extract") (param v128) (result i32)
+    (i16x8.extract_lane_s 3 (local.get 0)))
+)
@@ -0,0 +1,25 @@
+;; --split-module=N writes the functions to N partitions listed in the
+;; manifest. The global variables are kept in the first partition.
+;; RUN: %notdec-wasm2llvm --split-module=2 %s -o %t.bc
+;; RUN: %FileCheck --check-prefix=MANIFEST %s < %t.manifest
+;; RUN: %llvm-dis %t.0.bc -o %t.0.ll
+;; RUN: %llvm-dis %t.1.bc -o %t.1.ll
+;; RUN: %FileCheck --check-prefix=PART0 %s < %t.0.ll
+;; RUN: cat %t.0.ll %t.1.ll | %FileCheck %s
+
+;; MANIFEST: {{.*}}split-module.0.bc
+;; MANIFEST-NEXT: {{.*}}split-module.1.bc
+
+;; PART0: @__notdec_mem0 = hidden global
+
+;; CHECK-DAG: define i32 @first(
+;; CHECK-DAG: define i32 @second(
+
+(module
+  (memory 1)
+  (func $first (export "first") (param i32) (result i32)
+    (i32.load (i32.add (local.get 0) (i32.const 4))))
+  (func $second (export "second") (param i32) (result i32)
+    (i32.store (local.get 0) (i32.const 7))
+    (i32.mul (local.get 0) (i32.const 2)))
+)
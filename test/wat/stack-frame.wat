@@ -0,0 +1,42 @@
+;; --lift-stack-frames rewrites the shadow stack frame of a function to an
+;; alloca. Only the locals holding the frame base are promoted, and the
+;; functions without a frame are left alone.
+;; RUN: %notdec-wasm2llvm --lift-stack-frames %s -o %t.ll
+;; RUN: %FileCheck %s < %t.ll
+
+(module
+  (memory 1)
+  (global $__stack_pointer (mut i32) (i32.const 65536))
+
+  ;; CHECK-LABEL: define i32 @frame(
+  ;; CHECK-NEXT: allocator:
+  ;; CHECK-NEXT: %stack_frame = alloca [16 x i8], align 16
+  ;; CHECK-NEXT: %_param_0 = alloca i32
+  ;; CHECK-NOT: %_local_1
+  ;; CHECK-NOT: @__notdec_mem0
+  ;; CHECK: [[P:%.*]] = getelementptr i8, ptr %stack_frame, i32 12
+  ;; CHECK-NEXT: store i32 %{{.*}}, ptr [[P]]
+  ;; CHECK-NOT: @__notdec_mem0
+  ;; CHECK: [[Q:%.*]] = getelementptr i8, ptr %stack_frame, i32 12
+  ;; CHECK-NEXT: load i32, ptr [[Q]]
+  ;; CHECK-NOT: @__notdec_mem0
+  ;; CHECK: store i32 %{{.*}}, ptr @__stack_pointer
+  ;; CHECK: ret i32
+  (func $frame (export "frame") (param i32) (result i32)
+    (local i32)
+    (global.set $__stack_pointer
+      (local.tee 1 (i32.sub (global.get $__stack_pointer) (i32.const 16))))
+    (i32.store offset=12 (local.get 1) (local.get 0))
+    (local.set 0 (i32.load offset=12 (local.get 1)))
+    (global.set $__stack_pointer (i32.add (local.get 1) (i32.const 16)))
+    (local.get 0))
+
+  ;; CHECK-LABEL: define i32 @no_frame(
+  ;; CHECK-NEXT: allocator:
+  ;; CHECK-NEXT: %_param_0 = alloca i32
+  ;; CHECK-NEXT: %_local_1 = alloca i32
+  (func $no_frame (export "no_frame") (param i32) (result i32)
+    (local i32)
+    (local.set 1 (local.get 0))
+    (local.get 1))
+)
@@ -0,0 +1,33 @@
+;; The module constructor __notdec_init is registered in llvm.global_ctors and
+;; follows the instantiation order of wasm: the globals, the elem segments,
+;; the data segments, and then the start function.
+;; RUN: %notdec-wasm2llvm %s -o %t.ll
+;; RUN: %FileCheck %s < %t.ll
+
+;; CHECK: @llvm.global_ctors = appending global [1 x { i32, ptr, ptr }] [{ i32, ptr, ptr } { i32 65535, ptr @__notdec_init, ptr null }]
+
+;; CHECK-LABEL: define internal void @__notdec_init()
+;; CHECK-NEXT: entry:
+;; CHECK-NEXT: [[G:%.*]] = load i32, ptr @g
+;; CHECK-NEXT: store i32 [[G]], ptr @copy
+;; CHECK-NEXT: load i32, ptr @table_base
+;; CHECK: call void @llvm.memcpy.p0.p0.i64(ptr align 1 %{{.*}}, ptr align 1 @__notdec_elem_0,
+;; CHECK-NEXT: [[MB:%.*]] = load i32, ptr @memory_base
+;; CHECK-NEXT: [[DEST:%.*]] = getelementptr [65536 x i8], ptr @__notdec_mem0, i32 0, i32 [[MB]]
+;; CHECK-NEXT: call void @llvm.memcpy.p0.p0.i64(ptr align 1 [[DEST]], ptr align 1 @__notdec_data_0, i64 5, i1 false)
+;; CHECK-NEXT: call void @start()
+;; CHECK-NEXT: ret void
+
+(module
+  (import "env" "__memory_base" (global $memory_base i32))
+  (import "env" "__table_base" (global $table_base i32))
+  (import "env" "g" (global $g i32))
+  (memory 1)
+  (table 4 funcref)
+  (global $copy (mut i32) (global.get $g))
+  (elem (global.get $table_base) $start)
+  (data (global.get $memory_base) "hello")
+  (start $start)
+  (func $start
+    (global.set $copy (i32.const 1)))
+)
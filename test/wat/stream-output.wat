@@ -0,0 +1,27 @@
+;; --stream-output writes the functions to <output>.<n>.bc as they are
+;; translated, and the main module only keeps their declarations.
+;; RUN: %notdec-wasm2llvm --stream-output --stream-chunk-size=1 %s -o %t.bc
+;; RUN: %llvm-dis %t.0.bc -o - | %FileCheck --check-prefix=CHUNK0 %s
+;; RUN: %llvm-dis %t.1.bc -o - | %FileCheck --check-prefix=CHUNK1 %s
+;; RUN: %llvm-dis %t.bc -o %t.ll
+;; RUN: %FileCheck --check-prefix=MAIN %s < %t.ll
+;; RUN: %FileCheck --check-prefix=NODEF %s < %t.ll
+
+;; CHUNK0: define i32 @first(
+;; CHUNK0: call i32 @second(
+;; CHUNK0: declare i32 @second(
+
+;; CHUNK1-NOT: @first
+;; CHUNK1: define i32 @second(
+;; CHUNK1-NOT: @first
+
+;; MAIN-DAG: declare i32 @first(
+;; MAIN-DAG: declare i32 @second(
+;; NODEF-NOT: define
+
+(module
+  (func $first (export "first") (param i32) (result i32)
+    (call $second (i32.add (local.get 0) (i32.const 1))))
+  (func $second (export "second") (param i32) (result i32)
+    (i32.mul (local.get 0) (i32.const 2)))
+)
@@ -0,0 +1,43 @@
+;; table.grow and table.fill call the runtime library, and the table
+;; accesses trap when they are out of the table.
+;; RUN: %notdec-wasm2llvm %s -o %t.ll
+;; RUN: %FileCheck %s < %t.ll
+
+(module
+  (table $t 1 funcref)
+
+  ;; CHECK-LABEL: define i32 @grow(
+  ;; CHECK: %table_grow = call i32 @__notdec_wasm_table_grow(ptr @{{.*}}, ptr %{{.*}}, i32 %{{.*}})
+  ;; CHECK: ret i32
+  (func $grow (export "grow") (param funcref i32) (result i32)
+    (table.grow $t (local.get 0) (local.get 1)))
+
+  ;; CHECK-LABEL: define void @fill(
+  ;; CHECK: %table_size = load i32
+  ;; CHECK: %table_oob = icmp ugt i64
+  ;; CHECK: br i1 %table_oob, label %trap, label %trap_next
+  ;; CHECK: trap:
+  ;; CHECK-NEXT: call void @llvm.trap()
+  ;; CHECK: trap_next:
+  ;; CHECK: %table_elems = load ptr
+  ;; CHECK: call void @__notdec_wasm_table_fill(ptr %{{.*}}, ptr %{{.*}}, i32 %{{.*}})
+  (func $fill (export "fill") (param i32 funcref i32)
+    (table.fill $t (local.get 0) (local.get 1) (local.get 2)))
+
+  ;; CHECK-LABEL: define ptr @get(
+  ;; CHECK: br i1 %table_oob, label %trap, label %trap_next
+  ;; CHECK: trap_next:
+  ;; CHECK: %table_elems = load ptr
+  ;; CHECK: [[P:%.*]] = getelementptr ptr, ptr %table_elems, i64 %{{.*}}
+  ;; CHECK: load ptr, ptr [[P]]
+  (func $get (export "get") (param i32) (result funcref)
+    (table.get $t (local.get 0)))
+
+  ;; CHECK-LABEL: define void @set(
+  ;; CHECK: br i1 %table_oob, label %trap, label %trap_next
+  ;; CHECK: trap_next:
+  ;; CHECK: [[P:%.*]] = getelementptr ptr, ptr %table_elems, i64 %{{.*}}
+  ;; CHECK: store ptr %{{.*}}, ptr [[P]]
+  (func $set (export "set") (param i32 funcref)
+    (table.set $t (local.get 0) (local.get 1)))
+)
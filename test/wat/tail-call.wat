@@ -0,0 +1,42 @@
+;; return_call between internal functions is a guaranteed tail call, even when
+;; the prototypes differ.
+;; RUN: %notdec-wasm2llvm %s -o %t.ll
+;; RUN: %FileCheck %s < %t.ll
+
+(module
+  (table 1 funcref)
+  (elem (i32.const 0) $d)
+
+  ;; CHECK-LABEL: define internal tailcc i32 @a(
+  ;; CHECK: musttail call tailcc i32 @b(i64
+  ;; CHECK-NEXT: ret i32
+  (func $a (param i32) (result i32)
+    (return_call $b (i64.extend_i32_u (local.get 0)) (local.get 0)))
+
+  ;; CHECK-LABEL: define internal tailcc i32 @b(
+  (func $b (param i64 i32) (result i32)
+    (local.get 1))
+
+  ;; the exported function keeps the C calling convention, so the tail call
+  ;; with a different prototype is only a hint
+  ;; CHECK-LABEL: define i32 @c(
+  ;; CHECK: {{ }}tail call tailcc i32 @b(i64
+  (func $c (export "c") (param i32) (result i32)
+    (return_call $b (i64.const 0) (local.get 0)))
+
+  ;; the same prototype and calling convention
+  ;; CHECK-LABEL: define i32 @c2(
+  ;; CHECK: musttail call i32 @d(i32
+  (func $c2 (export "c2") (param i32) (result i32)
+    (return_call $d (local.get 0)))
+
+  ;; referenced by the table
+  ;; CHECK-LABEL: define internal i32 @d(
+  (func $d (param i32) (result i32)
+    (local.get 0))
+
+  ;; CHECK-LABEL: define i32 @run(
+  ;; CHECK: call tailcc i32 @a(i32
+  (func $run (export "run") (param i32) (result i32)
+    (call $a (local.get 0)))
+)
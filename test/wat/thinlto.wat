@@ -0,0 +1,27 @@
+;; --thinlto writes the module summary, and the output takes the target of
+;; the --link-host module, since a native ThinLTO link rejects wasm32.
+;; RUN: %notdec-wasm2llvm --thinlto --link-host %S/Inputs/host.ll %s -o %t.bc
+;; RUN: %llvm-dis %t.bc -o - | %FileCheck %s
+;; RUN: %notdec-wasm2llvm --thinlto --link-host %S/Inputs/host.ll --stream-output --stream-chunk-size=1 %s -o %t.stream.bc
+;; RUN: %llvm-dis %t.stream.bc -o - | %FileCheck --check-prefix=REST %s
+;; RUN: %llvm-dis %t.stream.0.bc -o - | %FileCheck --check-prefix=CHUNK %s
+;; RUN: ! %notdec-wasm2llvm --thinlto %s -o %t.wasm32.bc
+
+;; CHECK: target triple = "x86_64-unknown-linux-gnu"
+;; CHECK: ^0 = module: (path:
+;; CHECK: gv: (name: "f"
+
+;; REST: target triple = "x86_64-unknown-linux-gnu"
+;; REST: declare i32 @f(
+;; REST: ^0 = module: (path:
+
+;; CHUNK: target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-i128:128-f80:128-n8:16:32:64-S128"
+;; CHUNK: target triple = "x86_64-unknown-linux-gnu"
+;; CHUNK: define i32 @f(
+;; CHUNK: ^0 = module: (path:
+;; CHUNK: gv: (name: "f"
+
+(module
+  (func $f (export "f") (result i32)
+    (i32.const 7))
+)
@@ -0,0 +1,42 @@
+;; The trapping float-to-int truncations check the range before fptosi/fptoui,
+;; and the saturating ones use the saturating intrinsics.
+;; RUN: %notdec-wasm2llvm %s -o %t.ll
+;; RUN: %FileCheck %s < %t.ll
+
+(module
+  ;; CHECK-LABEL: define i32 @trunc_s(
+  ;; CHECK: fcmp ult float
+  ;; CHECK: fcmp uge float
+  ;; CHECK: %trunc_invalid = or i1
+  ;; CHECK: br i1 %trunc_invalid, label %trap, label %trap_next
+  ;; CHECK: call void @llvm.trap()
+  ;; CHECK: fptosi float %{{.*}} to i32
+  (func $trunc_s (export "trunc_s") (param f32) (result i32)
+    (i32.trunc_f32_s (local.get 0)))
+
+  ;; f64 represents -2^31 - 1 exactly, so it is the exclusive lower bound
+  ;; CHECK-LABEL: define i32 @trunc_s_f64(
+  ;; CHECK: fcmp ule double %{{.*}}, -2.147483649e+09
+  ;; CHECK: fptosi double %{{.*}} to i32
+  (func $trunc_s_f64 (export "trunc_s_f64") (param f64) (result i32)
+    (i32.trunc_f64_s (local.get 0)))
+
+  ;; values in (-1, 0) truncate to 0
+  ;; CHECK-LABEL: define i64 @trunc_u(
+  ;; CHECK: fcmp ule double %{{.*}}, -1.000000e+00
+  ;; CHECK: fptoui double %{{.*}} to i64
+  (func $trunc_u (export "trunc_u") (param f64) (result i64)
+    (i64.trunc_f64_u (local.get 0)))
+
+  ;; CHECK-LABEL: define i32 @trunc_sat_s(
+  ;; CHECK-NOT: @llvm.trap
+  ;; CHECK: call i32 @llvm.fptosi.sat.i32.f32(float
+  (func $trunc_sat_s (export "trunc_sat_s") (param f32) (result i32)
+    (i32.trunc_sat_f32_s (local.get 0)))
+
+  ;; CHECK-LABEL: define i64 @trunc_sat_u(
+  ;; CHECK-NOT: @llvm.trap
+  ;; CHECK: call i64 @llvm.fptoui.sat.i64.f64(double
+  (func $trunc_sat_u (export "trunc_sat_u") (param f64) (result i64)
+    (i64.trunc_sat_f64_u (local.get 0)))
+)
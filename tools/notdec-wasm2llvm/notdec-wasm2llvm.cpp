@@ -11,7 +11,11 @@
 #include <llvm/Support/SourceMgr.h>
 #include <llvm/Support/raw_ostream.h>
 
+#include "ir-writer.h"
+#include "link-host.h"
 #include "parser.h"
+#include "split-module.h"
+#include "stream-output.h"
 #include "utils.h"
 
 using namespace llvm;
@@ -39,6 +43,36 @@ static cl::opt<log_level>
                         clEnumValN(level_debug, "debug", "debug")),
              cl::init(level_notice));
 
+static cl::list<std::string>
+    linkHost("link-host",
+             cl::desc("Link the host implementations of the imported "
+                      "functions, and mark the small ones always inline."),
+             cl::value_desc("file.bc"));
+
+static cl::opt<bool> streamOutput(
+    "stream-output",
+    cl::desc("Write the functions to <output>.<n>.bc as soon as they are "
+             "translated, to bound the memory usage. Requires .bc output."),
+    cl::init(false));
+
+static cl::opt<unsigned> streamChunkSize(
+    "stream-chunk-size",
+    cl::desc("Number of instructions per chunk with --stream-output"),
+    cl::init(65536));
+
+static cl::opt<unsigned> splitParts(
+    "split-module",
+    cl::desc("Split the output into N balanced bitcode files "
+             "<output>.<n>.bc with a manifest, for parallel code generation"),
+    cl::value_desc("N"), cl::init(0));
+
+static cl::opt<bool>
+    thinLTO("thinlto",
+            cl::desc("Write the ThinLTO module summary into the bitcode "
+                     "output, for linking with the host code using ThinLTO. "
+                     "Requires --link-host, whose target the output takes."),
+            cl::init(false));
+
 #include "commandlines.def"
 
 std::string getSuffix(std::string fname) {
@@ -69,6 +103,36 @@ int main(int argc, char *argv[]) {
   std::unique_ptr<llvm::Module> mod;
   std::unique_ptr<Context> Context;
   Options Opts = getWasmOptions(LogLevel);
+  if ((streamOutput || splitParts > 0) && getSuffix(outputPath) != ".bc") {
+    std::cerr << "--stream-output and --split-module require a .bc output path."
+              << std::endl;
+    return 1;
+  }
+  if (streamOutput && splitParts > 0) {
+    std::cerr << "--stream-output cannot be used with --split-module."
+              << std::endl;
+    return 1;
+  }
+  // a native ThinLTO link rejects the wasm32 target of the translated module.
+  if (thinLTO && linkHost.empty()) {
+    std::cerr << "--thinlto requires --link-host for the target of the output."
+              << std::endl;
+    return 1;
+  }
+  std::unique_ptr<FunctionStreamer> streamer;
+  if (streamOutput) {
+    streamer = std::make_unique<FunctionStreamer>(outputPath, streamChunkSize,
+                                                  thinLTO, LogLevel);
+    // the chunks are written before the host module is linked.
+    llvm::Triple triple;
+    std::string dataLayout;
+    if (!linkHost.empty()) {
+      if (!readHostTarget(linkHost.front(), Ctx, triple, dataLayout)) {
+        return 1;
+      }
+      streamer->setTarget(triple, dataLayout);
+    }
+  }
   if (inSuffix.size() == 0) {
     std::cout << "no extension for input file. exiting." << std::endl;
     return 0;
@@ -76,38 +140,49 @@ int main(int argc, char *argv[]) {
     std::cout << "Loading Wasm: " << inputFilename << std::endl;
     SMDiagnostic Err;
     mod = std::make_unique<llvm::Module>(outputPath, Ctx);
-    Context = parse_wasm(Ctx, *mod, Opts, inputFilename);
+    Context = parse_wasm(Ctx, *mod, Opts, inputFilename, outputPath,
+                         streamer.get());
   } else if (inSuffix == ".wat") {
     std::cout << "Loading Wat: " << inputFilename << std::endl;
     SMDiagnostic Err;
     mod = std::make_unique<llvm::Module>(outputPath, Ctx);
-    Context = parse_wat(Ctx, *mod, Opts, inputFilename);
+    Context = parse_wat(Ctx, *mod, Opts, inputFilename, outputPath,
+                        streamer.get());
   } else {
     std::cout << "unknown extension " << inSuffix << " for input file. exiting."
               << std::endl;
     return 0;
   }
 
+  for (const std::string &path : linkHost) {
+    if (!linkHostModule(*mod, path, LogLevel)) {
+      return 1;
+    }
+  }
+
   std::string outSuffix = getSuffix(outputPath);
-  if (outSuffix == ".ll") {
-    std::error_code EC;
-    llvm::raw_fd_ostream os(outputPath, EC);
-    if (EC) {
-      std::cerr << "Cannot open output file." << std::endl;
-      std::cerr << EC.message() << std::endl;
+  if (streamer != nullptr) {
+    if (!streamer->finish(*mod)) {
+      return 1;
+    }
+    std::cerr << "Bitcode dumped to " << outputPath << " and "
+              << streamer->getChunkPaths().size() << " function chunks"
+              << std::endl;
+  } else if (splitParts > 0) {
+    if (!splitModule(*mod, outputPath, splitParts, thinLTO, LogLevel)) {
+      return 1;
+    }
+    std::cerr << "Bitcode split into " << splitParts << " files, see the "
+              << "manifest next to " << outputPath << std::endl;
+  } else if (outSuffix == ".ll") {
+    if (!writeTextualIR(*mod, outputPath)) {
       std::abort();
     }
-    mod->print(os, nullptr);
     std::cerr << "IR dumped to " << outputPath << std::endl;
   } else if (outSuffix == ".bc") {
-    std::error_code EC;
-    llvm::raw_fd_ostream os(outputPath, EC);
-    if (EC) {
-      std::cerr << "Cannot open output file." << std::endl;
-      std::cerr << EC.message() << std::endl;
+    if (!writeBitcode(*mod, outputPath, thinLTO)) {
       std::abort();
     }
-    WriteBitcodeToFile(*mod, os);
     std::cerr << "Bitcode dumped to " << outputPath << std::endl;
   } else {
     std::cerr << "Unknown suffix for path: " << outputPath << std::endl;